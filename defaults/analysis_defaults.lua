@@ -2,6 +2,7 @@ spectrum_calc_particle_files = {}
 spectrum_calc_file_to_rank = {}
 spectrum_calc_chk_file = "chk.h5"
 spectrum_calc_out_file = "spectrum_out"
+spectrum_calc_read_chunk = 1000000
 
 spectrum_calc_save_particles = 0
 spectrum_calc_save_particles_file = "particles_out.h5"
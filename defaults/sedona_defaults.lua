@@ -51,6 +51,28 @@ transport_store_Jnu              = 1
 transport_use_ddmc               = 0
 transport_ddmc_tau_threshold     = 100
 transport_fleck_alpha            = 0
+-- "history" = follow one particle at a time; "event" = advance all particles in batches of events
+transport_mode                   = "history"
+-- "atomic" = tally radiation quantities with omp atomics; "private" = per-thread tally buffers
+transport_tally_mode             = "atomic"
+-- whether to count how many radiation tally updates go to zones shared by threads
+transport_tally_stats            = 0
+-- whether removing escaped/absorbed particles keeps the order of the rest
+transport_census_preserve_order  = 0
+-- "none" | "zone" | "morton" = reorder particles in space before propagating them each step
+transport_sort_particles         = "none"
+-- whether to split and russian roulette photon packets with per-zone weight windows
+transport_weight_windows         = 0
+-- packets are split/rouletted above/below this factor times the zone target energy
+transport_weight_window_width    = 2.0
+-- maximum number of packets a packet is split into at once
+transport_weight_window_max_split = 10
+-- lower bound of the zone importance 1/(1 + optical depth to the surface)
+transport_importance_min         = 0.01
+-- whether photon packets lose energy continuously to absorption instead of being destroyed
+transport_implicit_capture       = 0
+-- packets below this fraction of the mean packet energy are rouletted (with implicit capture)
+transport_implicit_capture_floor = 0.01
 
 -- whether or not to fix RNG seed
 transport_fix_rng_seed           = 0
@@ -80,6 +102,12 @@ particles_n_initialize         = 0
 particles_n_emit_pointsources  = 0
 particles_pointsource_file     = ""
 particles_last_iter_pump        = 1
+-- "random" | "sobol" = zone, time, position, direction and frequency of emitted particles
+-- from random numbers, or from a scrambled sobol (quasi-random) sequence
+particles_emission_sampling    = "random"
+-- "random" | "stratified" = zone of each thermal/radioactive particle drawn at random, or
+-- each zone given its expected number of particles (rounded up or down at random)
+particles_zone_sampling        = "random"
 multiply_particles_n_emit_by_dt_over_dtmax = 0
 force_rprocess_heating         = 0
 
@@ -124,6 +152,10 @@ opacity_no_ground_recomb                = 0
 opacity_minimum_extinction  		= 0
 opacity_maximum_opacity     		= 1e40
 opacity_no_scattering       		= 0
+opacity_interleave_tables   		= 1 -- store abs and scat opacity of each bin next to each other
+opacity_cache_tolerance     		= 0 -- reuse opacities of zones changed by less than this (0 = off)
+opacity_table_file          		= "" -- hdf5 table of LTE opacities made by snopac (output_opacity_table)
+opacity_batch_size          		= 1 -- zones whose opacities are calculated together (1 = one at a time)
 dont_decay_composition      		= 0
 
 opacity_compton_scatter_photons = 0;
@@ -148,3 +180,5 @@ gamma_nu_grid  = {1,1,1}
 
 spectrum_particle_list_name = ""
 spectrum_particle_list_maxn = 1e9 -- max number of particles stored at any time in each rank's escaped_particles list
+spectrum_particle_list_stream = 0 -- write escaped particles to <name>_stream_rank<n>.h5 as they escape, instead of keeping them in memory
+spectrum_particle_list_chunk = 100000 -- number of escaped particles each thread buffers before appending them to the stream file
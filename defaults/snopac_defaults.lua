@@ -15,6 +15,9 @@ output_wavelength_file = ""
 output_gas_state   = ""
 -- set this to somefilename to output mean opacities
 output_mean_opacities = ""
+-- set this to some hdf5 filename to add the opacities on the density and
+-- temperature grid to a table for transport (opacity_table_file)
+output_opacity_table = ""
 
 -- fuzz line data file
 sedona_home = os.getenv("SEDONA_HOME")
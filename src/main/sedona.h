@@ -4,7 +4,16 @@
 // define real to choose either double or float precision
 //typedef float real;
 typedef double real;
+
+// precision of the zone opacity and emissivity tables.
+// Compile with -DSEDONA_FLOAT_OPACITY to store them in
+// single precision (halves their memory); quantities that
+// are accumulated (J_nu, tallies) stay in double
+#ifdef SEDONA_FLOAT_OPACITY
+typedef float   OpacityType;
+#else
 typedef double  OpacityType;
+#endif
 
 #define DEFAULT_PARAM_FILE_NAME "param.lua"
 #define MPI_PARALLEL 1
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include "hdf5.h"
 #include "hdf5_hl.h"
 
@@ -168,10 +169,94 @@ int AtomicData::read_atomic_data(int z)
   if (status != 0)
     version = 1;
 
-  if (version == 1)
-    return read_atomic_data_oldstyle(z);
-  if (version == 2)
-    return read_atomic_data_newstyle(z);
+  int err = 0;
+  if (version == 1) err = read_atomic_data_oldstyle(z);
+  if (version == 2) err = read_atomic_data_newstyle(z);
+  set_line_table(z);
+  set_photo_cs_table(z);
+  return err;
+}
+
+//------------------------------------------------------------------------
+// Fill the photoionization cross-section table of species Z,
+// sampling the cross-section of every level at the bin centers
+// once, so that the bound-free opacities and rates don't have
+// to look them up for every frequency and zone
+//------------------------------------------------------------------------
+void AtomicData::set_photo_cs_table(int z)
+{
+  IndividualAtomData *atom = &(atomlist_[z]);
+  photo_cs_table_structure &pt = atom->photo_cs_table_;
+  int nl = atom->n_levels_;
+  if ((int)pt.n_bins.size() == nl) return;
+
+  int ng = nu_grid_.size();
+  pt.first_bin.assign(nl,0);
+  pt.n_bins.assign(nl,0);
+  pt.offset.assign(nl,0);
+  pt.sigma.clear();
+  for (int i=0;i<nl;++i)
+  {
+    pt.offset[i] = pt.sigma.size();
+    xy_array &s_photo = atom->levels_[i].s_photo;
+    if ((atom->levels_[i].ic == -1)||(s_photo.x.size() == 0)) continue;
+
+    // bins above threshold, up to the last non-zero one
+    double E_ion = atom->levels_[i].E_ion;
+    int first = -1, last = -1;
+    for (int k=0;k<ng;++k)
+    {
+      double E = pc::h*nu_grid_.center(k)*pc::ergs_to_ev;
+      if (E < E_ion) continue;
+      if (first < 0) first = k;
+      if (s_photo.value_at_with_zero_edges(E) != 0) last = k;
+    }
+    if (last < 0) continue;
+
+    pt.first_bin[i] = first;
+    pt.n_bins[i] = last - first + 1;
+    for (int k=first;k<=last;++k)
+      pt.sigma.push_back(s_photo.value_at_with_zero_edges(pc::h*nu_grid_.center(k)*pc::ergs_to_ev));
+  }
+}
+
+//------------------------------------------------------------------------
+// Fill the line table of species Z, with its lines sorted
+// by rest frequency, so that the bound-bound opacity walks
+// through the frequency grid in order
+//------------------------------------------------------------------------
+void AtomicData::set_line_table(int z)
+{
+  IndividualAtomData *atom = &(atomlist_[z]);
+  line_table_structure &lt = atom->line_table_;
+  int n = atom->n_lines_;
+  if ((int)lt.nu.size() == n) return;
+
+  std::vector<int> order(n);
+  for (int i=0;i<n;++i) order[i] = i;
+  std::stable_sort(order.begin(),order.end(),[atom](int a, int b)
+    {return atom->lines_[a].nu < atom->lines_[b].nu; });
+
+  lt.nu.resize(n);
+  lt.alpha_c.resize(n);
+  lt.emis_c.resize(n);
+  lt.a_c.resize(n);
+  lt.g_ratio.resize(n);
+  lt.ll.resize(n);
+  lt.lu.resize(n);
+  for (int i=0;i<n;++i)
+  {
+    const AtomicLine &lin = atom->lines_[order[i]];
+    double gl = 1.0*atom->levels_[lin.ll].g;
+    double gu = 1.0*atom->levels_[lin.lu].g;
+    lt.nu[i]      = lin.nu;
+    lt.alpha_c[i] = gu/gl*lin.A_ul/(8*pc::pi)*pc::c*pc::c;
+    lt.emis_c[i]  = lin.A_ul*pc::h/(4.0*pc::pi);
+    lt.a_c[i]     = lin.A_ul/4/pc::pi;
+    lt.g_ratio[i] = gl/gu;
+    lt.ll[i]      = lin.ll;
+    lt.lu[i]      = lin.lu;
+  }
 }
 
 
@@ -19,6 +19,31 @@ struct fuzz_line_structure
   std::vector<int>   bin;
 };
 
+// the lines of an atom sorted by rest frequency, in
+// separate arrays, with the constants of the bound-bound
+// opacity that don't depend on the gas state
+struct line_table_structure
+{
+  std::vector<double> nu;        // rest frequency (Hz)
+  std::vector<double> alpha_c;   // gu/gl*A_ul*c^2/(8 pi)
+  std::vector<double> emis_c;    // A_ul*h/(4 pi)
+  std::vector<double> a_c;       // A_ul/(4 pi), over dnu is the voigt a
+  std::vector<double> g_ratio;   // gl/gu
+  std::vector<int>    ll, lu;    // index of lower/upper level
+};
+
+// the photoionization cross-sections of the levels of an
+// atom at the centers of the frequency bins, from the first
+// bin above the ionization threshold to the last with a
+// non-zero cross-section; the values of level i are
+// sigma[offset[i] ... offset[i] + n_bins[i] - 1]
+struct photo_cs_table_structure
+{
+  std::vector<int>    first_bin;
+  std::vector<int>    n_bins;
+  std::vector<long>   offset;
+  std::vector<double> sigma;
+};
 
 struct AtomicIon
 {
@@ -90,6 +115,8 @@ public:
   int max_n_levels_;        // maximum number of levels per ion stage
 
   fuzz_line_structure fuzz_lines_; // vector of fuzz lines
+  line_table_structure line_table_; // lines sorted by frequency
+  photo_cs_table_structure photo_cs_table_; // cross-sections on the nu grid
 
   double get_ion_chi(int i) {
     return ions_[i].chi;
@@ -183,6 +210,8 @@ public:
   int read_atomic_data(int z);
   int read_atomic_data_oldstyle(int z);
   int read_atomic_data_newstyle(int z);
+  void set_line_table(int z);
+  void set_photo_cs_table(int z);
 
   void print();
   void print_detailed(int);
@@ -29,6 +29,11 @@ private:
 
   // frequency bin array
   locate_array nu_grid_;
+  // bin centers, and their inverse squares, for the line kernel
+  std::vector<double> nu_center_;
+  std::vector<double> nu_center_inv2_;
+  // photon energies (eV) of the bin centers
+  std::vector<double> nu_E_ev_;
 
   // pointer to atomic data holder
   IndividualAtomData *adata_;
@@ -102,6 +107,19 @@ public:
   void   line_expansion_opacity(std::vector<double>&,double);
   void   fuzzline_expansion_opacity(std::vector<double>& opac, double time);
 
+  // the same for a block of nb zones, each with its own level
+  // populations lev_n[b] and number density n_dens[b]; results
+  // are indexed [i_nu*nb + b], except for bound-bound, which
+  // is [b*n_nu + i_nu] as each zone has its own line widths
+  void   bound_free_opacity_batch(const int nb, const double* const* lev_n,
+           const double *n_dens, const double *T, const double *ne,
+           std::vector<double>& opac, std::vector<double>& emis);
+  void   bound_bound_opacity_batch(const int nb, const double* const* lev_n,
+           const double *n_dens, const double *beta_dop,
+           std::vector<double>& opac, std::vector<double>& emis);
+  void   line_expansion_opacity_batch(const int nb, const double* const* lev_n,
+           const double *n_dens, const double *time, std::vector<double>& opac);
+
   // returns
   int get_n_fuzz_lines()
   {
@@ -63,6 +63,17 @@ int AtomicSpecies::initialize(int Z, AtomicData *ad)
   n_levels_ = adata_->n_levels_;
   n_lines_  = adata_->n_lines_;
 
+  int n_nu = nu_grid_.size();
+  nu_center_.resize(n_nu);
+  nu_center_inv2_.resize(n_nu);
+  nu_E_ev_.resize(n_nu);
+  for (int j=0;j<n_nu;++j)
+  {
+    nu_center_[j] = nu_grid_.center(j);
+    nu_center_inv2_[j] = 1.0/(nu_center_[j]*nu_center_[j]);
+    nu_E_ev_[j] = pc::h*nu_center_[j]*pc::ergs_to_ev;
+  }
+
   // allocate memory for state data
   ion_part_.resize(n_ions_);
   ion_frac_.resize(n_ions_);
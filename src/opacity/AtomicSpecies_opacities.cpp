@@ -1,5 +1,6 @@
 #include "AtomicSpecies.h"
 #include "physical_constants.h"
+#include "fastmath.h"
 #include <iostream>
 #include <limits>
 
@@ -106,47 +107,64 @@ void AtomicSpecies::bound_free_opacity_general
     nc_phifac[j] = nc*gl_o_gc/2. * lam_t * lam_t * lam_t;
   }
 
-  // loop over and set opac/emis for each frequency
-  for (int i=0;i<ng;++i)
+  // every level adds to the bins of its cross-section in
+  // the table, with the boltzmann factors of those bins
+  // evaluated together in one batch
+  const photo_cs_table_structure &pt = adata_->photo_cs_table_;
+  std::vector<double> ezeta_net(ng);
+  for (int j=0;j<n_levels_;++j)
   {
-    double nu    = nu_grid_.center(i);
-    double E     = pc::h*nu*pc::ergs_to_ev;
-    double emis_fac   = 2. * pc::h*nu*nu*nu / pc::c / pc::c;
-
-    // summing the contribution of every level
-    for (int j=0;j<n_levels_;++j)
+    int n = pt.n_bins[j];
+    if (n == 0) continue;
+    int i0 = pt.first_bin[j];
+    const double *sig = &(pt.sigma[pt.offset[j]]);
+    const double *E   = &(nu_E_ev_[i0]);
+    const double *nu  = &(nu_center_[i0]);
+    double Eion = adata_->get_lev_Eion(j);
+
+    for (int k=0;k<n;++k) ezeta_net[k] = (Eion - E[k])/kt_ev;
+    fastmath::exp(ezeta_net.data(),ezeta_net.data(),n);
+
+    double n_lev  = n_dens_ * lev_n_[j];
+    double phi_ne = nc_phifac[j] * ne;
+    double phifac = nc_phifac[j];
+    // don't add in the emission of the ground level if flag set
+    int add_emis = !((adata_->get_lev_E(j) == 0)&&(no_ground_recomb_));
+
+    if (coolheat == 0)
     {
-      // check if above threshold and ionization state above
-      double Eion = adata_->get_lev_Eion(j);
-      int ic = adata_->get_lev_ic(j);
-      if (ic == -1) continue;
-      if (E < Eion) continue;
-
-      // get extinction coefficient and emissivity
-      double zeta_net = (Eion - E)/kt_ev;
-      double ezeta_net = exp(zeta_net);
-      double sigma = adata_->get_lev_photo_cs(j,E);
-      double opac_fac = n_dens_ * lev_n_[j]  - nc_phifac[j] * ne * ezeta_net;
-      // kill maser
-      if (opac_fac < 0)
-      	opac_fac = 0.;
-
-      // store opacity (with extra factor if wanted for heating)
-      if (coolheat == 0)
-        opac[i] += sigma * opac_fac;
-      else if (coolheat == 2)
-        opac[i] += sigma * (opac_fac) * (E - Eion) * pc::ev_to_ergs;
-
-      // store emissivity (don't add in ground lev if flag set)
-      if ((adata_->get_lev_E(j) == 0)&&(no_ground_recomb_))
-        continue;
-
-      if (coolheat == 0)
-	      emis[i]  += emis_fac *sigma* nc_phifac[j] * ezeta_net;
-      else if (coolheat == 1)
-        emis[i]  += emis_fac *sigma* nc_phifac[j] * ezeta_net * (E - Eion)/E;
+      double *op = &(opac[i0]);
+      double *em = &(emis[i0]);
+      for (int k=0;k<n;++k)
+      {
+        double opac_fac = n_lev - phi_ne * ezeta_net[k];
+        // kill maser
+        if (opac_fac < 0) opac_fac = 0.;
+        op[k] += sig[k] * opac_fac;
+        double emis_fac = 2. * pc::h*nu[k]*nu[k]*nu[k] / pc::c / pc::c;
+        if (add_emis) em[k] += emis_fac *sig[k]* phifac * ezeta_net[k];
+      }
+    }
+    else if (coolheat == 1)
+    {
+      if (!add_emis) continue;
+      double *em = &(emis[i0]);
+      for (int k=0;k<n;++k)
+      {
+        double emis_fac = 2. * pc::h*nu[k]*nu[k]*nu[k] / pc::c / pc::c;
+        em[k] += emis_fac *sig[k]* phifac * ezeta_net[k] * (E[k] - Eion)/E[k];
+      }
+    }
+    else
+    {
+      double *op = &(opac[i0]);
+      for (int k=0;k<n;++k)
+      {
+        double opac_fac = n_lev - phi_ne * ezeta_net[k];
+        if (opac_fac < 0) opac_fac = 0.;
+        op[k] += sig[k] * (opac_fac) * (E[k] - Eion) * pc::ev_to_ergs;
+      }
     }
-
   }
 }
 
@@ -220,66 +238,54 @@ double AtomicSpecies::collisional_net_cooling_rate(double ne, double T)
 //---------------------------------------------------------
 // calculate the bound-bound (i.e., line) extinction coefficient
 // (units cm^{-1}) and emissivity for all lines
+// The lines are taken in order of frequency from the line
+// table, so the bins they cover are found by walking along
+// the grid from those of the previous line
 //---------------------------------------------------------
 void AtomicSpecies::bound_bound_opacity(std::vector<double>& opac, std::vector<double>& emis)
 {
   // zero out arrays
   for (size_t i=0;i<opac.size();++i) {opac[i] = 0; emis[i] = 0;}
 
-  // loop over all lines
+  const line_table_structure &lt = adata_->line_table_;
+  const double *nu_c   = nu_center_.data();
+  const double *nu_ic2 = nu_center_inv2_.data();
+  double *op = opac.data();
+  double *em = emis.data();
+
+  int inu1 = 0, inu2 = 0;
   for (int i=0;i<n_lines_;++i)
   {
-    int lu  = adata_->get_line_u(i);
-    int ll  = adata_->get_line_l(i);
-
-    double nl    = lev_n_[ll];
-    double nu    = lev_n_[lu];
-    double gl    = 1.0*adata_->get_lev_g(ll);
-    double gu    = 1.0*adata_->get_lev_g(lu);
-    double nu_0  = adata_->get_line_nu(i);
-
-    double dnu   = line_beta_dop_*nu_0;
-    double A_ul  = adata_->get_line_A(i);
-    double gamma = A_ul;
-    double a_voigt = gamma/4/pc::pi/dnu;
-
-    // extinction coefficient
+    double nl = lev_n_[lt.ll[i]];
     if (nl == 0) continue;
-    double alpha_0 = nl*n_dens_*gu/gl*A_ul/(8*pc::pi)*pc::c*pc::c;
-    // correction for stimulated emission
-    alpha_0 = alpha_0*(1 - nu*gl/(nl*gu));
+    double nu_0  = lt.nu[i];
+    double dnu   = line_beta_dop_*nu_0;
 
-    //if (alpha_0 < 0) std::cout << "LASER " << levels_[ll].E << " " << levels[lu].E << "\n";
-    //if (alpha_0 < 0) {std::cout << "LASER: " << nlow*gup << " " << nup*glow << "\n"; continue;}
+    // extinction coefficient, corrected for stimulated emission
+    double nu    = lev_n_[lt.lu[i]];
+    double alpha_0 = nl*n_dens_*lt.alpha_c[i]*(1 - nu*lt.g_ratio[i]/nl);
     if (alpha_0 <= 0) continue;
 
-    //if (alpha_0/nu_0/nu_0/dnu*1e15 < 1e-10) continue;
-
     // don't bother calculating very small opacities
     if (alpha_0/(nu_0*nu_0*dnu) < minimum_extinction_) continue;
 
-    // region to add to -- hard code to 20 doppler widths
-    double nu_1 = nu_0 - dnu*5; //*30;
-    double nu_2 = nu_0 + dnu*5; //*30; //debug
-    int inu1 = nu_grid_.locate_within_bounds(nu_1);
-    int inu2 = nu_grid_.locate_within_bounds(nu_2);
+    // region to add to -- hard code to 5 doppler widths
+    inu1 = nu_grid_.locate_from(nu_0 - dnu*5,inu1);
+    inu2 = nu_grid_.locate_from(nu_0 + dnu*5,inu2);
 
     // line emissivity: ergs/sec/cm^3/str
     // multiplied by phi below to get per Hz
-    double line_j = A_ul*nu*n_dens_*pc::h/(4.0*pc::pi);
-    for (int j = inu1;j<inu2;++j)
+    double line_j  = nu*n_dens_*lt.emis_c[i];
+    double inv_dnu = 1.0/dnu;
+    double a_voigt = lt.a_c[i]*inv_dnu;
+    #pragma omp simd
+    for (int j=inu1;j<inu2;++j)
     {
-      double nu = nu_grid_.center(j);
-      double x  = (nu_0 - nu)/dnu;
-      double phi = voigt_profile_.getProfile(x,a_voigt)/dnu;
-      opac[j] += alpha_0/nu/nu*phi;
-      emis[j] += line_j*nu*phi;
-
-      //if (isnan(alpha_0/nu/nu*phi)) std::cout << alpha_0 << " " << nlow << " " << nup << "\n";
-    //  std::cout << nu_0 << " " << nu-nu_0 << " " << line_j*nu*phi/(alpha_0/nu/nu*phi) << " "
-    //    << 2*pc::h*nu*nu*nu/pc::c/pc::c/(exp(pc::h*nu/pc::k/gas_temp_) - 1) << "\n";
+      double x   = (nu_0 - nu_c[j])*inv_dnu;
+      double phi = VoigtProfile::profile(x,a_voigt)*inv_dnu;
+      op[j] += alpha_0*nu_ic2[j]*phi;
+      em[j] += line_j*nu_c[j]*phi;
     }
-    //printf("%e %e %e %d %d\n",lines_[i].nu,nl,alpha_0,inu1,inu2,nu_grid[inu2]);
   }
 }
 
@@ -373,3 +379,179 @@ void AtomicSpecies::line_expansion_opacity
   for (size_t i=0;i<opac.size();i++)
      opac[i] = opac[i]*nu_grid_.center(i)/nu_grid_.delta(i)/pc::c/time;
 }
+
+
+//---------------------------------------------------------
+// Bound-free extinction coefficient and emissivity of a
+// block of nb zones, the same as bound_free_opacity of
+// each
+//---------------------------------------------------------
+void AtomicSpecies::bound_free_opacity_batch(const int nb, const double* const* lev_n,
+  const double *n_dens, const double *T, const double *ne,
+  std::vector<double>& opac, std::vector<double>& emis)
+{
+  int ng = nu_grid_.size();
+  std::fill(opac.begin(),opac.end(),0);
+  std::fill(emis.begin(),emis.end(),0);
+
+  std::vector<double> kt_ev(nb), lam_t(nb);
+  for (int b=0;b<nb;++b)
+  {
+    kt_ev[b] = pc::k_ev*T[b];
+    lam_t[b] = sqrt(pc::h*pc::h/(2*pc::pi*pc::m_e* pc::k * T[b]));
+  }
+
+  std::vector<double> nc_phifac(n_levels_*nb,0.0), lev_Eion(n_levels_);
+  for (int j=0;j<n_levels_;++j)
+  {
+    lev_Eion[j] = adata_->get_lev_Eion(j);
+    int ic = adata_->get_lev_ic(j);
+    if (ic == -1) continue;
+    int gl = adata_->get_lev_g(j);
+    int gc = adata_->get_lev_g(ic);
+    double gl_o_gc = (1.0*gl)/(1.0*gc);
+    for (int b=0;b<nb;++b)
+    {
+      double nc = n_dens[b]*lev_n[b][ic];
+      nc_phifac[j*nb+b] = nc*gl_o_gc/2. * lam_t[b] * lam_t[b] * lam_t[b];
+    }
+  }
+
+  // every level adds to the bins of its cross-section in
+  // the table, for all zones; the boltzmann factors of those
+  // bins in all zones are evaluated together in one batch
+  const photo_cs_table_structure &pt = adata_->photo_cs_table_;
+  std::vector<double> ezeta_net(ng*nb);
+  for (int j=0;j<n_levels_;++j)
+  {
+    int n = pt.n_bins[j];
+    if (n == 0) continue;
+    int i0 = pt.first_bin[j];
+    const double *sig = &(pt.sigma[pt.offset[j]]);
+    const double *E   = &(nu_E_ev_[i0]);
+    const double *nu  = &(nu_center_[i0]);
+    double Eion = lev_Eion[j];
+
+    for (int k=0;k<n;++k)
+      for (int b=0;b<nb;++b)
+        ezeta_net[k*nb+b] = (Eion - E[k])/kt_ev[b];
+    fastmath::exp(ezeta_net.data(),ezeta_net.data(),n*nb);
+
+    int add_emis = !((adata_->get_lev_E(j) == 0)&&(no_ground_recomb_));
+    const double *phifac = &(nc_phifac[j*nb]);
+    for (int k=0;k<n;++k)
+    {
+      double emis_fac = 2. * pc::h*nu[k]*nu[k]*nu[k] / pc::c / pc::c;
+      const double *ezeta = &(ezeta_net[k*nb]);
+      double *op = &(opac[(i0+k)*nb]);
+      double *em = &(emis[(i0+k)*nb]);
+      for (int b=0;b<nb;++b)
+      {
+        double opac_fac = n_dens[b] * lev_n[b][j]  - phifac[b] * ne[b] * ezeta[b];
+        // kill maser
+        if (opac_fac < 0) opac_fac = 0.;
+        op[b] += sig[k] * opac_fac;
+        if (add_emis) em[b] += emis_fac *sig[k]* phifac[b] * ezeta[b];
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------
+// Bound-bound extinction coefficient and emissivity of a
+// block of nb zones, the same as bound_bound_opacity of
+// each. Every line is read once for the whole block, and
+// each zone keeps its own place on the frequency grid
+//---------------------------------------------------------
+void AtomicSpecies::bound_bound_opacity_batch(const int nb, const double* const* lev_n,
+  const double *n_dens, const double *beta_dop,
+  std::vector<double>& opac, std::vector<double>& emis)
+{
+  int ng = nu_grid_.size();
+  std::fill(opac.begin(),opac.end(),0);
+  std::fill(emis.begin(),emis.end(),0);
+
+  const line_table_structure &lt = adata_->line_table_;
+  const double *nu_c   = nu_center_.data();
+  const double *nu_ic2 = nu_center_inv2_.data();
+
+  std::vector<int> inu1(nb,0), inu2(nb,0);
+  for (int i=0;i<n_lines_;++i)
+  {
+    int    ll    = lt.ll[i];
+    int    lu    = lt.lu[i];
+    double nu_0  = lt.nu[i];
+    for (int b=0;b<nb;++b)
+    {
+      double nl = lev_n[b][ll];
+      if (nl == 0) continue;
+      double dnu = beta_dop[b]*nu_0;
+
+      double nu      = lev_n[b][lu];
+      double alpha_0 = nl*n_dens[b]*lt.alpha_c[i]*(1 - nu*lt.g_ratio[i]/nl);
+      if (alpha_0 <= 0) continue;
+      if (alpha_0/(nu_0*nu_0*dnu) < minimum_extinction_) continue;
+
+      inu1[b] = nu_grid_.locate_from(nu_0 - dnu*5,inu1[b]);
+      inu2[b] = nu_grid_.locate_from(nu_0 + dnu*5,inu2[b]);
+
+      double line_j  = nu*n_dens[b]*lt.emis_c[i];
+      double inv_dnu = 1.0/dnu;
+      double a_voigt = lt.a_c[i]*inv_dnu;
+      double *op = &(opac[b*ng]);
+      double *em = &(emis[b*ng]);
+      #pragma omp simd
+      for (int j=inu1[b];j<inu2[b];++j)
+      {
+        double x   = (nu_0 - nu_c[j])*inv_dnu;
+        double phi = VoigtProfile::profile(x,a_voigt)*inv_dnu;
+        op[j] += alpha_0*nu_ic2[j]*phi;
+        em[j] += line_j*nu_c[j]*phi;
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------
+// Sobolev expansion opacity of a block of nb zones, the
+// same as line_expansion_opacity of each. Every line is
+// read once for the whole block
+//---------------------------------------------------------
+void AtomicSpecies::line_expansion_opacity_batch(const int nb, const double* const* lev_n,
+  const double *n_dens, const double *time, std::vector<double>& opac)
+{
+  std::fill(opac.begin(),opac.end(),0);
+
+  for (int i=0;i<n_lines_;++i)
+  {
+    int    ll  = adata_->get_line_l(i);
+    int    lu  = adata_->get_line_u(i);
+    double gl  = 1.0*adata_->get_lev_g(ll);
+    double gu  = 1.0*adata_->get_lev_g(lu);
+    double nu_0  = adata_->get_line_nu(i);
+    double lam   = pc::c/nu_0;
+    double f_lu  = adata_->get_line_f(i);
+    double *op   = &(opac[adata_->get_line_bin(i)*nb]);
+
+    for (int b=0;b<nb;++b)
+    {
+      double nl  = lev_n[b][ll];
+      double nu  = lev_n[b][lu];
+      if (nl < std::numeric_limits<double>::min()) continue;
+
+      // Sobolev optical depth, corrected for stimulated emission
+      double tau = nl*n_dens[b]*pc::sigma_tot*f_lu*time[b]*lam;
+      tau = tau*(1 - nu*gl/(nl*gu));
+      if (nu*gl > nl*gu) tau = 0;
+
+      double etau = exp(-tau);
+      if (!isnan(etau)) op[b] += (1 - etau);
+    }
+  }
+
+  // renormalize opacity array
+  int ng = nu_grid_.size();
+  for (int i=0;i<ng;i++)
+    for (int b=0;b<nb;b++)
+      opac[i*nb+b] = opac[i*nb+b]*nu_grid_.center(i)/nu_grid_.delta(i)/pc::c/time[b];
+}
@@ -215,31 +215,36 @@ void AtomicSpecies::calculate_radiative_rates(std::vector<real> J_nu)
   // recombination rate includes stimulated recombination
   double fac1 = 2/pc::c/pc::c;
 
-  int ng = nu_grid_.size();
-  for (int i=1;i<ng;++i)
+  // every level sums over the bins of its cross-section in
+  // the table (leaving out the first bin of the grid)
+  const photo_cs_table_structure &pt = adata_->photo_cs_table_;
+  for (int j=0;j<n_levels_;++j)
   {
-    double nu     = nu_grid_.center(i);
-    double E_ergs = pc::h*nu;
-    double E_ev   = E_ergs*pc::ergs_to_ev;
-
-    double J      = J_nu[i];
-    double dnu    = nu_grid_.delta(i);
-    for (int j=0;j<n_levels_;++j)
+    int n = pt.n_bins[j];
+    if (n == 0) continue;
+    int i0 = pt.first_bin[j];
+    const double *sig = &(pt.sigma[pt.offset[j]]);
+    double chi = adata_->get_lev_Eion(j);
+
+    double Pic = 0, Rci = 0;
+    for (int k=(i0 == 0);k<n;++k)
     {
-      int ic = adata_->get_lev_ic(j);
-      if (ic == -1) continue;
-      double chi = adata_->get_lev_Eion(j);
-      if (E_ev < chi) continue;
+      int i = i0 + k;
+      double nu     = nu_center_[i];
+      double E_ergs = pc::h*nu;
+      double E_ev   = E_ergs*pc::ergs_to_ev;
+      double J      = J_nu[i];
+      double dnu    = nu_grid_.delta(i);
 
       // photoionization term
-      double sigma = adata_->get_lev_photo_cs(j,E_ev);
-      double Jterm = sigma*J/E_ergs;
-      lev_Pic_[j] += Jterm*dnu;
+      double Jterm = sig[k]*J/E_ergs;
+      Pic += Jterm*dnu;
 
       // recombination term
-      lev_Rci_[j] += (sigma*fac1*nu*nu + Jterm)*exp(-1.0*(E_ev - chi)/pc::k_ev/gas_temp_)*dnu;
-
+      Rci += (sig[k]*fac1*nu*nu + Jterm)*exp(-1.0*(E_ev - chi)/pc::k_ev/gas_temp_)*dnu;
     }
+    lev_Pic_[j] = Pic;
+    lev_Rci_[j] = Rci;
   }
 
   // multiply by overall factors
@@ -8,6 +8,23 @@
 #include "hdf5.h"
 #include "hdf5_hl.h"
 
+//-----------------------------------------------------------
+// The solved state of the gas in one zone, saved so that
+// the opacities of a block of zones can be calculated
+// together with GasState::computeOpacityBatch
+//-----------------------------------------------------------
+struct GasZoneState
+{
+  double dens, temp, time, n_elec;
+  double bulk_grey_opacity, total_grey_opacity;
+  double free_free_factor;
+  std::vector<double> mass_frac;
+
+  // per atom
+  std::vector<double> n_dens, gas_temp, line_beta_dop;
+  std::vector< std::vector<double> > lev_n, ion_frac, ion_part;
+};
+
 class GasState
 {
 
@@ -216,7 +233,28 @@ class GasState
   //***********************************************************
   void computeOpacity(std::vector<OpacityType>&, std::vector<OpacityType>&,
 		      std::vector<OpacityType>&);
+
+  //-----------------------------------------------------------
+  // save the current (solved) state in s, or set the state
+  // back to the one saved in s
+  //-----------------------------------------------------------
+  void save_zone_state(GasZoneState& s);
+  void load_zone_state(const GasZoneState& s);
+
+  //-----------------------------------------------------------
+  // the same opacities as computeOpacity, for the n saved
+  // states of zones, calculated together: the frequency
+  // kernels loop over the zones innermost, so the atomic
+  // data is read once for the whole block. The results of
+  // zone b go in abs[b], scat[b] and tot_emis[b]. Leaves
+  // the gas in the state of the last zone
+  //-----------------------------------------------------------
+  void computeOpacityBatch(const GasZoneState *zones, const int n,
+    std::vector< std::vector<OpacityType> >& abs,
+    std::vector< std::vector<OpacityType> >& scat,
+    std::vector< std::vector<OpacityType> >& tot_emis);
   double electron_scattering_opacity();
+  double free_free_factor();
   void free_free_opacity  (std::vector<double>&, std::vector<double>&);
   double free_free_heating_rate(double, std::vector<real>);
   double free_free_cooling_rate(double);
@@ -1,5 +1,6 @@
 #include "GasState.h"
 #include "physical_constants.h"
+#include "fastmath.h"
 #include <iostream>
 
 namespace pc = physical_constants;
@@ -23,6 +24,17 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
   // zero out passed opacity arrays
   for (int i=0;i<ns;i++) {abs[i] = 0; scat[i] = 0; tot_emis[i] = 0;}
 
+  // planck function at the gas temperature, for the
+  // emissivities of the grey and expansion opacities
+  std::vector<double> bnu(ns);
+  for (int i=0;i<ns;i++) bnu[i] = 1.0*pc::h*nu_grid_.center(i)/pc::k/temp_;
+  fastmath::exp(bnu.data(),bnu.data(),ns);
+  for (int i=0;i<ns;i++)
+  {
+    double nu = nu_grid_.center(i);
+    bnu[i] = 2.0*nu*nu*nu*pc::h/pc::c/pc::c/(bnu[i]-1);
+  }
+
   //-----------------------------------------
   /// if grey opacity, just do simple thing
   //-----------------------------------------
@@ -33,10 +45,7 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
     {
       abs[i]  = gopac*epsilon_;
       scat[i] = gopac*(1-epsilon_);
-      double nu = nu_grid_.center(i);
-      double ezeta = exp(1.0*pc::h*nu/pc::k/temp_);
-      double bb =  2.0*nu*nu*nu*pc::h/pc::c/pc::c/(ezeta-1);
-      tot_emis[i] += bb*abs[i];
+      tot_emis[i] += bnu[i]*abs[i];
     }
   }
 
@@ -98,10 +107,7 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
       for (int i=0;i<ns;i++) {
     	 abs[i]  += aopac[i];
     	 scat[i] += opac[i] - aopac[i];
-       double nu = nu_grid_.center(i);
-       double ezeta = exp(1.0*pc::h*nu/pc::k/temp_);
-       double bb =  2.0*nu*nu*nu*pc::h/pc::c/pc::c/(ezeta-1);
-       tot_emis[i] += bb*aopac[i];
+       tot_emis[i] += bnu[i]*aopac[i];
       }
     }
 
@@ -112,10 +118,7 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
       for (int i=0;i<ns;i++) {
 	     abs[i]  += aopac[i];
 	     scat[i] += opac[i] - aopac[i];
-       double nu = nu_grid_.center(i);
-       double ezeta = exp(1.0*pc::h*nu/pc::k/temp_);
-       double bb =  2.0*nu*nu*nu*pc::h/pc::c/pc::c/(ezeta-1);
-       tot_emis[i] += bb*aopac[i];
+       tot_emis[i] += bnu[i]*aopac[i];
       }
     }
 
@@ -136,6 +139,299 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
 }
 
 
+//----------------------------------------------------------------
+// save the current state of the gas, as solved for a zone
+//----------------------------------------------------------------
+void GasState::save_zone_state(GasZoneState& s)
+{
+  int na = atoms.size();
+  s.dens   = dens_;
+  s.temp   = temp_;
+  s.time   = time_;
+  s.n_elec = n_elec_;
+  s.bulk_grey_opacity  = bulk_grey_opacity_;
+  s.total_grey_opacity = total_grey_opacity_;
+  s.free_free_factor = 0;
+  if ((total_grey_opacity_ == 0)&&(use_free_free_opacity))
+    s.free_free_factor = free_free_factor();
+  s.mass_frac = mass_frac;
+
+  s.n_dens.resize(na);
+  s.gas_temp.resize(na);
+  s.line_beta_dop.resize(na);
+  s.lev_n.resize(na);
+  s.ion_frac.resize(na);
+  s.ion_part.resize(na);
+  for (int i=0;i<na;i++)
+  {
+    s.n_dens[i]        = atoms[i].n_dens_;
+    s.gas_temp[i]      = atoms[i].gas_temp_;
+    s.line_beta_dop[i] = atoms[i].line_beta_dop_;
+    s.lev_n[i]         = atoms[i].lev_n_;
+    s.ion_frac[i]      = atoms[i].ion_frac_;
+    s.ion_part[i]      = atoms[i].ion_part_;
+  }
+}
+
+//----------------------------------------------------------------
+// set the gas back to a saved state
+//----------------------------------------------------------------
+void GasState::load_zone_state(const GasZoneState& s)
+{
+  int na = atoms.size();
+  dens_   = s.dens;
+  temp_   = s.temp;
+  time_   = s.time;
+  n_elec_ = s.n_elec;
+  bulk_grey_opacity_  = s.bulk_grey_opacity;
+  total_grey_opacity_ = s.total_grey_opacity;
+  mass_frac = s.mass_frac;
+  for (int i=0;i<na;i++)
+  {
+    atoms[i].n_dens_        = s.n_dens[i];
+    atoms[i].gas_temp_      = s.gas_temp[i];
+    atoms[i].line_beta_dop_ = s.line_beta_dop[i];
+    atoms[i].lev_n_         = s.lev_n[i];
+    atoms[i].ion_frac_      = s.ion_frac[i];
+    atoms[i].ion_part_      = s.ion_part[i];
+  }
+}
+
+//----------------------------------------------------------------
+// calculate the total absorptive and scattering opacity of
+// a block of n zones, from their saved states. Each kernel
+// fills arrays indexed [i_nu*nb + b] for the nb non-grey
+// zones, and they are added up in the same order as in
+// computeOpacity, so the results are the same
+//----------------------------------------------------------------
+void GasState::computeOpacityBatch(const GasZoneState *zones, const int n,
+  std::vector< std::vector<OpacityType> >& abs,
+  std::vector< std::vector<OpacityType> >& scat,
+  std::vector< std::vector<OpacityType> >& tot_emis)
+{
+  int ns = nu_grid_.size();
+  int na = atoms.size();
+
+  // planck function at the gas temperature of each zone
+  std::vector<double> bnu(ns*n);
+  for (int i=0;i<ns;i++)
+    for (int b=0;b<n;b++) bnu[i*n+b] = 1.0*pc::h*nu_grid_.center(i)/pc::k/zones[b].temp;
+  fastmath::exp(bnu.data(),bnu.data(),ns*n);
+  for (int i=0;i<ns;i++)
+  {
+    double nu = nu_grid_.center(i);
+    for (int b=0;b<n;b++) bnu[i*n+b] = 2.0*nu*nu*nu*pc::h/pc::c/pc::c/(bnu[i*n+b]-1);
+  }
+
+  // grey zones are done right away, the rest go to the kernels
+  std::vector<int> lane;
+  for (int b=0;b<n;b++)
+  {
+    for (int i=0;i<ns;i++) {abs[b][i] = 0; scat[b][i] = 0; tot_emis[b][i] = 0;}
+    if (zones[b].total_grey_opacity == 0) {lane.push_back(b); continue; }
+    double gopac = zones[b].dens*zones[b].total_grey_opacity;
+    for (int i=0;i<ns;i++)
+    {
+      abs[b][i]  = gopac*epsilon_;
+      scat[b][i] = gopac*(1-epsilon_);
+      tot_emis[b][i] += bnu[i*n+b]*abs[b][i];
+    }
+  }
+  int nb = lane.size();
+  if (nb == 0) {load_zone_state(zones[n-1]); return; }
+
+  // properties of the zones in the kernels
+  std::vector<double> temp(nb), ne(nb), time(nb);
+  std::vector< std::vector<const double*> > lev_n(na, std::vector<const double*>(nb));
+  std::vector< std::vector<double> > n_dens(na, std::vector<double>(nb));
+  std::vector< std::vector<double> > gas_temp(na, std::vector<double>(nb));
+  std::vector< std::vector<double> > beta_dop(na, std::vector<double>(nb));
+  for (int k=0;k<nb;k++)
+  {
+    const GasZoneState &z = zones[lane[k]];
+    temp[k] = z.temp;
+    ne[k]   = z.n_elec;
+    time[k] = z.time;
+    for (int a=0;a<na;a++)
+    {
+      lev_n[a][k]    = z.lev_n[a].data();
+      n_dens[a][k]   = z.n_dens[a];
+      gas_temp[a][k] = z.gas_temp[a];
+      beta_dop[a][k] = z.line_beta_dop[a];
+    }
+  }
+
+  std::vector<double> opac(ns*nb), aopac(ns*nb), emis(ns*nb);
+  std::vector<double> atom_opac(ns*nb), atom_emis(ns*nb);
+
+  //---
+  if (use_electron_scattering_opacity)
+  {
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      double es_opac = pc::thomson_cs*ne[k];
+      for (int i=0;i<ns;i++)
+      {
+        scat[b][i] += es_opac;
+        // debug -- small amount of thermalizing in e-scat
+        abs[b][i]  += 1e-20*epsilon_*es_opac;
+      }
+    }
+  }
+
+  //---
+  if (use_free_free_opacity)
+  {
+    for (int i=0;i<ns;i++)
+      for (int k=0;k<nb;k++) emis[i*nb+k] = -1.0*pc::h*nu_grid_.center(i)/pc::k/temp[k];
+    fastmath::exp(emis.data(),emis.data(),ns*nb);
+    for (int i=0;i<ns;i++)
+    {
+      double nu = nu_grid_.center(i);
+      for (int k=0;k<nb;k++)
+      {
+        double fac = zones[lane[k]].free_free_factor;
+        double ezeta = emis[i*nb+k];
+        double bb =  2.0*nu*nu*nu*pc::h/pc::c/pc::c/(1.0/ezeta-1);
+        opac[i*nb+k] = fac/nu/nu/nu*(1 - ezeta);
+        emis[i*nb+k] = opac[i*nb+k]*bb;
+      }
+    }
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      for (int i=0;i<ns;i++)
+      {
+        abs[b][i] += opac[i*nb+k];
+        tot_emis[b][i] += emis[i*nb+k];
+      }
+    }
+  }
+
+  //---
+  if (use_bound_free_opacity)
+  {
+    std::fill(opac.begin(),opac.end(),0);
+    std::fill(emis.begin(),emis.end(),0);
+    for (int a=0;a<na;a++)
+    {
+      atoms[a].bound_free_opacity_batch(nb,lev_n[a].data(),n_dens[a].data(),
+        gas_temp[a].data(),ne.data(),atom_opac,atom_emis);
+      for (int m=0;m<ns*nb;m++)
+      {
+        opac[m] += atom_opac[m];
+        emis[m] += atom_emis[m];
+      }
+    }
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      for (int i=0;i<ns;i++)
+      {
+        abs[b][i]      += opac[i*nb+k];
+        tot_emis[b][i] += emis[i*nb+k]*ne[k];
+      }
+    }
+  }
+
+  //---
+  if (use_bound_bound_opacity)
+  {
+    // indexed [b*ns + i_nu]
+    std::fill(opac.begin(),opac.end(),0);
+    std::fill(emis.begin(),emis.end(),0);
+    for (int a=0;a<na;a++)
+    {
+      atoms[a].bound_bound_opacity_batch(nb,lev_n[a].data(),n_dens[a].data(),
+        beta_dop[a].data(),atom_opac,atom_emis);
+      for (int m=0;m<ns*nb;m++)
+      {
+        opac[m] += atom_opac[m];
+        emis[m] += atom_emis[m];
+      }
+    }
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      for (int i=0;i<ns;i++)
+      {
+        abs[b][i] += opac[k*ns+i];
+        tot_emis[b][i] += emis[k*ns+i];
+      }
+    }
+  }
+
+  //---
+  if (use_line_expansion_opacity)
+  {
+    std::fill(opac.begin(),opac.end(),0);
+    std::fill(aopac.begin(),aopac.end(),0);
+    for (int a=0;a<na;a++)
+    {
+      // get epsilon (absorptive fraction) for this atom
+      double this_eps = epsilon_;
+      for (unsigned int m=0;m<atom_zero_epsilon_.size();m++)
+        if (atom_zero_epsilon_[m] == atoms[a].atomic_number)
+          this_eps = 0;
+
+      atoms[a].line_expansion_opacity_batch(nb,lev_n[a].data(),n_dens[a].data(),
+        time.data(),atom_opac);
+      for (int m=0;m<ns*nb;m++)
+      {
+        opac[m]  += atom_opac[m];
+        aopac[m] += atom_opac[m]*this_eps;
+      }
+    }
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      for (int i=0;i<ns;i++)
+      {
+        abs[b][i]  += aopac[i*nb+k];
+        scat[b][i] += opac[i*nb+k] - aopac[i*nb+k];
+        tot_emis[b][i] += bnu[i*n+b]*aopac[i*nb+k];
+      }
+    }
+  }
+
+  //---
+  // the fuzz line and user defined opacities are done
+  // one zone at a time
+  if ((use_fuzz_expansion_opacity)||(use_user_opacity_))
+  {
+    std::vector<double> zopac(ns), zaopac(ns), zemis(ns), eps(ns);
+    for (int k=0;k<nb;k++)
+    {
+      int b = lane[k];
+      load_zone_state(zones[b]);
+      if (use_fuzz_expansion_opacity)
+      {
+        fuzz_expansion_opacity(zopac,zaopac);
+        for (int i=0;i<ns;i++)
+        {
+          abs[b][i]  += zaopac[i];
+          scat[b][i] += zopac[i] - zaopac[i];
+          tot_emis[b][i] += bnu[i*n+b]*zaopac[i];
+        }
+      }
+      if (use_user_opacity_)
+      {
+        get_user_defined_opacity(zopac, eps, zemis);
+        for (int i=0;i<ns;i++)
+        {
+          abs[b][i]  += zopac[i]*eps[i];
+          scat[b][i] += zopac[i]*(1 - eps[i]);
+          tot_emis[b][i] += zemis[i];
+        }
+      }
+    }
+  }
+
+  load_zone_state(zones[n-1]);
+}
+
+
 //----------------------------------------------------------------
 // simple electron scattering opacity
 //----------------------------------------------------------------
@@ -146,17 +442,13 @@ double GasState::electron_scattering_opacity()
 
 
 //----------------------------------------------------------------
-// free-free opacity (brehmstrahlung)
-// note the gaunt factor is being set to 1 here
+// the frequency independent factor of the free-free opacity,
+// from the sum of n_ion*Z**2 over all ions
 //----------------------------------------------------------------
-void GasState::free_free_opacity(std::vector<double>& opac, std::vector<double>& emis)
+double GasState::free_free_factor()
 {
-  int npts   = nu_grid_.size();
   int natoms = atoms.size();
 
-  // zero out opacity/emissivity vector
-  for (int j=0;j<npts;j++) {opac[j] = 0; emis[j] = 0; }
-
   // calculate sum of n_ion*Z**2
   double fac = 0;
   for (int i=0;i<natoms;i++)
@@ -170,12 +462,32 @@ void GasState::free_free_opacity(std::vector<double>& opac, std::vector<double>&
   }
   // multiply by overall constants
   fac *= 3.7e8*pow(temp_,-0.5)*n_elec_;
+  return fac;
+}
+
+
+//----------------------------------------------------------------
+// free-free opacity (brehmstrahlung)
+// note the gaunt factor is being set to 1 here
+//----------------------------------------------------------------
+void GasState::free_free_opacity(std::vector<double>& opac, std::vector<double>& emis)
+{
+  int npts   = nu_grid_.size();
+
+  // zero out opacity/emissivity vector
+  for (int j=0;j<npts;j++) {opac[j] = 0; emis[j] = 0; }
+
+  double fac = free_free_factor();
+
+  // boltzmann factors, in one batch
+  for (int i=0;i<npts;i++) emis[i] = -1.0*pc::h*nu_grid_.center(i)/pc::k/temp_;
+  fastmath::exp(emis.data(),emis.data(),npts);
 
   // multiply by frequency dependence
   for (int i=0;i<npts;i++)
   {
     double nu = nu_grid_.center(i);
-    double ezeta = exp(-1.0*pc::h*nu/pc::k/temp_);
+    double ezeta = emis[i];
     double bb =  2.0*nu*nu*nu*pc::h/pc::c/pc::c/(1.0/ezeta-1);
     opac[i] = fac/nu/nu/nu*(1 - ezeta);
     emis[i] = opac[i]*bb;
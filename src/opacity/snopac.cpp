@@ -1,11 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
+#include <algorithm>
 #include "GasState.h"
 #include "locate_array.h"
 #include "physical_constants.h"
 #include "ParameterReader.h"
 #include "sedona.h"
+#include "lte_opacity_table.h"
 
 #ifdef MPI_PARALLEL
 #include <mpi.h>
@@ -26,6 +28,7 @@ static void write_mesa_file(std::string);
 static void write_frequency_file(std::string, int);
 static void write_gas_state(std::string);
 static void write_mean_opacities(std::string);
+static void write_opacity_table(std::string, int, int);
 static int verbose;
 
 
@@ -106,6 +109,7 @@ verbose = (my_rank == 0);
     = params.getScalar<int>("opacity_bound_bound");
   gas.use_free_free_opacity
     = params.getScalar<int>("opacity_free_free");
+  gas.epsilon_ = params.getScalar<double>("opacity_epsilon");
   gas.bulk_grey_opacity_ = 0;
   gas.use_zone_specific_grey_opacity_ = 0;
   gas.line_velocity_width_ = params.getScalar<double>("line_velocity_width");
@@ -139,6 +143,9 @@ verbose = (my_rank == 0);
   std::string meanfile = params.getScalar<string>("output_mean_opacities");
   if (meanfile != "") write_mean_opacities(meanfile);
 
+  std::string tablefile = params.getScalar<string>("output_opacity_table");
+  if (tablefile != "") write_opacity_table(tablefile,my_rank,n_procs);
+
 #ifdef MPI_PARALLEL
   MPI_Finalize();
 #endif
@@ -274,6 +281,74 @@ void write_mean_opacities(std::string outfile)
 
 
 
+//*********************************************************
+// Add the opacities of this composition and time, on the
+// grid of density and temperature, as a group to an HDF5
+// table that transport can use instead of solving the
+// gas state (opacity_table_file). The grid points are
+// split among the MPI ranks
+//*********************************************************
+void write_opacity_table(std::string outfile, int my_rank, int n_procs)
+{
+  if (params.getScalar<int>("use_logR"))
+  {
+    if (verbose) std::cerr << "# ERROR: opacity tables need a grid of density, not logR\n";
+    return;
+  }
+
+  vector<double> temperature_list = params.getArray<double>("temperature");
+  vector<double> density_list     = params.getArray<double>("density");
+  int n_rho = density_list.size();
+  int n_T   = temperature_list.size();
+  int ng    = nu_grid.size();
+
+  vector<double> log_T(n_T);
+  for (int j=0;j<n_T;j++) log_T[j] = log10(temperature_list[j]);
+
+  // opacities and electrons per gram
+  vector<double> abs_table(1L*n_rho*n_T*ng,0.0);
+  vector<double> scat_table(1L*n_rho*n_T*ng,0.0);
+  vector<double> elec_table(n_rho*n_T,0.0);
+
+  for (int k=my_rank;k<n_rho*n_T;k+=n_procs)
+  {
+    double this_dens = pow(10,density_list[k/n_T]);
+    gas.temp_ = temperature_list[k%n_T];
+    gas.dens_ = this_dens;
+    std::vector<double> J_nu;
+    gas.solve_state(J_nu);
+    gas.computeOpacity(abs_opacity,scat_opacity,emissivity);
+
+    for (int i=0;i<ng;i++)
+    {
+      abs_table[1L*k*ng + i]  = abs_opacity[i]/this_dens;
+      scat_table[1L*k*ng + i] = scat_opacity[i]/this_dens;
+    }
+    elec_table[k] = gas.get_electron_density()/this_dens;
+  }
+
+#ifdef MPI_PARALLEL
+  // every point was done by one rank, so sum onto rank 0
+  double *tables[3] = {abs_table.data(), scat_table.data(), elec_table.data()};
+  long sizes[3] = {(long)abs_table.size(), (long)scat_table.size(), (long)elec_table.size()};
+  for (int t=0;t<3;t++)
+    for (long i=0;i<sizes[t];i+=Max_MPI_Blocksize)
+    {
+      int this_size = std::min((long)Max_MPI_Blocksize,sizes[t] - i);
+      if (my_rank == 0)
+        MPI_Reduce(MPI_IN_PLACE,tables[t]+i,this_size,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+      else
+        MPI_Reduce(tables[t]+i,NULL,this_size,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+    }
+#endif
+
+  if (my_rank != 0) return;
+  lte_opacity_table::write_group(outfile,gas.time_,params.getVector<int>("elements_Z"),
+    params.getVector<int>("elements_A"),params.getVector<double>("mass_fractions"),
+    density_list,log_T,nu_grid,abs_table,scat_table,elec_table);
+  std::cout << "# Wrote " << n_rho << " x " << n_T << " opacity table to " << outfile << "\n";
+}
+
 //*********************************************************
 // Write an opacity table in mesa format
 //*********************************************************
@@ -0,0 +1,103 @@
+#ifndef _RNG_STREAM_H
+#define _RNG_STREAM_H 1
+
+#include <stdint.h>
+
+//**********************************************************
+// Counter-based random number stream (Philox4x32-10,
+// Salmon et al. 2011).
+//
+// Every random number is a pure function of the key (the
+// run seed), the stream id (e.g. a particle id) and the
+// index of the draw within the stream. A stream is thus
+// fully described by (id, count), and can be stored with a
+// particle and picked up again by any thread or rank.
+// The object is small and all inline, so it is meant to be
+// made once per particle history and passed down by
+// reference to everything that draws random numbers.
+// Each evaluation of the generator gives 128 random bits,
+// which are used for two consecutive doubles.
+//**********************************************************
+class RNG_stream
+{
+
+private:
+
+  uint32_t key_[2];
+  uint64_t id_;
+  uint64_t count_;
+  uint32_t block_[4];
+
+  static void mulhilo(const uint32_t a, const uint32_t b, uint32_t &hi, uint32_t &lo)
+  {
+    uint64_t prod = (uint64_t)a*(uint64_t)b;
+    hi = (uint32_t)(prod >> 32);
+    lo = (uint32_t)prod;
+  }
+
+  // fill block_ with the random bits for counter block n
+  void generate(const uint64_t n)
+  {
+    uint32_t c[4] = {(uint32_t)n, (uint32_t)(n >> 32), (uint32_t)id_, (uint32_t)(id_ >> 32)};
+    uint32_t k0 = key_[0], k1 = key_[1];
+    for (int r=0;r<10;r++)
+    {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53u,c[0],hi0,lo0);
+      mulhilo(0xCD9E8D57u,c[2],hi1,lo1);
+      c[0] = hi1 ^ c[1] ^ k0;
+      c[1] = lo1;
+      c[2] = hi0 ^ c[3] ^ k1;
+      c[3] = lo0;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    block_[0] = c[0];
+    block_[1] = c[1];
+    block_[2] = c[2];
+    block_[3] = c[3];
+  }
+
+public:
+
+  RNG_stream() : id_(0), count_(0)
+    {key_[0] = key_[1] = 0; block_[0] = block_[1] = block_[2] = block_[3] = 0; }
+
+  //------------------------------------------------------
+  // point the stream at draw number count of stream id
+  //------------------------------------------------------
+  void set(const uint64_t key, const uint64_t id, const uint64_t count)
+  {
+    key_[0] = (uint32_t)key;
+    key_[1] = (uint32_t)(key >> 32);
+    id_     = id;
+    count_  = count;
+    if (count_ & 1) generate(count_ >> 1);
+  }
+
+  uint64_t id()    const {return id_; }
+  uint64_t count() const {return count_; }
+
+  //------------------------------------------------------
+  // uniform random number in [0,1), with 53 random bits
+  //------------------------------------------------------
+  double uniform()
+  {
+    if (!(count_ & 1)) generate(count_ >> 1);
+    const uint32_t *w = block_ + 2*(count_ & 1);
+    count_++;
+    return ((w[0] >> 5)*67108864.0 + (w[1] >> 6))*(1.0/9007199254740992.0);
+  }
+
+  //------------------------------------------------------
+  // the next n uniform random numbers, in the order that
+  // n calls of uniform() would give them
+  //------------------------------------------------------
+  void fill(double *r, const int n)
+  {
+    for (int k=0;k<n;k++) r[k] = uniform();
+  }
+
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _ALIGNED_ALLOCATOR_H
+#define _ALIGNED_ALLOCATOR_H 1
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+// byte alignment of the allocated arrays (one cache line)
+#define ALIGNED_ALLOCATOR_ALIGN 64
+
+//**********************************************************
+// Minimal allocator so that std::vector data starts
+// on a cache line boundary
+//**********************************************************
+template <class T> class aligned_allocator
+{
+public:
+
+  typedef T value_type;
+
+  aligned_allocator() {}
+  template <class U> aligned_allocator(const aligned_allocator<U>&) {}
+
+  T* allocate(std::size_t n)
+  {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, ALIGNED_ALLOCATOR_ALIGN, n*sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t) { free(ptr); }
+
+  template <class U> struct rebind { typedef aligned_allocator<U> other; };
+};
+
+template <class T, class U>
+bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&) {return true;}
+template <class T, class U>
+bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&) {return false;}
+
+#endif
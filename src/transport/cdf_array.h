@@ -12,6 +12,10 @@
 // monitonically increasing and reaches unity
 // We can sample from it using a binary search.
 // the CDF value at locate_array's "min" is assumed to be 0
+//
+// When normalized, it also builds a Walker/Vose alias
+// table of the same distribution, which samples an index
+// in constant time with a single random number
 //**********************************************************
 
 template < class T> class cdf_array
@@ -20,7 +24,12 @@ template < class T> class cdf_array
 private:
   
   std::vector<T> y;
-  
+
+  // alias table: bin i is kept with probability prob[i],
+  // otherwise its alias is returned
+  std::vector<T>   prob;
+  std::vector<int> alias;
+
 public:
 
   void resize(const int n)  {y.resize(n); }
@@ -72,6 +81,57 @@ void normalize()
   double N = y.back();
   for (int i=0;i<y.size();i++)   y[i] /= N;
 
+  build_alias();
+}
+
+//------------------------------------------------------
+// Build the alias table from the current (normalized)
+// CDF, using Vose's method. Needs to be called again if
+// the CDF is changed with set() after normalizing
+//------------------------------------------------------
+void build_alias()
+{
+  int n = y.size();
+  prob.resize(n);
+  alias.resize(n);
+  if (n == 0) return;
+
+  // probabilities scaled so that the mean is 1
+  std::vector<double> p(n);
+  double sum = 0;
+  for (int i=0;i<n;i++)
+  {
+    p[i] = get_value(i);
+    if (!(p[i] > 0)) p[i] = 0;
+    sum += p[i];
+  }
+  for (int i=0;i<n;i++) p[i] = (sum > 0) ? p[i]*n/sum : 1.0;
+
+  // split bins into those below and above the mean
+  std::vector<int> small, large;
+  small.reserve(n);
+  large.reserve(n);
+  for (int i=0;i<n;i++)
+  {
+    if (p[i] < 1) small.push_back(i);
+    else large.push_back(i);
+  }
+
+  // fill each small bin up to the mean from a large one
+  while (!small.empty() && !large.empty())
+  {
+    int s = small.back(); small.pop_back();
+    int l = large.back(); large.pop_back();
+    prob[s]  = p[s];
+    alias[s] = l;
+    p[l] = (p[l] + p[s]) - 1;
+    if (p[l] < 1) small.push_back(l);
+    else large.push_back(l);
+  }
+
+  // what is left over is full, up to roundoff
+  for (size_t k=0;k<large.size();k++) {prob[large[k]] = 1; alias[large[k]] = large[k]; }
+  for (size_t k=0;k<small.size();k++) {prob[small[k]] = 1; alias[small[k]] = small[k]; }
 }
 
 
@@ -88,6 +148,24 @@ int sample(const double yval) const
   return v;
 }
 
+//---------------------------------------------------------
+// Sample the probability distribution in constant time
+// using the alias table. Pass a random number between 0
+// and 1; its integer part (times size) picks the bin, the
+// fractional part decides between the bin and its alias.
+// Gives the same distribution as sample(), but not the
+// same index for a given random number
+//---------------------------------------------------------
+int sample_alias(const double yval) const
+{
+  int n = prob.size();
+  if (n <= 1) return 0;
+  double x = yval*n;
+  int i = (int)x;
+  if (i >= n) i = n - 1;
+  return (x - i < prob[i]) ? i : alias[i];
+}
+
 
 //------------------------------------------------------
 // Simple printout
@@ -103,6 +181,8 @@ void print() const{
 void wipe()
 {
   y.assign(y.size(), 0.0);
+  prob.assign(prob.size(), 0.0);
+  alias.assign(alias.size(), 0);
 }
   
 //------------------------------------------------------------
@@ -0,0 +1,106 @@
+#include <math.h>
+#include <stdio.h>
+#include <ctime>
+#include <vector>
+#include <iostream>
+#include "cdf_array.h"
+#include "RNG_stream.h"
+
+//------------------------------------------------------------
+// Benchmark of sampling a cdf_array with binary search
+// vs with the alias table, for tables the size of a large
+// zone emission distribution (10^6 zones) and a fine
+// frequency grid (10^5 bins). Also checks that the two
+// give the same distribution.
+//------------------------------------------------------------
+
+double cpu_time()
+{
+  return ((double)clock())/(double)CLOCKS_PER_SEC;
+}
+
+// a bumpy distribution spanning many orders of magnitude,
+// with some empty bins
+void setup(cdf_array<double>& cdf, const int n)
+{
+  cdf.resize(n);
+  for (int i=0;i<n;i++)
+  {
+    double x = 1.0*i/n;
+    double w = exp(-20*x)*(1 + 0.9*sin(200*x)) + 1e-6;
+    if (i%97 == 0) w = 0;
+    cdf.set_value(i,w);
+  }
+  cdf.normalize();
+}
+
+void benchmark(const int n, const long n_samples, const std::vector<double>& u)
+{
+  cdf_array<double> cdf;
+  double t0 = cpu_time();
+  setup(cdf,n);
+  double t_build = cpu_time() - t0;
+
+  long nu = u.size();
+
+  // binary search
+  t0 = cpu_time();
+  long check_bs = 0;
+  for (long k=0;k<n_samples;k++)
+  {
+    int i = cdf.sample(u[k%nu]);
+    check_bs += i;
+  }
+  double t_bs = cpu_time() - t0;
+
+  // alias table
+  t0 = cpu_time();
+  long check_al = 0;
+  for (long k=0;k<n_samples;k++)
+  {
+    int i = cdf.sample_alias(u[k%nu]);
+    check_al += i;
+  }
+  double t_al = cpu_time() - t0;
+
+  // compare the sampled distributions to the exact one,
+  // binned coarsely, using each random number once
+  int n_coarse = 100;
+  std::vector<double> h_bs(n_coarse,0), h_al(n_coarse,0), h_ex(n_coarse,0);
+  for (long k=0;k<nu;k++)
+  {
+    h_bs[(long)cdf.sample(u[k])*n_coarse/n] += 1.0/nu;
+    h_al[(long)cdf.sample_alias(u[k])*n_coarse/n] += 1.0/nu;
+  }
+  for (int i=0;i<n;i++) h_ex[(long)i*n_coarse/n] += cdf.get_value(i);
+  double dev_bs = 0, dev_al = 0;
+  for (int i=0;i<n_coarse;i++)
+  {
+    double sigma = sqrt(h_ex[i]/nu) + 1e-300;
+    dev_bs = std::max(dev_bs,fabs(h_bs[i] - h_ex[i])/sigma);
+    dev_al = std::max(dev_al,fabs(h_al[i] - h_ex[i])/sigma);
+  }
+
+  printf("--- %d bins, %ld samples ---\n",n,n_samples);
+  printf("  build (normalize + alias) : %10.4f secs\n",t_build);
+  printf("  binary search             : %10.4f secs  (%.1f ns/sample)\n",t_bs,1e9*t_bs/n_samples);
+  printf("  alias table               : %10.4f secs  (%.1f ns/sample)\n",t_al,1e9*t_al/n_samples);
+  printf("  speedup                   : %10.2f\n",t_bs/t_al);
+  printf("  mean index (bs, alias)    : %.2f %.2f\n",1.0*check_bs/n_samples,1.0*check_al/n_samples);
+  printf("  max deviation (bs, alias) : %.2f %.2f sigma\n",dev_bs,dev_al);
+}
+
+int main()
+{
+  // reuse a block of random numbers, so that the
+  // generator is not part of the timing
+  long n_rand = 1 << 22;
+  std::vector<double> u(n_rand);
+  RNG_stream rng;
+  rng.set(1234,0,0);
+  rng.fill(u.data(),n_rand);
+
+  long n_samples = 10000000;
+  benchmark(1000000,n_samples,u);
+  benchmark(100000,n_samples,u);
+}
@@ -0,0 +1,199 @@
+#include <math.h>
+#include "compton_tables.h"
+
+//------------------------------------------------------------
+// set up all tables
+//------------------------------------------------------------
+void compton_tables::init()
+{
+  // photon energies from ~2e-4 to ~4e3 m_e c^2. Below, the
+  // angles are interpolated to the Thomson limit; above,
+  // the largest energy is used. The mean scattering angle
+  // is good to ~3e-5 in between nodes
+  e_min_ = -11;
+  e_max_ =  13;
+  kn_per_octave_ = 32;
+  mu_per_octave_ = 16;
+  n_mu_u_ = 257;
+  n_mb_u_ = 4097;
+
+  //-------------------------------------------
+  // klein-nishina factor
+  //-------------------------------------------
+  int n_kn = (e_max_ - e_min_)*kn_per_octave_ + 1;
+  kn_.resize(n_kn);
+  for (int i=0;i<n_kn;i++)
+    kn_[i] = klein_nishina_exact(node_energy(i,kn_per_octave_));
+
+  //-------------------------------------------
+  // scattering angles. The differential cross-section is
+  // smooth in s = log(E_new/E_old), which runs from
+  // -log(1+2x) (backscattering) to 0 (forward); integrate
+  // it on a fine grid in s and invert. Row 0 is the
+  // Thomson limit, row i+1 energy node i
+  //-------------------------------------------
+  int n_rows = (e_max_ - e_min_)*mu_per_octave_ + 2;
+  int n_fine = 4096;
+  std::vector<double> s(n_fine+1), cdf(n_fine+1);
+  mu_.resize(n_rows*n_mu_u_);
+  for (int j=0;j<n_mu_u_;j++)
+  {
+    // root of mu^3 + 3 mu + 4 - 8u = 0
+    double q = 4.0*j/(n_mu_u_ - 1) - 2;
+    double d = sqrt(q*q + 1);
+    mu_[j] = cbrt(q + d) + cbrt(q - d);
+  }
+  for (int i=1;i<n_rows;i++)
+  {
+    double x = node_energy(i-1,mu_per_octave_);
+    double s_min = -log1p(2*x);
+
+    // dsigma/ds, with r = E_new/E_old
+    double g_last = 0;
+    for (int k=0;k<=n_fine;k++)
+    {
+      s[k] = s_min*(1 - 1.0*k/n_fine);
+      double r  = exp(s[k]);
+      double mu = 1 - expm1(-s[k])/x;
+      double g  = r*r + 1 - r*(1 - mu*mu);
+      if (k == 0) cdf[k] = 0;
+      else cdf[k] = cdf[k-1] + 0.5*(g + g_last)*(s[k] - s[k-1]);
+      g_last = g;
+    }
+
+    double *row = &mu_[i*n_mu_u_];
+    int k = 0;
+    for (int j=0;j<n_mu_u_;j++)
+    {
+      double c = cdf[n_fine]*j/(n_mu_u_ - 1);
+      while ((k < n_fine-1)&&(cdf[k+1] < c)) k++;
+      double f = (c - cdf[k])/(cdf[k+1] - cdf[k]);
+      double sc = s[k] + f*(s[k+1] - s[k]);
+      row[j] = 1 - expm1(-sc)/x;
+    }
+  }
+  for (int i=0;i<n_rows;i++)
+  {
+    mu_[i*n_mu_u_] = -1;
+    mu_[(i+1)*n_mu_u_ - 1] = 1;
+  }
+
+  //-------------------------------------------
+  // maxwell-boltzmann speeds, from inverting the CDF
+  // erf(y) - 2y exp(-y^2)/sqrt(pi) by bisection; the
+  // distribution is cut off at 5 times the thermal speed
+  //-------------------------------------------
+  double y_max = 5;
+  mb_.resize(n_mb_u_);
+  for (int j=0;j<n_mb_u_;j++)
+  {
+    double u = 1.0*j/(n_mb_u_ - 1);
+    double lo = 0, hi = y_max;
+    for (int it=0;it<60;it++)
+    {
+      double y = 0.5*(lo + hi);
+      double F = erf(y) - 2*y*exp(-y*y)/sqrt(M_PI);
+      if (F < u) lo = y;
+      else hi = y;
+    }
+    mb_[j] = 0.5*(lo + hi);
+  }
+  mb_[0] = 0;
+  mb_[n_mb_u_-1] = y_max;
+}
+
+
+//------------------------------------------------------------
+// energy of node i of a grid with n_per_octave nodes per
+// factor of two
+//------------------------------------------------------------
+double compton_tables::node_energy(const int i, const int n_per_octave) const
+{
+  int e = e_min_ + i/n_per_octave;
+  int k = i%n_per_octave;
+  return ldexp(1 + 1.0*k/n_per_octave, e - 1);
+}
+
+//------------------------------------------------------------
+// find the node i below x and the interpolation weight w
+// of node i+1. Returns -1 if x is below the grid, +1 if it
+// is above, and 0 otherwise
+//------------------------------------------------------------
+int compton_tables::locate(const double x, const int n_per_octave, int &i, double &w) const
+{
+  int e;
+  double m = frexp(x,&e);
+  if ((!(x > 0))||(e < e_min_)) return -1;
+  if (e >= e_max_) return 1;
+  double t = (2*m - 1)*n_per_octave;
+  int k = (int)t;
+  i = (e - e_min_)*n_per_octave + k;
+  w = t - k;
+  return 0;
+}
+
+
+//------------------------------------------------------------
+// Klein_Nishina correction to the Compton cross-section
+//------------------------------------------------------------
+double compton_tables::klein_nishina(const double x) const
+{
+  int i;
+  double w;
+  if (locate(x,kn_per_octave_,i,w) != 0) return klein_nishina_exact(x);
+  return kn_[i] + w*(kn_[i+1] - kn_[i]);
+}
+
+double compton_tables::klein_nishina_exact(const double x)
+{
+  // series expansion where the full expression cancels badly
+  if (x < 0.01) return 1 + x*(-2 + x*(26./5 + x*(-133./10 + x*1144./35)));
+
+  double logfac = log(1 + 2*x);
+  double term1 = (1+x)/x/x/x*(2*x*(1+x)/(1+2*x) - logfac);
+  double term2 = 1.0/2.0/x*logfac;
+  double term3 = -1.0*(1 + 3*x)/(1+2*x)/(1+2*x);
+  return .75*(term1 + term2 + term3);
+}
+
+
+//------------------------------------------------------------
+// sample cos(theta) of klein-nishina scattering
+//------------------------------------------------------------
+double compton_tables::sample_cos_theta(const double x, const double u) const
+{
+  double t = u*(n_mu_u_ - 1);
+  int j = (int)t;
+  if (j > n_mu_u_ - 2) j = n_mu_u_ - 2;
+  double f = t - j;
+
+  // row of the energy node below x
+  int i;
+  double w;
+  int where = locate(x,mu_per_octave_,i,w);
+  if (where == 0) i++;
+  if (where < 0) {i = 0; w = (x > 0) ? x/node_energy(0,mu_per_octave_) : 0; }
+  if (where > 0) {i = (e_max_ - e_min_)*mu_per_octave_; w = 1; }
+
+  const double *r0 = &mu_[i*n_mu_u_ + j];
+  const double *r1 = r0 + n_mu_u_;
+  double mu0 = r0[0] + f*(r0[1] - r0[0]);
+  double mu1 = r1[0] + f*(r1[1] - r1[0]);
+  double mu = mu0 + w*(mu1 - mu0);
+  if (mu >  1) mu =  1;
+  if (mu < -1) mu = -1;
+  return mu;
+}
+
+
+//------------------------------------------------------------
+// sample a maxwell-boltzmann speed
+//------------------------------------------------------------
+double compton_tables::sample_MB_speed(const double u) const
+{
+  double t = u*(n_mb_u_ - 1);
+  int j = (int)t;
+  if (j > n_mb_u_ - 2) j = n_mb_u_ - 2;
+  double f = t - j;
+  return mb_[j] + f*(mb_[j+1] - mb_[j]);
+}
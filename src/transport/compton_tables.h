@@ -0,0 +1,77 @@
+#ifndef _COMPTON_TABLES_H
+#define _COMPTON_TABLES_H 1
+
+#include <vector>
+
+//**********************************************************
+// Precomputed tables for sampling Compton scattering
+//
+//  - the Klein-Nishina correction to the Thomson
+//    cross-section, as a function of photon energy
+//  - the inverse CDF of the Klein-Nishina scattering angle,
+//    per photon energy (energy x random number -> cos theta)
+//  - the inverse CDF of the Maxwell-Boltzmann speed of the
+//    scattering electrons (random number -> speed)
+//
+// Photon energies x are in units of m_e c^2. The energy
+// grid has a fixed number of nodes per factor of two,
+// uniformly spaced within each octave, so that a node is
+// found from the binary exponent of x without taking a log.
+// All lookups interpolate linearly
+//**********************************************************
+class compton_tables
+{
+
+private:
+
+  // energy grid covers 2^(e_min_-1) <= x <= 2^(e_max_-1)
+  int e_min_, e_max_;
+  int kn_per_octave_, mu_per_octave_;
+
+  // number of random number nodes of the inverse CDFs
+  int n_mu_u_, n_mb_u_;
+
+  // klein-nishina factor at the energy nodes
+  std::vector<double> kn_;
+  // cos(theta) at the random number nodes; the Thomson
+  // limit, then one row per energy node
+  std::vector<double> mu_;
+  // speed in units of sqrt(2kT/m_e) at the random number nodes
+  std::vector<double> mb_;
+
+  double node_energy(const int i, const int n_per_octave) const;
+  int    locate(const double x, const int n_per_octave, int &i, double &w) const;
+
+public:
+
+  compton_tables() : e_min_(0), e_max_(0), kn_per_octave_(0), mu_per_octave_(0),
+    n_mu_u_(0), n_mb_u_(0) {}
+
+  void init();
+
+  //------------------------------------------------------
+  // klein-nishina factor (sigma/sigma_thomson) at photon
+  // energy x = E/(m_e c^2)
+  //------------------------------------------------------
+  double klein_nishina(const double x) const;
+  static double klein_nishina_exact(const double x);
+
+  //------------------------------------------------------
+  // cosine of the scattering angle of a photon of energy
+  // x = E/(m_e c^2) off an electron at rest, for a random
+  // number u in [0,1). The energy ratio E_new/E_old
+  // follows from it as 1/(1 + x*(1 - cos theta))
+  //------------------------------------------------------
+  double sample_cos_theta(const double x, const double u) const;
+
+  //------------------------------------------------------
+  // Maxwell-Boltzmann speed in units of sqrt(2kT/m_e)
+  // for a random number u in [0,1)
+  //------------------------------------------------------
+  double sample_MB_speed(const double u) const;
+
+  double memory_bytes() const
+    {return 1.0*(kn_.size() + mu_.size() + mb_.size())*sizeof(double); }
+};
+
+#endif
@@ -15,7 +15,7 @@ namespace pc = physical_constants;
 // Reference: Gentile, J. of Comput. Physics 172, 543–571 (2001)
 // This is only implemented for 1D spherical so far
 // ------------------------------------------------------
-ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
+ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt, RNG_stream &rng)
 {
   int stop = 0;
 
@@ -38,23 +38,21 @@ ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
     zone *zone = &(grid->z[p.ind]);
 
     // add in tally of absorbed and total radiation energy
-    #pragma omp atomic
-    zone->e_abs += p.e*ddmc_P_abs_[p.ind];
+    tally_.add(radiation_tally::e_abs, p.ind, p.e*ddmc_P_abs_[p.ind]);
     //zone->e_rad += p.e*ddmc_P_stay_[p.ind];
-    #pragma omp atomic
-    J_nu_[p.ind][0] += p.e*ddmc_P_stay_[p.ind]*dt*pc::c;
+    tally_.add_J_nu(p.ind, 0, p.e*ddmc_P_stay_[p.ind]*dt*pc::c);
 
     // total probability of diffusing in some direction
     double P_diff = ddmc_P_up_[p.ind]  + ddmc_P_dn_[p.ind];
     double P_stay = ddmc_P_abs_[p.ind] + ddmc_P_stay_[p.ind];
 
     // randomly choose whether to diffuse
-    double r1 = rangen.uniform();
+    double r1 = rng.uniform();
     if (r1 < P_diff)
     {
       // find dimension to diffuse in...
       // move up or down in this dimension
-      double r2 = rangen.uniform();
+      double r2 = rng.uniform();
       if (r2 < ddmc_P_up_[p.ind]/P_diff)
       {
         p.ind++;
@@ -76,7 +74,7 @@ ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
     else
     {
       // check for absorption
-      double r2 = rangen.uniform();
+      double r2 = rng.uniform();
       double f_abs = ddmc_P_abs_[p.ind]/P_stay;
       // see if absorbed
       if (r2 < f_abs) { return absorbed;}
@@ -108,7 +106,7 @@ ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
 // Reference: Densmore+, J. of Comput. Physics 222, 485-503 (2007)
 // This is only implemented for 1D spherical also.
 // ------------------------------------------------------
-ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
+ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop, RNG_stream &rng)
 {
   enum ParticleEvent {scatter, boundary, tstep};
   ParticleEvent event;
@@ -203,7 +201,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
 
     double sigma_leak_tot = sigma_leak_left + sigma_leak_right;
 
-    double xi = rangen.uniform();
+    double xi = rng.uniform();
     double d_stay, d_leak;
     bool leaked2imc = false;
 
@@ -221,7 +219,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
       {d_sc = std::numeric_limits<double>::infinity();}
     else  // non-grey case
     {
-      double tau_r = -1.0*log(rangen.uniform());
+      double tau_r = -1.0*log(rng.uniform());
       if (eps_i_cmf > 0.0)
       {
         k_es_inelastic = sigma_i*eps_i_cmf;
@@ -253,10 +251,8 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
     // tally the contribution of zone's radiation energy
     // only one factor of dshift above because opacity is in cmf,
     // just need to covert p.e from lab to cmf.
-    #pragma omp atomic
-    J_nu_[p.ind][0] += p.e*this_d;
-    #pragma omp atomic
-    grid->z[p.ind].e_abs  += (p.e*dshift)*this_d*sigma_i*eps_i_cmf;
+    tally_.add_J_nu(p.ind, 0, p.e*this_d);
+    tally_.add(radiation_tally::e_abs, p.ind, (p.e*dshift)*this_d*sigma_i*eps_i_cmf);
 
     // Perform the event with a smaller distance
     if (event == scatter)  // effective scattering
@@ -265,7 +261,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
       int now_i_nu = i_nu;
       while (now_i_nu == i_nu)
       {
-        fate = do_scatter(&p,1.0);
+        fate = do_scatter(&p,1.0,rng);
         dshift = dshift_lab_to_comoving(&p);
         now_i_nu = get_opacity(p,dshift,sigma_i,eps_i_cmf);
       }
@@ -279,7 +275,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
     else if (event == boundary) // Leak to adjacent zone
     {
       double P_leak_left = sigma_leak_left / sigma_leak_tot;
-      double xi2 = rangen.uniform();
+      double xi2 = rng.uniform();
 
       // Step 1: leakage to the neighboring zone
       double dr;
@@ -290,7 +286,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
         p.ind--;
         double rr = p.r();
         dr = rr - r_m;
-        if (ddmc_on_im1) dr += rangen.uniform()*dxm1;
+        if (ddmc_on_im1) dr += rng.uniform()*dxm1;
         else dr *= (1.0 + ddmc_sml_push);
         //dr += rangen.uniform()*dxm1;
 
@@ -309,7 +305,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
           // Sample velocity from face of blackbody
           // in case of DDMC-to-IMC leakage
           transform_lab_to_comoving(&p);
-          sample_dir_from_blackbody_surface(&p);
+          sample_dir_from_blackbody_surface(&p,rng);
 
           mu = (p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2]) / p.r();
           if (mu > 0.0)  // make sure it points toward -ve radial direction
@@ -324,7 +320,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
         p.ind++;
         double rr = p.r();
         dr = r_p - rr;
-        if (ddmc_on_ip1) dr += rangen.uniform()*dxp1;
+        if (ddmc_on_ip1) dr += rng.uniform()*dxp1;
         else dr *= (1.0 + ddmc_sml_push);
         //dr += rangen.uniform()*dxp1;
 
@@ -342,7 +338,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
           // Sample velocity from face of blackbody
           // in case of DDMC-to-IMC leakage
           transform_lab_to_comoving(&p);
-          sample_dir_from_blackbody_surface(&p);
+          sample_dir_from_blackbody_surface(&p,rng);
 
           mu = (p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2]) / p.r();
           if (mu < 0.0)  // make sure it points towards +ve radial direction
@@ -395,7 +391,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
 // gets converted into DDMC. If the particle is not converted,
 // it is returned to the MC region.
 // ------------------------------------------------------
-int transport::move_across_DDMC_interface(particle &p, int new_ind, double sigma_i, double dr)
+int transport::move_across_DDMC_interface(particle &p, int new_ind, double sigma_i, double dr, RNG_stream &rng)
 {
   // gather information for neighboring zone
   int ip = p.ind + 1;
@@ -444,11 +440,11 @@ int transport::move_across_DDMC_interface(particle &p, int new_ind, double sigma
   // Alternative formalism in Densmore, Evans, and Buksas (2008)
   //p_convert = 4.0 * (0.91 + 1.635*mu) / (3.0*sigma_i*dr + 6.0*0.7104);
 
-  double xi = rangen.uniform();
+  double xi = rng.uniform();
   std::vector<double> rand;
-  rand.push_back(rangen.uniform());
-  rand.push_back(rangen.uniform());
-  rand.push_back(rangen.uniform());
+  rand.push_back(rng.uniform());
+  rand.push_back(rng.uniform());
+  rand.push_back(rng.uniform());
   double new_r[3];
   double ddmc_sml_push = 1.0e-8;
 
@@ -490,7 +486,7 @@ int transport::move_across_DDMC_interface(particle &p, int new_ind, double sigma
     }
 
     // emit from blackbody face in comoving frame
-    sample_dir_from_blackbody_surface(&p);
+    sample_dir_from_blackbody_surface(&p,rng);
 
     // make sure the particle moves away from the zone face
     double mu = (p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2]) / p.r();
@@ -546,7 +542,7 @@ void transport::setup_RandomWalk(){
   for(int i=0; i<npoints; i++)
     randomwalk_Pescape[i] /= randomwalk_Pescape[npoints-1];
 }
-void random_direction(double dir[3], thread_RNG& rangen){
+void random_direction(double dir[3], RNG_stream& rng){
   // double magnitude = 0;
   // for(int i=0; i<3; i++){
   //   dir[i] = rangen.uniform();
@@ -554,9 +550,9 @@ void random_direction(double dir[3], thread_RNG& rangen){
   // }
   // magnitude = sqrt(magnitude);
   // for(int i=0; i<3; i++) dir[i] /= magnitude;
-  double costheta = 2.*rangen.uniform() - 1.;
+  double costheta = 2.*rng.uniform() - 1.;
   double sintheta = sqrt(1.-costheta*costheta);
-  double phi = 2.*M_PI * rangen.uniform();
+  double phi = 2.*M_PI * rng.uniform();
   dir[0] = sintheta * cos(phi);
   dir[1] = sintheta * sin(phi);
   dir[2] = costheta;
@@ -593,7 +589,7 @@ double interpolate_CDF(const vector<double>& CDF, const locate_array& x, const d
   assert(result<=P2);
   return result;
 }
-ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
+ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop, RNG_stream &rng)
 {
   int stop = 0;
   if (steady_state) t_stop = 1e99;
@@ -619,7 +615,7 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
     double X = dt_remaining*D/(dx*dx);
 
     double dt_step, R_diffuse;
-    double u = rangen.uniform();
+    double u = rng.uniform();
     double sampled_X = sample_CDF(randomwalk_Pescape, randomwalk_x, u);
     if (sampled_X < X)
     { // particle reaches surface before census
@@ -645,19 +641,17 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
     //#pragma omp atomic
     //zone->e_abs += p.e*ddmc_P_abs_[p.ind];
     //zone->e_rad += p.e*ddmc_P_stay_[p.ind];
-    #pragma omp atomic
-    J_nu_[p.ind][0] += p.e*dt_step*pc::c;
-    #pragma omp atomic
-    grid->z[p.ind].e_abs  += p.e*dt_step*pc::c*planck_mean_opacity_[p.ind];
+    tally_.add_J_nu(p.ind, 0, p.e*dt_step*pc::c);
+    tally_.add(radiation_tally::e_abs, p.ind, p.e*dt_step*pc::c*planck_mean_opacity_[p.ind]);
 
     // move the particle a distance R_diffuse
     double diffuse_dir[3];
-    random_direction(diffuse_dir, rangen);
+    random_direction(diffuse_dir, rng);
     for(int i=0; i<3; i++) p.x[i] += diffuse_dir[i] * R_diffuse;
 
     // get outgoing direction
     do{
-      random_direction(p.D, rangen);
+      random_direction(p.D, rng);
     } while (p.D[0]*diffuse_dir[0] + p.D[1]*diffuse_dir[1] + p.D[2]*diffuse_dir[2] < 0);
 
     // advect it
@@ -680,6 +674,20 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
 }
 
 
+// ------------------------------------------------------
+// Is the particle (at comoving doppler factor dshift)
+// in the ddmc regime in zone ind. Looks up the table
+// set in compute_diffusion_probabilities, so is only
+// valid for 0 <= ind < n_zones
+// ------------------------------------------------------
+bool transport::in_ddmc_zone(particle &p, const int ind, const double dshift)
+{
+  if (p.type != photon) return false;
+  int i_nu = nu_grid_.locate_from(p.nu*dshift,p.i_nu);
+  p.i_nu = i_nu;
+  return ddmc_mask_[ind*nu_grid_.size() + i_nu];
+}
+
 // ------------------------------------------------------
 // Calculate the probabilities of diffusion
 // for now this only works in 1D spherical coords
@@ -703,6 +711,16 @@ void transport::compute_diffusion_probabilities(double dt)
     if (ztau > ddmc_tau_) dtau_ddmc+= ztau;
     else dtau_mc += ztau;
 
+    // flag the frequency bins where photons in this zone are
+    // diffused, using the same opacity as get_opacity()
+    int n_nu = nu_grid_.size();
+    for (int j=0;j<n_nu;j++)
+    {
+      double sigma = opacity_table_.abs(i,j);
+      if (!omit_scattering_) sigma += opacity_table_.scat(i,j);
+      ddmc_mask_[i*n_nu + j] = (sigma*dx > ddmc_tau_);
+    }
+
     // indices of adjacent zones
     int ip = i+1;
     if (ip == nz) ip = i;
@@ -757,12 +775,12 @@ void transport::compute_diffusion_probabilities(double dt)
 
 // Sample particle's direction from the face of a blackbody,
 // which has a normal component proportional to sqrt(rand()).
-void transport::sample_dir_from_blackbody_surface(particle* p)
+void transport::sample_dir_from_blackbody_surface(particle* p, RNG_stream &rng)
 {
   double v1, v2, v3;
   double mu, phi, smu;
-  mu = sqrt(rangen.uniform()); // using sqrt(rand)
-  phi = 2.0*pc::pi*rangen.uniform();
+  mu = sqrt(rng.uniform()); // using sqrt(rand)
+  phi = 2.0*pc::pi*rng.uniform();
   smu = sqrt(1.0 - mu*mu);
 
   v1 = smu*cos(phi);
@@ -3,12 +3,82 @@
 #include "transport.h"
 #include "radioactive.h"
 #include "physical_constants.h"
+#include "fastmath.h"
 
 namespace pc = physical_constants;
 using std::cout;
 using std::cerr;
 using std::endl;
 
+//------------------------------------------------------------
+// Split n_total particles over the MPI ranks: this rank
+// emits particles number [lo,hi) of the n_total. Each emitted
+// particle gets its own random number stream, with id first
+// plus its number, so the same particles are emitted whatever
+// the number of ranks. The ids of all n_total are reserved
+// on every rank, to keep the ranks' stream ids in step
+//------------------------------------------------------------
+static void rank_block(int n_total, int rank, int n_ranks, int &lo, int &hi)
+{
+  lo = (int)(((long)n_total*rank)/n_ranks);
+  hi = (int)(((long)n_total*(rank+1))/n_ranks);
+}
+
+//------------------------------------------------------------
+// With quasi-random emission, draw a new random scrambling
+// of the sobol points for the next batch of particles. The
+// scrambling gets a stream id of its own, like a particle
+//------------------------------------------------------------
+void transport::scramble_emission_points()
+{
+  if (!qmc_emission_) return;
+  RNG_stream rng = rangen.stream(rangen.new_streams(1),0);
+  sobol_.scramble(rng);
+}
+
+//------------------------------------------------------------
+// Stratified choice of the emitting zones: zone i gets
+// floor(N w_i) or that plus one of the n_emit particles, where
+// w_i is its share of zone_emission_cdf_. The remainders are
+// handed out by systematic sampling, with one random offset
+// drawn from a stream of its own so all ranks agree. Fills
+// start with the number of the first particle of each zone
+// (and start[n_zones] = n_emit)
+//------------------------------------------------------------
+void transport::stratify_emission_zones(const int n_emit, std::vector<int> &start)
+{
+  RNG_stream rng = rangen.stream(rangen.new_streams(1),0);
+  double u = rng.uniform();
+  int nz = grid->n_zones;
+  start.resize(nz+1);
+  start[0] = 0;
+  for (int i=0;i<nz;i++)
+  {
+    start[i+1] = (int)floor(n_emit*zone_emission_cdf_.get(i) + u);
+    if (start[i+1] > n_emit) start[i+1] = n_emit;
+  }
+  start[nz] = n_emit;
+}
+
+//------------------------------------------------------------
+// Make room for n_emit new particles at the end of the
+// particle store, so that the emission loops can fill their
+// slots in parallel, particle q of this rank's block going to
+// slot first + q - q_lo. Returns first, or -1 if the store
+// would grow past particles_max_total
+//------------------------------------------------------------
+int transport::add_particle_slots(const int n_emit)
+{
+  int first = particles.size();
+  if (first + n_emit > max_total_particles)
+  {
+    if (verbose) cerr << "# Out of particle space; not adding in" << endl;
+    return -1;
+  }
+  particles.resize(first + n_emit);
+  return first;
+}
+
 //------------------------------------------------------------
 // emit new particles
 //------------------------------------------------------------
@@ -22,23 +92,30 @@ void transport::emit_particles(double dt)
 }
 
 //------------------------------------------------------------
-// sample photon frequency from local emissivity
+// sample photon frequency from local emissivity, using the
+// two numbers in u if given, else two from rng
 //------------------------------------------------------------
-void transport::sample_photon_frequency(particle *p)
+void transport::sample_photon_frequency(particle *p, RNG_stream &rng, const double *u_in)
 {
   if (p->type == photon)
   {
-    int inu  = emissivity_[p->ind].sample(rangen.uniform());
-    p->nu = nu_grid_.sample(inu,rangen.uniform());
+    double u[2];
+    if (u_in) {u[0] = u_in[0]; u[1] = u_in[1]; }
+    else rng.fill(u,2);
+    int inu  = emissivity_[p->ind].sample_alias(u[0]);
+    p->nu = nu_grid_.sample(inu,u[1]);
+    p->i_nu = inu;
     if (p->nu > 1e20) std::cout << "pnu " << p->nu << "\n";
   }
   else if (p->type == gammaray)
   {
     p->nu = 1;
+    p->i_nu = -1;
   }
   else
   {
     p->nu = 1;
+    p->i_nu = -1;
   }
 
 
@@ -49,10 +126,12 @@ void transport::sample_photon_frequency(particle *p)
 // General function to create a particle in zone i
 // emitted isotropically in the comoving frame.
 // Useful for thermal radiation emitted all througout
-// the grid
+// the grid. The position, direction and frequency take the
+// 7 numbers in u_in if given, else they are drawn from rng.
+// The particle is put in slot j of the particle store
 //------------------------------------------------------------
 void transport::create_isotropic_particle
-(int i, PType type, double Ep, double t)
+(int j, int i, PType type, double Ep, double t, RNG_stream &rng, const double *u_in)
 {
   particle p;
 
@@ -62,11 +141,13 @@ void transport::create_isotropic_particle
   // particle type
   p.type = type;
 
+  // random numbers for the position and direction
+  double u[5];
+  if (u_in) for (int k=0;k<5;k++) u[k] = u_in[k];
+  else rng.fill(u,5);
+
   // random sample position in zone
-  std::vector<double> rand;
-  rand.push_back(rangen.uniform());
-  rand.push_back(rangen.uniform());
-  rand.push_back(rangen.uniform());
+  std::vector<double> rand(u,u+3);
   double r[3];
   grid->sample_in_zone(i,rand,r);
   p.x[0] = r[0];
@@ -78,15 +159,15 @@ void transport::create_isotropic_particle
   p.x_interact[2] = r[2];
 
   // emit isotropically in comoving frame
-  double mu  = 1 - 2.0*rangen.uniform();
-  double phi = 2.0*pc::pi*rangen.uniform();
+  double mu  = 1 - 2.0*u[3];
+  double phi = 2.0*pc::pi*u[4];
   double smu = sqrt(1 - mu*mu);
   p.D[0] = smu*cos(phi);
   p.D[1] = smu*sin(phi);
   p.D[2] = mu;
 
   // sample frequency from local emissivity
-  sample_photon_frequency(&p);
+  sample_photon_frequency(&p,rng,u_in ? u_in + 5 : NULL);
 //  p.nu = 1e16; //debug
 
   // set packet energy
@@ -98,10 +179,12 @@ void transport::create_isotropic_particle
   // set time to current
   p.t  = t;
 
-  // add to particle vector
-  #pragma omp critical
-  particles.push_back(p);
+  // the particle continues the random stream it was emitted with
+  p.rng_id    = rng.id();
+  p.rng_count = rng.count();
 
+  // add to particle store
+  particles.set(j,p);
 }
 
 
@@ -111,19 +194,12 @@ void transport::create_isotropic_particle
 //------------------------------------------------------------
 void transport::initialize_particles(int init_particles)
 {
-  int my_n_emit = init_particles/(1.0*MPI_nprocs);
-  // If init_particles % MPI_nprocs != 0, create the remaining particles
-  // on the first remainder nodes.
-  int remainder = init_particles % MPI_nprocs;
-  if (MPI_myID < remainder) {
-    my_n_emit += 1;
-  }
+  int q_lo, q_hi;
+  rank_block(init_particles,MPI_myID,MPI_nprocs,q_lo,q_hi);
+  uint64_t id0 = rangen.new_streams(init_particles);
+  int my_n_emit = q_hi - q_lo;
 
   if (my_n_emit == 0) return;
-   // check that we have enough space to add these particles
-  if (my_n_emit > max_total_particles) {
-      if (verbose) cerr << "# Not enough particle space to initialize" << endl;
-      return; }
 
   if (verbose) cout << "# init with " << init_particles << " total particles ";
   if (verbose) cout << "(" << my_n_emit << " per MPI proc)\n";
@@ -132,29 +208,40 @@ void transport::initialize_particles(int init_particles)
   // set up emission distribution across zones
   double E_sum = 0;
   int ng = nu_grid_.size();
+  std::vector<double> ezeta(ng);
   for (int i=0;i<grid->n_zones;i++)
   {
     double T = grid->z[i].T_gas;
     double E_zone = grid->z[i].e_rad*grid->zone_volume(i);
     zone_emission_cdf_.set_value(i,E_zone);
     E_sum += E_zone;
-    // setup blackbody emissivity for initialization
+    // setup blackbody emissivity for initialization, with
+    // the exponentials of all frequencies done in one batch
+    for (int j=0;j<ng;j++) ezeta[j] = pc::h*nu_grid_.center(j)/pc::k/T;
+    fastmath::exp(ezeta.data(),ezeta.data(),ng);
     for (int j=0;j<ng;j++)
     {
       double nu_m = nu_grid_.center(j);
-      double emis = blackbody_nu(T,nu_m)*nu_grid_.delta(j);
+      double bb = 2.0*nu_m*nu_m*nu_m*pc::h/pc::c/pc::c/(ezeta[j]-1);
+      double emis = bb*nu_grid_.delta(j);
       emissivity_[i].set_value(j,emis);
     }
     emissivity_[i].normalize();
   }
   zone_emission_cdf_.normalize();
 
+  // check that we have enough space to add these particles
+  int first = add_particle_slots(my_n_emit);
+  if (first < 0) return;
+
   // emit particles
-  double Ep = E_sum/(1.0*my_n_emit);
-  for (int q=0;q<my_n_emit;q++)
+  double Ep = E_sum*MPI_nprocs/(1.0*init_particles);
+  #pragma omp parallel for schedule(static)
+  for (int q=q_lo;q<q_hi;q++)
   {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    create_isotropic_particle(i,photon,Ep,t_now_);
+    RNG_stream rng = rangen.stream(id0 + q,0);
+    int i = zone_emission_cdf_.sample_alias(rng.uniform());
+    create_isotropic_particle(first + q - q_lo,i,photon,Ep,t_now_,rng);
   }
 }
 
@@ -184,11 +271,11 @@ void transport::emit_radioactive(double dt)
     if (verbose) std::cout << "# last iteration, increasing emission by factor of " << pumpup << "\n";
   }
 
-  int my_n_emit = floor(total_n_emit/(1.0*MPI_nprocs));
-
-  // randomize remainder
-  double remainder = total_n_emit/(1.0*MPI_nprocs) - my_n_emit;
-  if (rangen.uniform() < remainder) my_n_emit += 1;
+  int q_lo, q_hi;
+  rank_block(total_n_emit,MPI_myID,MPI_nprocs,q_lo,q_hi);
+  uint64_t id0 = rangen.new_streams(total_n_emit);
+  scramble_emission_points();
+  int my_n_emit = q_hi - q_lo;
 
   radioactive radio;
   double gfrac;
@@ -211,28 +298,42 @@ void transport::emit_radioactive(double dt)
 
 
   if (L_tot == 0) return;
-  double E_p = L_tot*dt/(1.0*my_n_emit);
+  double E_p = L_tot*dt*MPI_nprocs/(1.0*total_n_emit);
+
+  std::vector<int> zone_start;
+  if (stratify_emission_zones_) stratify_emission_zones(total_n_emit,zone_start);
 
   // check that we have enough space to add these particles
-  if ((int)particles.size()+my_n_emit > max_total_particles) {
-    if (verbose) cerr << "# Out of particle space; not adding in" << endl;
-    return; }
+  int first = add_particle_slots(my_n_emit);
+  if (first < 0) {delete[] gamma_frac; return; }
 
-  // emit particles
-  for (int q=0;q<my_n_emit;q++)
+  // emit particles, zone by zone if stratified; each thread
+  // walks the zones from the start of its block of particles
+  #pragma omp parallel
   {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    double t  = t_now_ + dt*rangen.uniform();
-
-    // determine if make gamma-ray or positron
-    if (rangen.uniform() < gamma_frac[i])
-      create_isotropic_particle(i,gammaray,E_p,t);
-    else
+    int i = 0;
+    #pragma omp for schedule(static)
+    for (int q=q_lo;q<q_hi;q++)
     {
-      // positrons are just immediately made into photons
-      #pragma omp atomic
-      grid->z[i].L_radio_dep += E_p;
-      create_isotropic_particle(i,photon,E_p,t);
+      RNG_stream rng = rangen.stream(id0 + q,0);
+      double u[10];
+      if (qmc_emission_) sobol_.point(q,u,10);
+      else rng.fill(u,3);
+      const double *u_iso = qmc_emission_ ? u + 3 : NULL;
+      if (stratify_emission_zones_) {while (zone_start[i+1] <= q) i++; }
+      else i = zone_emission_cdf_.sample_alias(u[0]);
+      double t  = t_now_ + dt*u[1];
+
+      // determine if make gamma-ray or positron
+      if (u[2] < gamma_frac[i])
+        create_isotropic_particle(first + q - q_lo,i,gammaray,E_p,t,rng,u_iso);
+      else
+      {
+        // positrons are just immediately made into photons
+        #pragma omp atomic
+        grid->z[i].L_radio_dep += E_p;
+        create_isotropic_particle(first + q - q_lo,i,photon,E_p,t,rng,u_iso);
+      }
     }
   }
 
@@ -249,7 +350,11 @@ void transport::emit_thermal(double dt)
   // number of thermal particles to emit
   int total_n_emit = params_->getScalar<int>("particles_n_emit_thermal");
   if (total_n_emit == 0) return;
-  int my_n_emit = total_n_emit/(1.0*MPI_nprocs);
+  int q_lo, q_hi;
+  rank_block(total_n_emit,MPI_myID,MPI_nprocs,q_lo,q_hi);
+  uint64_t id0 = rangen.new_streams(total_n_emit);
+  scramble_emission_points();
+  int my_n_emit = q_hi - q_lo;
 
   // calculate the total thermal emisison energy on the grid
   double E_tot = 0;
@@ -273,14 +378,32 @@ void transport::emit_thermal(double dt)
   zone_emission_cdf_.normalize();
 
   if (E_tot == 0) return;
-  double E_p = E_tot/(1.0*my_n_emit);
+  double E_p = E_tot*MPI_nprocs/(1.0*total_n_emit);
 
-  // emit particles
-  for (int q=0;q<my_n_emit;q++)
+  std::vector<int> zone_start;
+  if (stratify_emission_zones_) stratify_emission_zones(total_n_emit,zone_start);
+
+  // check that we have enough space to add these particles
+  int first = add_particle_slots(my_n_emit);
+  if (first < 0) return;
+
+  // emit particles, zone by zone if stratified; each thread
+  // walks the zones from the start of its block of particles
+  #pragma omp parallel
   {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    double t  = t_now_ + dt*rangen.uniform();
-    create_isotropic_particle(i,photon,E_p,t);
+    int i = 0;
+    #pragma omp for schedule(static)
+    for (int q=q_lo;q<q_hi;q++)
+    {
+      RNG_stream rng = rangen.stream(id0 + q,0);
+      double u[9];
+      if (qmc_emission_) sobol_.point(q,u,9);
+      else rng.fill(u,2);
+      if (stratify_emission_zones_) {while (zone_start[i+1] <= q) i++; }
+      else i = zone_emission_cdf_.sample_alias(u[0]);
+      double t  = t_now_ + dt*u[1];
+      create_isotropic_particle(first + q - q_lo,i,photon,E_p,t,rng,qmc_emission_ ? u + 2 : NULL);
+    }
   }
 
   if (verbose) cout << "# E thermal = " << E_tot << " ergs; ";
@@ -380,21 +503,32 @@ void transport::emit_inner_source(double dt)
     if (pumpup != 0) total_n_emit *= pumpup;
     if (verbose) std::cout << "# last iteration, increasing emission by factor of " << pumpup << "\n";
   }
-  int n_emit = total_n_emit/(1.0*MPI_nprocs);
+  int q_lo, q_hi;
+  rank_block(total_n_emit,MPI_myID,MPI_nprocs,q_lo,q_hi);
+  uint64_t id0 = rangen.new_streams(total_n_emit);
+  scramble_emission_points();
+  int n_emit = q_hi - q_lo;
 
 
   // get current luminosity, if time dependent
   double L_current = params_->getFunction("core_luminosity", t_now_);
   if (L_current != 0) L_core_ = L_current;
-  double Ep  = L_core_*dt/n_emit;
-
-  if ((int)particles.size() + n_emit > this->max_total_particles)
-    {cerr  << "# Not enough particle space" << endl; return; }
+  double Ep  = L_core_*dt*MPI_nprocs/(1.0*total_n_emit);
 
-  // inject particles from the source
-  for (int i=0;i<n_emit;i++)
+  // check that we have enough space to add these particles
+  int first = add_particle_slots(n_emit);
+  if (first < 0) return;
+
+  // inject particles from the source. With quasi-random
+  // emission, the 7 coordinates of a sobol point give the
+  // position and direction (4), frequency (2) and time (1)
+  #pragma omp parallel for schedule(static)
+  for (int q=q_lo;q<q_hi;q++)
   {
     particle p;
+    RNG_stream rng = rangen.stream(id0 + q,0);
+    double u_qmc[7];
+    if (qmc_emission_) sobol_.point(q,u_qmc,7);
 
     if (r_core_ == 0)
     {
@@ -403,8 +537,11 @@ void transport::emit_inner_source(double dt)
       p.x[1] = 0;
       p.x[2] = 0;
       // emit isotropically in comoving frame
-      double mu  = 1 - 2.0*rangen.uniform();
-      double phi = 2.0*pc::pi*rangen.uniform();
+      double u[2];
+      if (qmc_emission_) {u[0] = u_qmc[0]; u[1] = u_qmc[1]; }
+      else rng.fill(u,2);
+      double mu  = 1 - 2.0*u[0];
+      double phi = 2.0*pc::pi*u[1];
       double smu = sqrt(1 - mu*mu);
       p.D[0] = smu*cos(phi);
       p.D[1] = smu*sin(phi);
@@ -413,10 +550,13 @@ void transport::emit_inner_source(double dt)
     else
     {
       // pick initial position on photosphere
-      double phi_core   = 2*pc::pi*rangen.uniform();
+      double u[4];
+      if (qmc_emission_) for (int k=0;k<4;k++) u[k] = u_qmc[k];
+      else rng.fill(u,4);
+      double phi_core   = 2*pc::pi*u[0];
       double cosp_core  = cos(phi_core);
       double sinp_core  = sin(phi_core);
-      double cost_core  = 1 - 2.0*rangen.uniform();
+      double cost_core  = 1 - 2.0*u[1];
       double sint_core  = sqrt(1-cost_core*cost_core);
       // real spatial coordinates
       double a_phot = r_core_ + r_core_*1e-10;
@@ -425,9 +565,9 @@ void transport::emit_inner_source(double dt)
       p.x[2] = a_phot*cost_core;
 
       // pick photon propagation direction wtr to local normal
-      double phi_loc = 2*pc::pi*rangen.uniform();
+      double phi_loc = 2*pc::pi*u[2];
       // choose sqrt(R) to get outward, cos(theta) emission
-      double cost_loc  = sqrt(rangen.uniform());
+      double cost_loc  = sqrt(u[3]);
       double sint_loc  = sqrt(1 - cost_loc*cost_loc);
       // local direction vector
       double D_xl = sint_loc*cos(phi_loc);
@@ -451,12 +591,17 @@ void transport::emit_inner_source(double dt)
     {
       // constant single frequency emission
       p.nu = core_frequency_;
+      p.i_nu = -1;
     }
     else
     {
       // sample frequency from blackbody
-      int inu = core_emission_spectrum_.sample(rangen.uniform());
-      p.nu = nu_grid_.sample(inu,rangen.uniform());
+      double u[2];
+      if (qmc_emission_) {u[0] = u_qmc[4]; u[1] = u_qmc[5]; }
+      else rng.fill(u,2);
+      int inu = core_emission_spectrum_.sample_alias(u[0]);
+      p.nu = nu_grid_.sample(inu,u[1]);
+      p.i_nu = inu;
       p.e  /= emissivity_weight_[inu];
       // straight bin emission
       //int ilam = rangen.uniform()*nu_grid_.size();
@@ -470,14 +615,17 @@ void transport::emit_inner_source(double dt)
     transform_comoving_to_lab(&p);
 
     // set time to current
-    p.t  = t_now_ + rangen.uniform()*dt;
+    p.t  = t_now_ + (qmc_emission_ ? u_qmc[6] : rng.uniform())*dt;
 
     // set type to photon
     p.type = photon;
 
+    // the particle continues the random stream it was emitted with
+    p.rng_id    = rng.id();
+    p.rng_count = rng.count();
+
     // add to particle vector
-    #pragma omp critical
-    particles.push_back(p);
+    particles.set(first + q - q_lo,p);
   }
 
   if (verbose)
@@ -496,20 +644,30 @@ void transport::emit_from_pointsoures(double dt)
   // this could be set to be a function if we want
   int total_n_emit    = params_->getScalar<int>("particles_n_emit_pointsources");
   if (total_n_emit == 0) return;
-  int n_emit = total_n_emit/(1.0*MPI_nprocs);
+  int q_lo, q_hi;
+  rank_block(total_n_emit,MPI_myID,MPI_nprocs,q_lo,q_hi);
+  uint64_t id0 = rangen.new_streams(total_n_emit);
+  scramble_emission_points();
+  int n_emit = q_hi - q_lo;
 
-  if ((int)particles.size() + n_emit > this->max_total_particles)
-    {cerr << "# Not enough particle space" << endl; return; }
+  // check that we have enough space to add these particles
+  int first = add_particle_slots(n_emit);
+  if (first < 0) return;
 
-  double Ep  = pointsources_L_tot_*dt/n_emit;
+  double Ep  = pointsources_L_tot_*dt*MPI_nprocs/(1.0*total_n_emit);
 
   // inject particles from the source
-  for (int i=0;i<n_emit;i++)
+  #pragma omp parallel for schedule(static)
+  for (int q=q_lo;q<q_hi;q++)
   {
     particle p;
+    RNG_stream rng = rangen.stream(id0 + q,0);
+    double u[6];
+    if (qmc_emission_) sobol_.point(q,u,6);
+    else rng.fill(u,6);
 
     // pick your pointsource to emit from
-    int ind = pointsource_emission_cdf_.sample(rangen.uniform());
+    int ind = pointsource_emission_cdf_.sample_alias(u[0]);
 
     p.x[0] = pointsource_x_[ind];
     p.x[1] = pointsource_y_[ind];
@@ -520,8 +678,8 @@ void transport::emit_from_pointsoures(double dt)
     p.x_interact[2] = p.x[2];
 
     // emit isotropically in comoving frame
-    double mu  = 1 - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
+    double mu  = 1 - 2.0*u[1];
+    double phi = 2.0*pc::pi*u[2];
     double smu = sqrt(1 - mu*mu);
     p.D[0] = smu*cos(phi);
     p.D[1] = smu*sin(phi);
@@ -531,8 +689,9 @@ void transport::emit_from_pointsoures(double dt)
     p.e = Ep;
 
     // sample frequency
-    int inu = pointsource_emission_spectrum_.sample(rangen.uniform());
-    p.nu = nu_grid_.sample(inu,rangen.uniform());
+    int inu = pointsource_emission_spectrum_.sample_alias(u[3]);
+    p.nu = nu_grid_.sample(inu,u[4]);
+    p.i_nu = inu;
 
     // get index of current zone
     p.ind = grid->get_zone(p.x);
@@ -541,14 +700,17 @@ void transport::emit_from_pointsoures(double dt)
     transform_comoving_to_lab(&p);
 
     // set time to current
-    p.t  = t_now_ + rangen.uniform()*dt;
+    p.t  = t_now_ + u[5]*dt;
 
     // set type to photon
     p.type = photon;
 
+    // the particle continues the random stream it was emitted with
+    p.rng_id    = rng.id();
+    p.rng_count = rng.count();
+
     // add to particle vector
-    #pragma omp critical
-    particles.push_back(p);
+    particles.set(first + q - q_lo,p);
   }
 
   if (verbose)
@@ -0,0 +1,224 @@
+#include <math.h>
+#include <fstream>
+#include <algorithm>
+#include "lte_opacity_table.h"
+#include "h5utils.h"
+
+using std::vector;
+using std::string;
+
+//------------------------------------------------------------
+// interpolate between the four corners k of a grid cell,
+// with weights w, in the log if all corners are non-zero
+//------------------------------------------------------------
+template <class T>
+static double interpolate_corners(const vector<T>& y, const long *k, const int stride,
+  const int j, const double *w)
+{
+  double y0 = y[k[0]*stride + j];
+  double y1 = y[k[1]*stride + j];
+  double y2 = y[k[2]*stride + j];
+  double y3 = y[k[3]*stride + j];
+  if ((y0 > 0)&&(y1 > 0)&&(y2 > 0)&&(y3 > 0))
+    return exp(w[0]*log(y0) + w[1]*log(y1) + w[2]*log(y2) + w[3]*log(y3));
+  return w[0]*y0 + w[1]*y1 + w[2]*y2 + w[3]*y3;
+}
+
+//------------------------------------------------------------
+// cell i and weight w of the upper node, of the value val
+// on the ascending grid x, clamped to its ends
+//------------------------------------------------------------
+void lte_opacity_table::locate(const vector<double>& x, const double val, int &i, double &w)
+{
+  int n = x.size();
+  if ((n == 1)||(val <= x[0])) {i = 0; w = 0; return; }
+  if (val >= x[n-1]) {i = n-2; w = 1; return; }
+  i = std::upper_bound(x.begin(),x.end(),val) - x.begin() - 1;
+  w = (val - x[i])/(x[i+1] - x[i]);
+}
+
+//------------------------------------------------------------
+// read in all groups of the file
+//------------------------------------------------------------
+void lte_opacity_table::read(const string fname, const locate_array& nu_grid)
+{
+  std::ifstream infile(fname.c_str());
+  if (!infile)
+  {
+    std::cerr << "# ERROR: can't open opacity table file " << fname << "\n";
+    exit(1);
+  }
+  infile.close();
+
+  // opened read only, so that all ranks can read at once
+  hid_t file_id = H5Fopen(fname.c_str(),H5F_ACC_RDONLY,H5P_DEFAULT);
+  n_nu_ = nu_grid.size();
+  int n_groups = 0;
+  readSimple(file_id,"n_groups",&n_groups,H5T_NATIVE_INT);
+  groups_.resize(n_groups);
+
+  for (int g=0;g<n_groups;g++)
+  {
+    group &gr = groups_[g];
+    string gname = "composition_" + std::to_string(g);
+    hid_t group_id = openH5Group(file_id,gname);
+    readSimple(group_id,"time",&gr.time,H5T_NATIVE_DOUBLE);
+    readVector(group_id,"Z",gr.Z,H5T_NATIVE_INT);
+    readVector(group_id,"A",gr.A,H5T_NATIVE_INT);
+    readVector(group_id,"mass_fractions",gr.X,H5T_NATIVE_DOUBLE);
+    readVector(group_id,"log_rho",gr.log_rho,H5T_NATIVE_DOUBLE);
+    readVector(group_id,"log_T",gr.log_T,H5T_NATIVE_DOUBLE);
+
+    // the frequency grid has to be the one of the calculation
+    vector<double> nu;
+    readVector(group_id,"nu",nu,H5T_NATIVE_DOUBLE);
+    int same = ((int)nu.size() == n_nu_);
+    for (int j=0;(j<n_nu_)&&same;j++)
+      if (fabs(nu[j] - nu_grid.center(j)) > 1e-6*nu_grid.center(j)) same = 0;
+    if (!same)
+    {
+      std::cerr << "# ERROR: frequency grid of opacity table " << fname << " (" << gname
+                << ") is not transport_nu_grid\n";
+      exit(1);
+    }
+
+    int n_rho = gr.log_rho.size();
+    int n_T   = gr.log_T.size();
+    vector<double> tmp(1L*n_rho*n_T*n_nu_);
+    readSimple(group_id,"abs_opacity",tmp.data(),H5T_NATIVE_DOUBLE);
+    gr.abs.assign(tmp.begin(),tmp.end());
+    readSimple(group_id,"scat_opacity",tmp.data(),H5T_NATIVE_DOUBLE);
+    gr.scat.assign(tmp.begin(),tmp.end());
+    gr.n_elec.resize(n_rho*n_T);
+    readSimple(group_id,"n_elec",gr.n_elec.data(),H5T_NATIVE_DOUBLE);
+    closeH5Group(group_id);
+  }
+  H5Fclose(file_id);
+}
+
+//------------------------------------------------------------
+// add a group to the file
+//------------------------------------------------------------
+void lte_opacity_table::write_group(const string fname, const double time,
+  const vector<int>& Z, const vector<int>& A, const vector<double>& X,
+  const vector<double>& log_rho, const vector<double>& log_T,
+  const locate_array& nu_grid, const vector<double>& abs,
+  const vector<double>& scat, const vector<double>& n_elec)
+{
+  hsize_t one = 1;
+  int n_groups = 0;
+  std::ifstream infile(fname.c_str());
+  if (infile)
+  {
+    infile.close();
+    readSimple(fname,"/","n_groups",&n_groups,H5T_NATIVE_INT);
+  }
+  else
+  {
+    createFile(fname);
+    createDataset(fname,"/","n_groups",1,&one,H5T_NATIVE_INT);
+  }
+
+  string gname = "composition_" + std::to_string(n_groups);
+  createGroup(fname,gname);
+
+  double t = time;
+  createDataset(fname,gname,"time",1,&one,H5T_NATIVE_DOUBLE);
+  writeSimple(fname,gname,"time",&t,H5T_NATIVE_DOUBLE);
+
+  vector<int> Zv = Z, Av = A;
+  vector<double> Xv = X, rv = log_rho, Tv = log_T;
+  vector<double> nu(nu_grid.size());
+  for (int j=0;j<nu_grid.size();j++) nu[j] = nu_grid.center(j);
+  writeVector(fname,gname,"Z",Zv,H5T_NATIVE_INT);
+  writeVector(fname,gname,"A",Av,H5T_NATIVE_INT);
+  writeVector(fname,gname,"mass_fractions",Xv,H5T_NATIVE_DOUBLE);
+  writeVector(fname,gname,"log_rho",rv,H5T_NATIVE_DOUBLE);
+  writeVector(fname,gname,"log_T",Tv,H5T_NATIVE_DOUBLE);
+  writeVector(fname,gname,"nu",nu,H5T_NATIVE_DOUBLE);
+
+  hsize_t dims[3] = {log_rho.size(), log_T.size(), nu.size()};
+  createDataset(fname,gname,"abs_opacity",3,dims,H5T_NATIVE_DOUBLE);
+  writeSimple(fname,gname,"abs_opacity",(void*)abs.data(),H5T_NATIVE_DOUBLE);
+  createDataset(fname,gname,"scat_opacity",3,dims,H5T_NATIVE_DOUBLE);
+  writeSimple(fname,gname,"scat_opacity",(void*)scat.data(),H5T_NATIVE_DOUBLE);
+  createDataset(fname,gname,"n_elec",2,dims,H5T_NATIVE_DOUBLE);
+  writeSimple(fname,gname,"n_elec",(void*)n_elec.data(),H5T_NATIVE_DOUBLE);
+
+  n_groups++;
+  writeSimple(fname,"/","n_groups",&n_groups,H5T_NATIVE_INT);
+}
+
+//------------------------------------------------------------
+// group closest in composition, then in time
+//------------------------------------------------------------
+int lte_opacity_table::closest_group(const vector<int>& Z, const vector<int>& A,
+  const vector<double>& X, const double time) const
+{
+  int best = 0;
+  double best_dX = 0, best_dt = 0;
+  for (size_t g=0;g<groups_.size();g++)
+  {
+    const group &gr = groups_[g];
+
+    // summed difference of the mass fractions, counting
+    // isotopes missing from either side
+    double dX = 0;
+    vector<int> matched(gr.Z.size(),0);
+    for (size_t i=0;i<Z.size();i++)
+    {
+      double Xg = 0;
+      for (size_t k=0;k<gr.Z.size();k++)
+        if ((gr.Z[k] == Z[i])&&(gr.A[k] == A[i])) {Xg = gr.X[k]; matched[k] = 1; }
+      dX += fabs(X[i] - Xg);
+    }
+    for (size_t k=0;k<gr.Z.size();k++)
+      if (!matched[k]) dX += gr.X[k];
+
+    double dt = fabs(log(time/gr.time));
+    if ((g == 0)||(dX < best_dX - 1e-6)||((fabs(dX - best_dX) <= 1e-6)&&(dt < best_dt)))
+    {
+      best = g;
+      best_dX = dX;
+      best_dt = dt;
+    }
+  }
+  return best;
+}
+
+//------------------------------------------------------------
+// interpolated opacities of group g
+//------------------------------------------------------------
+void lte_opacity_table::get_opacity(const int g, const double rho, const double T,
+  vector<OpacityType>& abs, vector<OpacityType>& scat, double &n_elec) const
+{
+  const group &gr = groups_[g];
+  int n_rho = gr.log_rho.size();
+  int n_T   = gr.log_T.size();
+
+  int ir, it;
+  double wr, wt;
+  locate(gr.log_rho,log10(rho),ir,wr);
+  locate(gr.log_T,log10(T),it,wt);
+  int ir1 = std::min(ir+1,n_rho-1);
+  int it1 = std::min(it+1,n_T-1);
+
+  long k[4] = {1L*ir*n_T + it, 1L*ir*n_T + it1, 1L*ir1*n_T + it, 1L*ir1*n_T + it1};
+  double w[4] = {(1-wr)*(1-wt), (1-wr)*wt, wr*(1-wt), wr*wt};
+
+  n_elec = rho*interpolate_corners(gr.n_elec,k,1,0,w);
+  for (int j=0;j<n_nu_;j++)
+  {
+    abs[j]  = rho*interpolate_corners(gr.abs,k,n_nu_,j,w);
+    scat[j] = rho*interpolate_corners(gr.scat,k,n_nu_,j,w);
+  }
+}
+
+double lte_opacity_table::memory_bytes() const
+{
+  double sum = 0;
+  for (size_t g=0;g<groups_.size();g++)
+    sum += (groups_[g].abs.size() + groups_[g].scat.size())*sizeof(OpacityType)
+         + groups_[g].n_elec.size()*sizeof(double);
+  return sum;
+}
@@ -0,0 +1,88 @@
+#ifndef _LTE_OPACITY_TABLE_H
+#define _LTE_OPACITY_TABLE_H 1
+
+#include <vector>
+#include <string>
+#include "sedona.h"
+#include "locate_array.h"
+
+//**********************************************************
+// Tables of LTE opacities, generated by snopac and read in
+// by transport in place of solving the gas state of every
+// zone.
+//
+// An HDF5 file holds one group per composition (and time),
+// named composition_0, composition_1, ...; each has the
+// isotopes and mass fractions it was calculated for and,
+// on a grid of log10 density and log10 temperature, the
+// absorptive and scattering opacity per gram in every
+// frequency bin and the free electrons per gram. The LTE
+// emissivity follows from Kirchhoff's law, so it is not
+// stored. Lookups interpolate bilinearly in log density
+// and log temperature, in the log of the values where
+// they are non-zero, and are clamped to the edges of the
+// grid
+//**********************************************************
+class lte_opacity_table
+{
+
+private:
+
+  struct group
+  {
+    double time;
+    std::vector<int> Z, A;
+    std::vector<double> X;
+    std::vector<double> log_rho, log_T;
+    // per gram, indexed [(i_rho*n_T + i_T)*n_nu + i_nu]
+    std::vector<OpacityType> abs, scat;
+    // per gram, indexed [i_rho*n_T + i_T]
+    std::vector<double> n_elec;
+  };
+
+  std::vector<group> groups_;
+  int n_nu_;
+
+  static void locate(const std::vector<double>& x, const double val, int &i, double &w);
+
+public:
+
+  lte_opacity_table() : n_nu_(0) {}
+
+  //------------------------------------------------------
+  // read all groups of the file, checking that they were
+  // calculated on this frequency grid
+  //------------------------------------------------------
+  void read(const std::string fname, const locate_array& nu_grid);
+
+  //------------------------------------------------------
+  // add a group to the file (created if needed); abs and
+  // scat are per gram, with the layout above
+  //------------------------------------------------------
+  static void write_group(const std::string fname, const double time,
+    const std::vector<int>& Z, const std::vector<int>& A, const std::vector<double>& X,
+    const std::vector<double>& log_rho, const std::vector<double>& log_T,
+    const locate_array& nu_grid, const std::vector<double>& abs,
+    const std::vector<double>& scat, const std::vector<double>& n_elec);
+
+  int n_groups() const {return (int)groups_.size(); }
+
+  //------------------------------------------------------
+  // the group closest in composition to the mass fractions
+  // X of isotopes Z,A; of groups with the same composition,
+  // the one closest in log time
+  //------------------------------------------------------
+  int closest_group(const std::vector<int>& Z, const std::vector<int>& A,
+    const std::vector<double>& X, const double time) const;
+
+  //------------------------------------------------------
+  // opacities (1/cm) and electron density of group g at
+  // density rho and temperature T
+  //------------------------------------------------------
+  void get_opacity(const int g, const double rho, const double T,
+    std::vector<OpacityType>& abs, std::vector<OpacityType>& scat, double &n_elec) const;
+
+  double memory_bytes() const;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef _OPACITY_TABLE_H
+#define _OPACITY_TABLE_H 1
+
+#include <vector>
+#include <algorithm>
+#include "aligned_allocator.h"
+
+//**********************************************************
+// Absorptive and scattering opacity of every zone and
+// frequency bin, stored in one contiguous block.
+//
+// The table is zone-major, each zone row starting on a
+// cache line. Within a row, the absorptive and scattering
+// opacities are either stored as two separate arrays
+// (abs[0..n_nu-1], scat[0..n_nu-1]) or interleaved
+// (abs[0],scat[0],abs[1],scat[1],...) so that a lookup of
+// both at one frequency touches a single cache line.
+// Padding at the end of the rows is kept at zero
+//**********************************************************
+template <class T> class opacity_table
+{
+
+private:
+
+  std::vector<T, aligned_allocator<T> > data_;
+
+  int n_zones_, n_nu_;
+  int use_scat_, interleave_;
+  // distance between rows, and from the start of a row
+  // to its scattering opacities (non-interleaved)
+  long stride_;
+  int scat_offset_;
+
+  // round n up to a whole number of cache lines
+  static long pad(const long n)
+  {
+    const long per_line = ALIGNED_ALLOCATOR_ALIGN/sizeof(T);
+    return ((n + per_line - 1)/per_line)*per_line;
+  }
+
+  long abs_index(const int i, const int j) const
+    {return i*stride_ + (interleave_ ? 2*j : j); }
+
+  long scat_index(const int i, const int j) const
+    {return i*stride_ + (interleave_ ? 2*j + 1 : scat_offset_ + j); }
+
+public:
+
+  opacity_table() : n_zones_(0), n_nu_(0), use_scat_(0), interleave_(0),
+    stride_(0), scat_offset_(0) {}
+
+  //------------------------------------------------------
+  // allocate the table; if use_scat = 0 no scattering
+  // opacity is stored (and scat() returns 0)
+  //------------------------------------------------------
+  void init(const int n_zones, const int n_nu, const int use_scat, const int interleave)
+  {
+    n_zones_    = n_zones;
+    n_nu_       = n_nu;
+    use_scat_   = use_scat;
+    interleave_ = (use_scat && interleave);
+    if (interleave_)
+    {
+      stride_ = pad(2*n_nu);
+      scat_offset_ = 0;
+    }
+    else
+    {
+      scat_offset_ = pad(n_nu);
+      stride_ = use_scat ? 2*scat_offset_ : scat_offset_;
+    }
+    data_.assign(n_zones_*stride_,0);
+  }
+
+  int n_zones()     const {return n_zones_; }
+  int n_nu()        const {return n_nu_; }
+  int interleaved() const {return interleave_; }
+
+  //------------------------------------------------------
+  // opacity of zone i at frequency bin j
+  //------------------------------------------------------
+  T abs(const int i, const int j) const {return data_[abs_index(i,j)]; }
+  T scat(const int i, const int j) const
+    {return use_scat_ ? data_[scat_index(i,j)] : 0; }
+
+  void set_abs(const int i, const int j, const T val)  {data_[abs_index(i,j)] = val; }
+  void set_scat(const int i, const int j, const T val)
+    {if (use_scat_) data_[scat_index(i,j)] = val; }
+
+  //------------------------------------------------------
+  // copy the opacities of zone i in or out of vectors
+  //------------------------------------------------------
+  template <class U>
+  void set_row(const int i, const std::vector<U>& abs, const std::vector<U>& scat)
+  {
+    for (int j=0;j<n_nu_;j++)
+    {
+      set_abs(i,j,abs[j]);
+      set_scat(i,j,scat[j]);
+    }
+  }
+
+  template <class U>
+  void get_row(const int i, std::vector<U>& abs, std::vector<U>& scat) const
+  {
+    abs.resize(n_nu_);
+    scat.resize(n_nu_);
+    for (int j=0;j<n_nu_;j++)
+    {
+      abs[j]  = this->abs(i,j);
+      scat[j] = this->scat(i,j);
+    }
+  }
+
+  //------------------------------------------------------
+  // zero out all zones
+  //------------------------------------------------------
+  void wipe() {data_.assign(data_.size(),0); }
+
+  //------------------------------------------------------
+  // zero out zone i
+  //------------------------------------------------------
+  void wipe_row(const int i)
+    {std::fill(data_.begin() + i*stride_, data_.begin() + (i+1)*stride_, 0); }
+
+  //------------------------------------------------------
+  // scale all opacities of zone i by a factor
+  //------------------------------------------------------
+  void scale_row(const int i, const double fac)
+  {
+    for (long k=i*stride_;k<(i+1)*stride_;k++) data_[k] *= fac;
+  }
+
+  //------------------------------------------------------
+  // the whole table as one block (including padding),
+  // e.g. for MPI reductions
+  //------------------------------------------------------
+  T*   data()       {return data_.data(); }
+  long size() const {return (long)data_.size(); }
+
+  // one zone row (including padding), of length stride()
+  T*   row(const int i)  {return data_.data() + i*stride_; }
+  long stride() const    {return stride_; }
+
+  double memory_bytes() const {return 1.0*data_.size()*sizeof(T); }
+
+};
+
+#endif
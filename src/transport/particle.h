@@ -3,6 +3,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 
 // particle properties
 enum PType         {photon, gammaray, positron, neutrino};
@@ -23,11 +24,15 @@ class particle
   double       t;         // current time
   double       e;         // total energy in ergs of packet
   double      nu;         // frequency
+  int       i_nu;         // comoving frequency bin index (-1 if not known)
 
   double   gamma;         // lorentz factor
   double   dshift;        // doppler shift
   double   dvds;          // directional velocity derivative 
 
+  uint64_t rng_id;        // id of this particle's random number stream
+  uint64_t rng_count;     // number of random numbers drawn from it so far
+
   ParticleFate fate;
 
   double r() 
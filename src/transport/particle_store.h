@@ -0,0 +1,215 @@
+#ifndef _PARTICLE_STORE_H
+#define _PARTICLE_STORE_H 1
+
+#include <vector>
+
+#include "particle.h"
+#include "aligned_allocator.h"
+
+//**********************************************************
+// Structure-of-arrays container of particles
+//
+// Each particle property lives in its own aligned array,
+// so that passes over the whole particle list (census,
+// distance calculations, output) only stream the fields
+// they need. Particles are moved in and out of the store
+// as a particle class with get() and set() so that the
+// per-history physics routines are unchanged.
+//**********************************************************
+class ParticleStore
+{
+
+public:
+
+  template <class T> using array = std::vector<T, aligned_allocator<T> >;
+
+  // hot properties, touched every step
+  array<double> x[3];           // x,y,z position
+  array<double> D[3];           // direction vector, Dx,Dy,Dz
+  array<double> nu;             // frequency
+  array<int> i_nu;              // comoving frequency bin index
+  array<double> e;              // total energy in ergs of packet
+  array<double> t;              // current time
+  array<int> ind;               // index of the zone in grid
+  array<ParticleFate> fate;
+  array<PType> type;
+  array<uint64_t> rng_id;       // random number stream id
+  array<uint64_t> rng_count;    // random numbers drawn from stream
+
+  // cold properties, only needed for output
+  array<double> x_interact[3];  // position of last scatter
+  array<double> gamma;          // lorentz factor
+  array<double> dshift;         // doppler shift
+  array<double> dvds;           // directional velocity derivative
+
+  //------------------------------------------------------
+  // number of particles stored
+  //------------------------------------------------------
+  int size() const {return (int)e.size(); }
+  bool empty() const {return e.empty(); }
+
+  //------------------------------------------------------
+  // change the number of particles stored
+  //------------------------------------------------------
+  void resize(const int n)
+  {
+    for (int k=0;k<3;k++) {
+      x[k].resize(n);
+      D[k].resize(n);
+      x_interact[k].resize(n); }
+    nu.resize(n);
+    i_nu.resize(n,-1);
+    e.resize(n);
+    t.resize(n);
+    ind.resize(n);
+    fate.resize(n);
+    type.resize(n);
+    rng_id.resize(n);
+    rng_count.resize(n);
+    gamma.resize(n);
+    dshift.resize(n);
+    dvds.resize(n);
+  }
+
+  void reserve(const int n)
+  {
+    for (int k=0;k<3;k++) {
+      x[k].reserve(n);
+      D[k].reserve(n);
+      x_interact[k].reserve(n); }
+    nu.reserve(n);
+    i_nu.reserve(n);
+    e.reserve(n);
+    t.reserve(n);
+    ind.reserve(n);
+    fate.reserve(n);
+    type.reserve(n);
+    rng_id.reserve(n);
+    rng_count.reserve(n);
+    gamma.reserve(n);
+    dshift.reserve(n);
+    dvds.reserve(n);
+  }
+
+  void clear() {resize(0); }
+
+  //------------------------------------------------------
+  // copy particle i out of the store
+  //------------------------------------------------------
+  particle get(const int i) const
+  {
+    particle p;
+    for (int k=0;k<3;k++) {
+      p.x[k] = x[k][i];
+      p.D[k] = D[k][i];
+      p.x_interact[k] = x_interact[k][i]; }
+    p.nu     = nu[i];
+    p.i_nu   = i_nu[i];
+    p.e      = e[i];
+    p.t      = t[i];
+    p.ind    = ind[i];
+    p.fate   = fate[i];
+    p.type   = type[i];
+    p.rng_id    = rng_id[i];
+    p.rng_count = rng_count[i];
+    p.gamma  = gamma[i];
+    p.dshift = dshift[i];
+    p.dvds   = dvds[i];
+    return p;
+  }
+
+  //------------------------------------------------------
+  // copy a particle into slot i of the store
+  //------------------------------------------------------
+  void set(const int i, const particle& p)
+  {
+    for (int k=0;k<3;k++) {
+      x[k][i] = p.x[k];
+      D[k][i] = p.D[k];
+      x_interact[k][i] = p.x_interact[k]; }
+    nu[i]     = p.nu;
+    i_nu[i]   = p.i_nu;
+    e[i]      = p.e;
+    t[i]      = p.t;
+    ind[i]    = p.ind;
+    fate[i]   = p.fate;
+    type[i]   = p.type;
+    rng_id[i]    = p.rng_id;
+    rng_count[i] = p.rng_count;
+    gamma[i]  = p.gamma;
+    dshift[i] = p.dshift;
+    dvds[i]   = p.dvds;
+  }
+
+  //------------------------------------------------------
+  // add a particle to the end of the store
+  // (not thread safe)
+  //------------------------------------------------------
+  void push_back(const particle& p)
+  {
+    resize(size() + 1);
+    set(size() - 1, p);
+  }
+
+  void pop_back() {resize(size() - 1); }
+
+  //------------------------------------------------------
+  // overwrite slot i with particle j of another store
+  //------------------------------------------------------
+  void copy(const int i, const ParticleStore& src, const int j)
+  {
+    for (int k=0;k<3;k++) {
+      x[k][i] = src.x[k][j];
+      D[k][i] = src.D[k][j];
+      x_interact[k][i] = src.x_interact[k][j]; }
+    nu[i]     = src.nu[j];
+    i_nu[i]   = src.i_nu[j];
+    e[i]      = src.e[j];
+    t[i]      = src.t[j];
+    ind[i]    = src.ind[j];
+    fate[i]   = src.fate[j];
+    type[i]   = src.type[j];
+    rng_id[i]    = src.rng_id[j];
+    rng_count[i] = src.rng_count[j];
+    gamma[i]  = src.gamma[j];
+    dshift[i] = src.dshift[j];
+    dvds[i]   = src.dvds[j];
+  }
+
+  //------------------------------------------------------
+  // overwrite slot i with the particle in slot j
+  //------------------------------------------------------
+  void move(const int i, const int j) {copy(i,*this,j); }
+
+  //------------------------------------------------------
+  // exchange contents with another store (no copying)
+  //------------------------------------------------------
+  void swap(ParticleStore& other)
+  {
+    for (int k=0;k<3;k++) {
+      x[k].swap(other.x[k]);
+      D[k].swap(other.D[k]);
+      x_interact[k].swap(other.x_interact[k]); }
+    nu.swap(other.nu);
+    i_nu.swap(other.i_nu);
+    e.swap(other.e);
+    t.swap(other.t);
+    ind.swap(other.ind);
+    fate.swap(other.fate);
+    type.swap(other.type);
+    rng_id.swap(other.rng_id);
+    rng_count.swap(other.rng_count);
+    gamma.swap(other.gamma);
+    dshift.swap(other.dshift);
+    dvds.swap(other.dvds);
+  }
+
+  //------------------------------------------------------
+  // x dot D of particle i (used for light travel times)
+  //------------------------------------------------------
+  double x_dot_d(const int i) const
+  {return x[0][i]*D[0][i] + x[1][i]*D[1][i] + x[2][i]*D[2][i]; }
+
+};
+
+#endif
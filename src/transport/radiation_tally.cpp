@@ -0,0 +1,132 @@
+#include <algorithm>
+#include "radiation_tally.h"
+
+//-----------------------------------------------------------------
+// set up the tally; J_nu must already be allocated
+// use_private = 1 allocates per-thread buffers
+// collect_stats = 1 counts the updates each thread makes per zone
+//-----------------------------------------------------------------
+void radiation_tally::init(grid_general *grid, std::vector< std::vector<real> > *J_nu,
+  int use_private, int collect_stats)
+{
+  grid_    = grid;
+  J_nu_    = J_nu;
+  n_zones_ = grid->n_zones;
+  n_nu_    = 1;
+  if (n_zones_ > 0) n_nu_ = (*J_nu)[0].size();
+  use_private_ = use_private;
+  collect_stats_ = collect_stats;
+
+#ifdef _OPENMP
+  n_threads_ = omp_get_max_threads();
+#else
+  n_threads_ = 1;
+#endif
+
+  if (collect_stats_)
+  {
+    n_updates_.resize(n_threads_);
+    for (int t=0;t<n_threads_;t++) n_updates_[t].assign(padded_size<long>(n_zones_),0);
+  }
+
+  if (use_private_)
+  {
+    zone_buf_.resize(n_threads_);
+    J_nu_buf_.resize(n_threads_);
+    for (int t=0;t<n_threads_;t++)
+    {
+      zone_buf_[t].assign(padded_size<double>(n_zones_*n_quantities),0.0);
+      J_nu_buf_[t].assign(padded_size<double>(n_zones_*n_nu_),0.0);
+    }
+  }
+}
+
+//-----------------------------------------------------------------
+// zero out the thread buffers and update counts
+//-----------------------------------------------------------------
+void radiation_tally::wipe()
+{
+  #pragma omp parallel for schedule(static)
+  for (int t=0;t<n_threads_;t++)
+  {
+    if (collect_stats_)
+      std::fill(n_updates_[t].begin(),n_updates_[t].end(),0);
+    if (use_private_)
+    {
+      std::fill(zone_buf_[t].begin(),zone_buf_[t].end(),0.0);
+      std::fill(J_nu_buf_[t].begin(),J_nu_buf_[t].end(),0.0);
+    }
+  }
+}
+
+//-----------------------------------------------------------------
+// add the thread buffers onto the grid and J_nu.
+// Threads are summed in order, so the result does not depend
+// on how the particles were scheduled
+//-----------------------------------------------------------------
+void radiation_tally::reduce()
+{
+  if (!use_private_) return;
+
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<n_zones_;i++)
+  {
+    zone *z = &(grid_->z[i]);
+    for (int t=0;t<n_threads_;t++)
+    {
+      const double *b = &(zone_buf_[t][i*n_quantities]);
+      z->e_abs  += b[e_abs];
+      z->fx_rad += b[fx_rad];
+      z->fy_rad += b[fy_rad];
+      z->fz_rad += b[fz_rad];
+      z->fr_rad += b[fr_rad];
+      const double *bj = &(J_nu_buf_[t][i*n_nu_]);
+      std::vector<real>& J = (*J_nu_)[i];
+      for (int j=0;j<n_nu_;j++) J[j] += bj[j];
+    }
+  }
+}
+
+//-----------------------------------------------------------------
+// statistics of the updates since the last wipe:
+// total number of updates, number made to zones that were
+// updated by more than one thread, and number of such zones
+//-----------------------------------------------------------------
+void radiation_tally::get_stats(long &n_updates, long &n_shared_updates,
+  int &n_shared_zones) const
+{
+  n_updates = 0;
+  n_shared_updates = 0;
+  n_shared_zones = 0;
+  if (!collect_stats_) return;
+  for (int i=0;i<n_zones_;i++)
+  {
+    long n_zone = 0;
+    int  n_touch = 0;
+    for (int t=0;t<n_threads_;t++)
+    {
+      n_zone += n_updates_[t][i];
+      if (n_updates_[t][i] > 0) n_touch++;
+    }
+    n_updates += n_zone;
+    if (n_touch > 1)
+    {
+      n_shared_updates += n_zone;
+      n_shared_zones++;
+    }
+  }
+}
+
+//-----------------------------------------------------------------
+// memory used by the per-thread buffers
+//-----------------------------------------------------------------
+double radiation_tally::memory_bytes() const
+{
+  double n = 0;
+  if (collect_stats_)
+    n += 1.0*n_threads_*padded_size<long>(n_zones_)*sizeof(long);
+  if (use_private_)
+    n += 1.0*n_threads_*(padded_size<double>(n_zones_*n_quantities)
+      + padded_size<double>(n_zones_*n_nu_))*sizeof(double);
+  return n;
+}
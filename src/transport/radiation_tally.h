@@ -0,0 +1,150 @@
+#ifndef _RADIATION_TALLY_H
+#define _RADIATION_TALLY_H 1
+
+#include <vector>
+#include "grid_general.h"
+#include "sedona.h"
+#include "aligned_allocator.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//**********************************************************
+// Accumulates the radiation quantities tallied by particles
+// during propagation (absorbed energy, radiation force and
+// J_nu in each zone).
+//
+// In atomic mode each tally is added directly onto the
+// grid with an omp atomic. In private mode each thread adds
+// into its own buffers, which are summed onto the grid by
+// reduce() after the propagation loop, so threads never
+// write to the same memory.
+//
+// Each thread buffer starts on a cache line and is padded
+// to a whole number of cache lines, so threads do not
+// false-share the ends of their buffers.
+//
+// When statistics are requested, the number of tally
+// updates each thread makes in each zone is counted, to
+// measure how much of the tallying goes to zones that are
+// shared between threads
+//**********************************************************
+class radiation_tally
+{
+
+public:
+
+  // zone quantities that are tallied
+  enum quantity {e_abs, fx_rad, fy_rad, fz_rad, fr_rad, n_quantities};
+
+private:
+
+  grid_general *grid_;
+  std::vector< std::vector<real> > *J_nu_;
+
+  int n_zones_, n_nu_, n_threads_;
+  int use_private_;
+  int collect_stats_;
+
+  template <class T> using buffer = std::vector<T, aligned_allocator<T> >;
+
+  // per-thread buffers, indexed [thread][zone*n + i]
+  std::vector< buffer<double> > zone_buf_;
+  std::vector< buffer<double> > J_nu_buf_;
+
+  // per-thread count of tally updates in each zone
+  std::vector< buffer<long> > n_updates_;
+
+  // length n rounded up to a whole number of cache lines
+  template <class T> static size_t padded_size(size_t n)
+  {
+    const size_t per_line = ALIGNED_ALLOCATOR_ALIGN/sizeof(T);
+    return ((n + per_line - 1)/per_line)*per_line;
+  }
+
+  int thread_num() const
+  {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+public:
+
+  radiation_tally() : grid_(NULL), J_nu_(NULL), n_zones_(0), n_nu_(0),
+    n_threads_(1), use_private_(0), collect_stats_(0) {}
+
+  void init(grid_general *grid, std::vector< std::vector<real> > *J_nu, int use_private,
+    int collect_stats);
+  void wipe();
+  void reduce();
+
+  // contention statistics of the last step (zero unless collected)
+  void get_stats(long &n_updates, long &n_shared_updates, int &n_shared_zones) const;
+
+  int    use_private() const {return use_private_; }
+  int    collect_stats() const {return collect_stats_; }
+  double memory_bytes() const;
+
+  //------------------------------------------------------
+  // add val to quantity q of zone ind
+  //------------------------------------------------------
+  void add(const quantity q, const int ind, const double val)
+  {
+    int t = thread_num();
+    if (collect_stats_) n_updates_[t][ind]++;
+    if (use_private_)
+    {
+      zone_buf_[t][ind*n_quantities + q] += val;
+      return;
+    }
+    zone *z = &(grid_->z[ind]);
+    switch (q)
+    {
+      case e_abs:
+        #pragma omp atomic
+        z->e_abs  += val;
+        break;
+      case fx_rad:
+        #pragma omp atomic
+        z->fx_rad += val;
+        break;
+      case fy_rad:
+        #pragma omp atomic
+        z->fy_rad += val;
+        break;
+      case fz_rad:
+        #pragma omp atomic
+        z->fz_rad += val;
+        break;
+      case fr_rad:
+        #pragma omp atomic
+        z->fr_rad += val;
+        break;
+      default:
+        break;
+    }
+  }
+
+  //------------------------------------------------------
+  // add val to J_nu of zone ind at frequency index i_nu
+  //------------------------------------------------------
+  void add_J_nu(const int ind, const int i_nu, const double val)
+  {
+    int t = thread_num();
+    if (collect_stats_) n_updates_[t][ind]++;
+    if (use_private_)
+    {
+      J_nu_buf_[t][ind*n_nu_ + i_nu] += val;
+      return;
+    }
+    #pragma omp atomic
+    (*J_nu_)[ind][i_nu] += val;
+  }
+
+};
+
+#endif
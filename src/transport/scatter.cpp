@@ -6,10 +6,32 @@
 
 namespace pc = physical_constants;
 
+//------------------------------------------------------------
+// direction at angle acos(mu) from the unit vector D, and
+// azimuth phi around it
+//------------------------------------------------------------
+static void rotate_direction(const double *D, const double mu, const double phi, double *D_new)
+{
+  double smu  = sqrt(1 - mu*mu);
+  double cphi = cos(phi);
+  double sphi = sin(phi);
+  double s = sqrt(D[0]*D[0] + D[1]*D[1]);
+  if (s < 1e-10)
+  {
+    D_new[0] = smu*cphi;
+    D_new[1] = smu*sphi;
+    D_new[2] = (D[2] > 0) ? mu : -mu;
+    return;
+  }
+  D_new[0] = mu*D[0] + smu*(D[0]*D[2]*cphi - D[1]*sphi)/s;
+  D_new[1] = mu*D[1] + smu*(D[1]*D[2]*cphi + D[0]*sphi)/s;
+  D_new[2] = mu*D[2] - smu*s*cphi;
+}
+
 //------------------------------------------------------------
 // interaction physics
 //------------------------------------------------------------
-ParticleFate transport::do_scatter(particle *p, double eps)
+ParticleFate transport::do_scatter(particle *p, double eps, RNG_stream &rng)
 {
   zone *zone = &(grid->z[p->ind]);
   ParticleFate fate = moving;
@@ -19,24 +41,41 @@ ParticleFate transport::do_scatter(particle *p, double eps)
   p->x_interact[1] = p->x[1];
   p->x_interact[2] = p->x[2];
 
+  // with implicit capture, photon absorption was done along
+  // the path; the event is an elastic scattering or a thermal
+  // re-emission, in proportion to their opacities
+  if ((implicit_capture_)&&(p->type == photon))
+  {
+    double f_scat = 1 - capture_fraction(p->ind,eps);
+    if ((f_scat <= 0)||(rng.uniform()*f_scat < 1 - eps))
+    {
+      if (compton_scatter_photons_)
+        compton_scatter_photon(p,rng);
+      else
+        isotropic_scatter(p,0,rng);
+    }
+    else
+      isotropic_scatter(p,1,rng);
+  }
+
   // do photon interaction physics
-  if (p->type == photon)
+  else if (p->type == photon)
   {
     // see if scattered
-    if (rangen.uniform() > eps)
+    if (rng.uniform() > eps)
     {
       if (compton_scatter_photons_)
-        compton_scatter_photon(p);
+        compton_scatter_photon(p,rng);
       else
-        isotropic_scatter(p,0);
+        isotropic_scatter(p,0,rng);
     }
     else
     {
       // check for effective scattering
-      double z2 = rangen.uniform();
+      double z2 = rng.uniform();
       // enforced radiative equilibrium always effective scatters
       if ((z2 > zone->eps_imc)||(radiative_eq))
-        isotropic_scatter(p,1);
+        isotropic_scatter(p,1,rng);
       else fate = absorbed;
     }
   }
@@ -45,20 +84,21 @@ ParticleFate transport::do_scatter(particle *p, double eps)
   if (p->type == gammaray)
   {
     // see if scattered
-    if (rangen.uniform() > eps) compton_scatter(p);
+    if (rng.uniform() > eps) compton_scatter(p,rng);
     // or if absorbed, turn it into a photon
     else
     {
+      #pragma omp atomic
       grid->z[p->ind].L_radio_dep += p->e;
       p->type = photon;
       // isotropic emission in comoving frame
-      double mu  = 1 - 2.0*rangen.uniform();
-      double phi = 2.0*pc::pi*rangen.uniform();
+      double mu  = 1 - 2.0*rng.uniform();
+      double phi = 2.0*pc::pi*rng.uniform();
       double smu = sqrt(1 - mu*mu);
       p->D[0] = smu*cos(phi);
       p->D[1] = smu*sin(phi);
       p->D[2] = mu;
-      sample_photon_frequency(p);
+      sample_photon_frequency(p,rng);
 
       // lorentz transform back to lab frame
       transform_comoving_to_lab(p);
@@ -73,34 +113,20 @@ ParticleFate transport::do_scatter(particle *p, double eps)
 //------------------------------------------------------------
 // physics of compton scattering for gamma-rays
 //------------------------------------------------------------
-void transport::compton_scatter(particle *p)
+void transport::compton_scatter(particle *p, RNG_stream &rng)
 {
   assert(p->ind >= 0);
 
   transform_lab_to_comoving(p);
 
-  // sample new direction by rejection method
-  double E_ratio;
+  // sample scattering angle from the klein-nishina cross-section
+  double x = p->nu/pc::m_e_MeV;
+  double cost = compton_tables_.sample_cos_theta(x,rng.uniform());
+  double phi  = 2.0*pc::pi*rng.uniform();
   double D_new[3];
-  while (true)
-  {
-    // isotropic new direction
-    double mu  = 1 - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1 - mu*mu);
-    D_new[0] = smu*cos(phi);
-    D_new[1] = smu*sin(phi);
-    D_new[2] = mu;
-
-    // angle between old and new directions
-    double cost = p->D[0]*D_new[0] + p->D[1]*D_new[1] + p->D[2]*D_new[2];
-    // new energy ratio (E_new/E_old) at this angle (assuming lambda in MeV)
-    E_ratio = 1/(1 + p->nu/pc::m_e_MeV*(1 - cost));
-    // klein-nishina differential cross-section
-    double diff_cs = 0.5*(E_ratio*E_ratio*(1/E_ratio + E_ratio - 1 + cost*cost));
-    // see if this scatter angle OK
-    if (rangen.uniform() < diff_cs) break;
-  }
+  rotate_direction(p->D,cost,phi,D_new);
+  // new energy ratio (E_new/E_old) at this angle (assuming lambda in MeV)
+  double E_ratio = 1/(1 + x*(1 - cost));
 
   // new frequency
   p->nu = p->nu*E_ratio;
@@ -109,18 +135,19 @@ void transport::compton_scatter(particle *p)
   //if (p->type == gammaray) grid->z[p->ind].L_radio_dep += p->e*(1 - E_ratio);
 
   // sample whether we stay alive, if not become a photon
-  if (rangen.uniform() > E_ratio)
+  if (rng.uniform() > E_ratio)
   {
+    #pragma omp atomic
     grid->z[p->ind].L_radio_dep += p->e;
     p->type = photon;
     // isotropic emission in comoving frame
-    double mu  = 1 - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
+    double mu  = 1 - 2.0*rng.uniform();
+    double phi = 2.0*pc::pi*rng.uniform();
     double smu = sqrt(1 - mu*mu);
     D_new[0] = smu*cos(phi);
     D_new[1] = smu*sin(phi);
     D_new[2] = mu;
-    sample_photon_frequency(p);
+    sample_photon_frequency(p,rng);
   }
 
   // set new direction
@@ -133,36 +160,27 @@ void transport::compton_scatter(particle *p)
 }
 
 
-void transport::sample_MB_vector(double T, double* v_e, double* p_d)
+void transport::sample_MB_vector(double T, double* v_e, double* p_d, RNG_stream &rng)
 {
-
-  while (true)
-  {
-
-    // if you prefer, you could also rejection sample to get v_tot.
-
-    double v_tot = sqrt(2. * pc::k * T /pc::m_e) * mb_dv * (mb_cdf_.sample(rangen.uniform()) + rangen.uniform() );
-
-    double mu  = 1. - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1 - mu*mu);
-    double ed0 = smu*cos(phi);
-    double ed1 = smu*sin(phi);
-    double ed2 = mu;
-
-
-    double omega = ed0 * p_d[0] + ed1 * p_d[1] + ed2 * p_d[2];
-
-    // could tighten this bound if you think you know how small v_tot/C will be
-    if (rangen.uniform() < 0.5 * (1. - omega * v_tot/pc::c)) // this is crucial. For the more relativistic case, the formula gets more complicated. See the discussion at the top of pdf page 135 (journal page 323) of the Pozdnyakov 1983 paper, which references a formula for sigma-hat four pages earlier
-    {
-
-      v_e[0] = v_tot * ed0;
-      v_e[1] = v_tot * ed1;
-      v_e[2] = v_tot * ed2;
-      return;
-    }
-  }
+  // speed from the maxwell-boltzmann distribution
+  double v_tot = sqrt(2. * pc::k * T /pc::m_e) * compton_tables_.sample_MB_speed(rng.uniform());
+  double beta  = v_tot/pc::c;
+
+  // The chance to scatter goes as (1 - omega*beta), where omega is the cosine
+  // between the electron and photon directions (for the more relativistic case,
+  // the formula gets more complicated, see the discussion at the top of pdf page
+  // 135 (journal page 323) of the Pozdnyakov 1983 paper, which references a formula
+  // for sigma-hat four pages earlier). As this integrates to the same over omega
+  // for any speed, sample omega from it directly by inverting its CDF
+  double z = 2.0*rng.uniform() - 1;
+  double omega = (2*z - beta)/(1 + sqrt(1 + beta*beta - 2*beta*z));
+  double phi = 2.0*pc::pi*rng.uniform();
+
+  double ed[3];
+  rotate_direction(p_d,omega,phi,ed);
+  v_e[0] = v_tot * ed[0];
+  v_e[1] = v_tot * ed[1];
+  v_e[2] = v_tot * ed[2];
 }
 
 
@@ -171,7 +189,7 @@ void transport::sample_MB_vector(double T, double* v_e, double* p_d)
 // physics of compton scattering for photons of arbitrary energies
 // samples from thermal velocity distribution of non-relativistic electrons
 //------------------------------------------------------------
-void transport::compton_scatter_photon(particle *p)
+void transport::compton_scatter_photon(particle *p, RNG_stream &rng)
 {
 
   assert(p->ind >= 0);
@@ -184,7 +202,7 @@ void transport::compton_scatter_photon(particle *p)
 
   // Find random thermal electron velocity
   double v_sc[3];
-  sample_MB_vector(zone->T_gas,v_sc,p->D);
+  sample_MB_vector(zone->T_gas,v_sc,p->D,rng);
 
   //Transform into rest frame of electon
   double v_tot = sqrt(v_sc[0] * v_sc[0] + v_sc[1] * v_sc[1] + v_sc[2] * v_sc[2]);
@@ -205,29 +223,14 @@ void transport::compton_scatter_photon(particle *p)
   p->D[2] = 1.0/dshift_into_scatterer * (p->D[2] - gamma*v_sc[2]/pc::c * (1. - gamma*vdd/pc::c/(gamma+1)) );
 
 
-  // sample new direction by rejection method
-  double E_ratio;
+  // sample scattering angle from the klein-nishina cross-section
+  double x = pc::h * p->nu / (pc::m_e_MeV * pc:: Mev_to_ergs);
+  double cost = compton_tables_.sample_cos_theta(x,rng.uniform());
+  double phi  = 2.0*pc::pi*rng.uniform();
   double D_new[3];
-
-  while (true)
-  {
-    // isotropic new direction
-    double mu  = 1. - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1. - mu*mu);
-    D_new[0] = smu*cos(phi);
-    D_new[1] = smu*sin(phi);
-    D_new[2] = mu;
-
-    // angle between old and new directions
-    double cost = p->D[0]*D_new[0] + p->D[1]*D_new[1] + p->D[2]*D_new[2];
-    // new energy ratio (E_new/E_old) at this angle (assuming lambda in MeV)
-    E_ratio = 1./(1. + pc::h * p->nu / (pc::m_e_MeV * pc:: Mev_to_ergs)*(1. - cost));
-    // klein-nishina differential cross-section
-    double diff_cs = 0.5*(E_ratio*E_ratio*(1./E_ratio + E_ratio - 1. + cost*cost));
-    // see if this scatter angle OK
-    if (rangen.uniform() < diff_cs) break;
-  }
+  rotate_direction(p->D,cost,phi,D_new);
+  // new energy ratio (E_new/E_old) at this angle
+  double E_ratio = 1./(1. + x*(1. - cost));
 
   // new frequency
   p->nu = p->nu * E_ratio;
@@ -300,7 +303,7 @@ void transport::compton_scatter_photon(particle *p)
 //------------------------------------------------------------
 // FAKE physics of non-isotropic Compton scattering
 //------------------------------------------------------------
-void transport::isotropic_scatter(particle *p, int redist)
+void transport::isotropic_scatter(particle *p, int redist, RNG_stream &rng)
 {
   double V[3], dvds;
   grid->get_velocity(p->ind,p->x,p->D,V,&dvds);
@@ -319,15 +322,15 @@ void transport::isotropic_scatter(particle *p, int redist)
   double D_new[3];
 
   // choose new isotropic direction in comoving frame
-  double mu  = 1 - 2.0*rangen.uniform();
-  double phi = 2.0*pc::pi*rangen.uniform();
+  double mu  = 1 - 2.0*rng.uniform();
+  double phi = 2.0*pc::pi*rng.uniform();
   double smu = sqrt(1 - mu*mu);
   D_new[0] = smu*cos(phi);
   D_new[1] = smu*sin(phi);
   D_new[2] = mu;
 
   // choose new wavelength if redistributed
-  if (redist) sample_photon_frequency(p);
+  if (redist) sample_photon_frequency(p,rng);
 
   // outgoing velocity vector
   for (int i=0;i<3;i++) V[i] = -1*V[i];
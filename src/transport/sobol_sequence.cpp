@@ -0,0 +1,57 @@
+#include <iostream>
+#include <stdlib.h>
+#include "sobol_sequence.h"
+
+//------------------------------------------------------------
+// primitive polynomials (degree s, coefficients a) and
+// initial direction numbers m of dimensions 2 to max_dims,
+// from the new-joe-kuo-6.21201 table
+//------------------------------------------------------------
+static const int sobol_s[] = {1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6};
+static const int sobol_a[] = {0, 1, 1, 2, 1, 4, 2, 4, 7, 11, 13, 14, 1, 13, 16};
+static const int sobol_m[][6] = {
+  {1}, {1,3}, {1,3,1}, {1,1,1}, {1,1,3,3}, {1,3,5,13},
+  {1,1,5,5,17}, {1,1,5,5,5}, {1,1,7,11,19}, {1,1,5,1,1},
+  {1,1,1,3,11}, {1,3,5,5,31}, {1,3,3,9,7,49}, {1,1,1,15,21,21},
+  {1,3,1,13,27,49}};
+
+//------------------------------------------------------------
+// set up the direction numbers of n_dims dimensions
+//------------------------------------------------------------
+void sobol_sequence::init(const int n_dims)
+{
+  if ((n_dims < 1)||(n_dims > max_dims))
+  {
+    std::cerr << "# ERROR: sobol sequence supports 1 to " << max_dims << " dimensions\n";
+    exit(1);
+  }
+  n_dims_ = n_dims;
+  v_.assign(32*n_dims_,0);
+  shift_.assign(n_dims_,0);
+
+  // first dimension is the van der corput sequence
+  for (int b=0;b<32;b++) v_[b] = 1u << (31 - b);
+
+  for (int d=1;d<n_dims_;d++)
+  {
+    int s = sobol_s[d-1];
+    int a = sobol_a[d-1];
+    uint32_t *v = &v_[32*d];
+    for (int b=0;b<s;b++) v[b] = (uint32_t)sobol_m[d-1][b] << (31 - b);
+    for (int b=s;b<32;b++)
+    {
+      v[b] = v[b-s] ^ (v[b-s] >> s);
+      for (int k=1;k<s;k++)
+        if ((a >> (s - 1 - k)) & 1) v[b] ^= v[b-k];
+    }
+  }
+}
+
+//------------------------------------------------------------
+// new random digital shift
+//------------------------------------------------------------
+void sobol_sequence::scramble(RNG_stream &rng)
+{
+  for (int d=0;d<n_dims_;d++)
+    shift_[d] = (uint32_t)(rng.uniform()*4294967296.0);
+}
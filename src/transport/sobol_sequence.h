@@ -0,0 +1,66 @@
+#ifndef _SOBOL_SEQUENCE_H
+#define _SOBOL_SEQUENCE_H 1
+
+#include <stdint.h>
+#include <vector>
+#include "RNG_stream.h"
+
+//**********************************************************
+// Scrambled Sobol low-discrepancy sequence, for quasi-monte
+// carlo sampling of particle emission.
+//
+// Point n of the sequence is a function of n alone, so each
+// emitted particle can take the point of its own number,
+// whichever rank or thread emits it. The points are
+// scrambled with a random digital shift (an xor of every
+// coordinate with a random bit pattern), which keeps their
+// uniformity and makes estimates made with them unbiased.
+// Direction numbers are from Joe & Kuo (2008); the first
+// max_dims dimensions are supported
+//**********************************************************
+class sobol_sequence
+{
+
+private:
+
+  int n_dims_;
+
+  // 32 direction numbers per dimension
+  std::vector<uint32_t> v_;
+  // the digital shift of each dimension
+  std::vector<uint32_t> shift_;
+
+public:
+
+  static const int max_dims = 16;
+
+  sobol_sequence() : n_dims_(0) {}
+
+  void init(const int n_dims);
+
+  //------------------------------------------------------
+  // draw a new random shift for all dimensions
+  //------------------------------------------------------
+  void scramble(RNG_stream &rng);
+
+  //------------------------------------------------------
+  // the first n coordinates (n <= n_dims) of point number
+  // index, each in the open interval (0,1)
+  //------------------------------------------------------
+  void point(const uint64_t index, double *u, const int n) const
+  {
+    uint32_t k = (uint32_t)index;
+    for (int d=0;d<n;d++)
+    {
+      const uint32_t *v = &v_[32*d];
+      uint32_t x = shift_[d];
+      for (int b=0;(k >> b) != 0;b++)
+        if ((k >> b) & 1) x ^= v[b];
+      u[d] = (x + 0.5)*(1.0/4294967296.0);
+    }
+  }
+
+  int n_dims() const {return n_dims_; }
+};
+
+#endif
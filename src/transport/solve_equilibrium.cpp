@@ -15,6 +15,7 @@ int transport::solve_state_and_temperature(GasState* gas_state_ptr, int i)
 {
 
   vector<OpacityType> emis(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
@@ -37,7 +38,7 @@ int transport::solve_state_and_temperature(GasState* gas_state_ptr, int i)
     if (gas_state_ptr->use_nlte_ == 0)
     {
       solve_error = gas_state_ptr->solve_state();
-      gas_state_ptr->computeOpacity(abs_opacity_[i],scat,emis);
+      gas_state_ptr->computeOpacity(abs,scat,emis);
     }
 
     // Calculate equilibrium temperature.
@@ -120,15 +121,19 @@ double transport::rad_eq_function_LTE(GasState* gas_state_ptr, int c,double T, i
 
   // helper variables need for call (will not be used)
   vector<OpacityType> emis(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
-  // recalculate opacities based on current T if desired
+  // recalculate opacities based on current T if desired,
+  // otherwise use the ones stored for this zone
   if (solve_flag)
   {
     // solve_error = gas_state_ptr->solve_state();
-    gas_state_ptr->computeOpacity(abs_opacity_[c],scat,emis);
+    gas_state_ptr->computeOpacity(abs,scat,emis);
   }
+  else
+    opacity_table_.get_row(c,abs,scat);
 
   // total energy emitted (to be calculated)
   double E_emitted = 0.;
@@ -142,10 +147,10 @@ double transport::rad_eq_function_LTE(GasState* gas_state_ptr, int c,double T, i
   // Calculate total emission assuming no frequency (grey) opacity
   if (nu_grid_.size() == 1)
   {
-    E_emitted = 4.0*pc::pi*abs_opacity_[c][0]*pc::sb/pc::pi*pow(T,4);
+    E_emitted = 4.0*pc::pi*abs[0]*pc::sb/pc::pi*pow(T,4);
 
     if (solve_flag && solve_error == 0)
-      E_absorbed = pc::c *abs_opacity_[c][0] * grid->z[c].e_rad;
+      E_absorbed = pc::c *abs[0] * grid->z[c].e_rad;
   }
 
   // integrate emisison over frequency (angle
@@ -158,7 +163,7 @@ double transport::rad_eq_function_LTE(GasState* gas_state_ptr, int c,double T, i
     double dnu  = nu_grid_.delta(i);
     double nu   = nu_grid_.center(i);
     double B_nu = blackbody_nu(T,nu);
-    double kappa_abs = abs_opacity_[c][i];
+    double kappa_abs = abs[i];
     E_emitted += 4.0*pc::pi*kappa_abs*B_nu*dnu;
     if (solve_flag == 1)
       E_absorbed += 4.0*pc::pi*kappa_abs*J_nu_[c][i]*dnu;
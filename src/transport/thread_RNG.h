@@ -1,23 +1,44 @@
 #ifndef _THREAD_RNG_H
 #define _THREAD_RNG_H
-#include <gsl/gsl_rng.h>
-#include <vector>
+#include <stdint.h>
 #include <string>
+#include "RNG_stream.h"
 
+//**********************************************************
+// Source of the random number streams of a run, from a
+// counter-based generator keyed by the run seed.
+//
+// Every particle carries its own stream (id, count). The
+// thread that works on a particle gets a stream object for
+// it with stream() and saves the count back afterwards, so
+// a particle history does not depend on which thread or
+// rank follows it. New stream ids are handed out in the
+// same order on every rank by new_streams().
+//**********************************************************
 class thread_RNG
 {
 
 protected:
 
-  // OPTIMIZE - to prevent false sharing, make sure all the RNG's are on different cache lines
-  // vector of generators
-  std::vector<gsl_rng*> generators;
-  
+  uint64_t seed_;
+  uint64_t next_id_;
+
 public:
 
+  thread_RNG() : seed_(0), next_id_(0) {}
+
   void   init(bool fix_seed = false, unsigned long int fixed_seed_val = 0);
-  double uniform();
-  ~thread_RNG();
+
+  // reserve n consecutive stream ids, returns the first
+  uint64_t new_streams(const uint64_t n);
+
+  // stream id, positioned at draw number count
+  RNG_stream stream(const uint64_t id, const uint64_t count) const
+  {
+    RNG_stream s;
+    s.set(seed_,id,count);
+    return s;
+  }
 
   void writeCheckpointRNG(std::string fname);
   int readCheckpointRNG(std::string fname);
@@ -10,6 +10,7 @@
 #include <list>
 #include <algorithm>
 #include <ctime>
+#include <stdint.h>
 
 #include "transport.h"
 #include "ParameterReader.h"
@@ -20,6 +21,37 @@ using std::cerr;
 using std::endl;
 namespace pc = physical_constants;
 
+//--------------------------------------------------------
+// thread number, number of threads in the current team
+// and maximum number of threads, also without OpenMP
+//--------------------------------------------------------
+static int local_thread_num()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+static int local_num_threads()
+{
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+static int local_max_threads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
 //------------------------------------------------------------
 // take a transport time step
 //------------------------------------------------------------
@@ -50,54 +82,123 @@ void transport::step(double dt)
   tstr = get_system_time();
   emit_particles(dt);
 
+  // reorder the particles so that threads work on spatially coherent chunks
+  if (sort_particles_) sort_particle_vector();
+
+  // zone importances and packet energy for splitting and roulette
+  if (use_weight_windows_) set_weight_windows();
+
+  // energy below which captured packets are rouletted
+  if (implicit_capture_) implicit_capture_e_floor_ = implicit_capture_floor_*mean_particle_energy();
+
+  // splitting, roulette and implicit capture leave packets with
+  // unequal energies, so then the escaped fraction is measured by
+  // packet energy rather than by packet count
+  int weighted_packets = (use_weight_windows_ || implicit_capture_);
+  double e_active = 0;
+  if ((steady_state)&&(weighted_packets))
+  {
+    int n = particles.size();
+    #pragma omp parallel for schedule(static) reduction(+:e_active)
+    for (int i=0;i<n;i++) e_active += particles.e[i];
+  }
+
   // Propagate the particles
   int n_active = particles.size();
   int n_particles = particles.size();
+  double tprop = get_system_time();
 
-  #pragma omp parallel for schedule(guided)
-  for(int i=0; i<n_particles; i++)
+  if (use_event_transport_)
   {
-    // propagate particles
-    particles[i].fate = propagate(particles[i],dt);
+    // advance all particles together in batches of events
+    propagate_event_based(dt);
 
     // Add escaped photons to output spectrum and escaped particle list
-    if (particles[i].fate == escaped)
+    #pragma omp parallel for schedule(guided)
+    for(int i=0; i<n_particles; i++)
     {
-      // account for light crossing time, relative to grid center
-      double t_obs = particles[i].t - particles[i].x_dot_d()/pc::c;
-      if (particles[i].type == photon)
-        optical_spectrum.count(t_obs,particles[i].nu,particles[i].e,particles[i].D);
-      if (particles[i].type == gammaray)
-        gamma_spectrum.count(t_obs,particles[i].nu,particles[i].e,particles[i].D);
-      particles[i].t = t_obs;
-      if (save_escaped_particles_) {
-#pragma omp critical
-        {
-          if (maxn_escaped_particles_ >= particles_escaped.size()) {
-            particles_escaped.push_back(particles[i]);
-          }
-          else {
-            std::cerr << "# WARNING: Escaped particle list exceeds max size " 
-              << maxn_escaped_particles_ << std::endl;
-            std::cerr << "# Clearing escaped particle list on rank " << MPI_myID << std::endl;
-            clearEscapedParticles();
-          }
-        }
-      }
+      if (particles.fate[i] != escaped) continue;
+      particle p = particles.get(i);
+      record_escaped_particle(p);
+      particles.set(i,p);
     }
   }
+  else
+  {
+    #pragma omp parallel for schedule(guided)
+    for(int i=0; i<n_particles; i++)
+    {
+      // pull this particle out of the store and propagate it,
+      // drawing random numbers from its own stream
+      particle p = particles.get(i);
+      RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+      p.fate = propagate(p,dt,rng);
+      p.rng_count = rng.count();
+
+      // Add escaped photons to output spectrum and escaped particle list
+      if (p.fate == escaped) record_escaped_particle(p);
+
+      // put the updated particle back
+      particles.set(i,p);
+    }
+  }
+
+  // follow the copies made by splitting packets
+  if (use_weight_windows_) propagate_split_particles(dt);
+
+  // collect the escaped particle lists of all threads
+  gather_escaped_particles();
+
+  double tprop_end = get_system_time();
+  if ((verbose)&&(n_particles > 0)&&(tprop_end > tprop))
+    cout << "# Transport rate         (" << n_particles/(tprop_end-tprop)
+         << " particles/sec/rank, " << (use_event_transport_ ? "event" : "history") << " mode)\n";
+
+  // combine thread tallies of the radiation quantities
+  double ttally = get_system_time();
+  tally_.reduce();
+  double ttally_end = get_system_time();
+  if (verbose)
+  {
+    cout << "# Tallied radiation      (" << (ttally_end-ttally) << " secs, "
+         << (tally_.use_private() ? "private" : "atomic") << " mode";
+    if (tally_.collect_stats())
+    {
+      long n_updates, n_shared;
+      int n_shared_zones;
+      tally_.get_stats(n_updates,n_shared,n_shared_zones);
+      double f_shared = 0;
+      if (n_updates > 0) f_shared = (1.0*n_shared)/(1.0*n_updates);
+      cout << "; " << n_updates << " updates, " << 100.0*f_shared << "% to "
+           << n_shared_zones << " zones shared by threads";
+    }
+    cout << ")\n";
+  }
 
   // Remove escaped and absorbed particles from the particle vector
+  double tcensus = get_system_time();
   int n_escaped = clean_up_particle_vector();
+  double tcensus_end = get_system_time();
+  if (verbose)
+    cout << "# Particle census        (" << (tcensus_end-tcensus) << " secs; "
+         << census_.n_alive << " alive, " << census_.n_escaped << " escaped (" << census_.e_escaped
+         << " ergs), " << census_.n_absorbed << " absorbed (" << census_.e_absorbed << " ergs))\n";
 
   // calculate percent particles escaped, and rescale if wanted
   if (steady_state)
   {
     double per_esc = (1.0*n_escaped)/(1.0*n_active);
+    const char *esc_name = "particles";
+    if (weighted_packets)
+    {
+      per_esc = 0;
+      if (e_active > 0) per_esc = census_.e_escaped/e_active;
+      esc_name = "energy";
+    }
     if (core_fix_luminosity_)
     {
       if (verbose)
-        cout << "# Percent particles escaped = " << 100.0*per_esc << " (rescaling)\n";
+        cout << "# Percent " << esc_name << " escaped = " << 100.0*per_esc << " (rescaling)\n";
 
       double fac = 1.0/per_esc;
       optical_spectrum.rescale(fac);
@@ -111,7 +212,7 @@ void transport::step(double dt)
     }
     else {
       if (verbose)
-        cout << "# Percent particles escaped = " << 100.0*per_esc << " (not rescaling)\n";}
+        cout << "# Percent " << esc_name << " escaped = " << 100.0*per_esc << " (not rescaling)\n";}
   }
 
   tend = get_system_time();
@@ -157,52 +258,325 @@ double get_system_time()
 
 
 //--------------------------------------------------------
-// Loop over the vector of particles
-// and remove those that are either escaped or absorbed
-// Returns the number of particles that escaped
+// mean energy of the particles in the store, over all ranks
+//--------------------------------------------------------
+double transport::mean_particle_energy()
+{
+  int n = particles.size();
+  double e_sum = 0;
+  #pragma omp parallel for schedule(static) reduction(+:e_sum)
+  for (int i=0;i<n;i++) e_sum += particles.e[i];
+  double sum[2] = {e_sum, (double)n};
+#ifdef MPI_PARALLEL
+  MPI_Allreduce(MPI_IN_PLACE,sum,2,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif
+  if (sum[1] == 0) return 0;
+  return sum[0]/sum[1];
+}
+
+//--------------------------------------------------------
+// Add an escaped particle to the output spectrum and
+// (optionally) to this thread's escaped particle buffer.
+// Sets the particle time to the observer time, accounting
+// for light travel time relative to the grid center
+//--------------------------------------------------------
+void transport::record_escaped_particle(particle &p)
+{
+  // account for light crossing time, relative to grid center
+  double t_obs = p.t - p.x_dot_d()/pc::c;
+  if (p.type == photon)
+    optical_spectrum.count(t_obs,p.nu,p.e,p.D);
+  if (p.type == gammaray)
+    gamma_spectrum.count(t_obs,p.nu,p.e,p.D);
+  p.t = t_obs;
+  if (save_escaped_particles_)
+  {
+    ParticleStore& buffer = escape_buffers_[local_thread_num()];
+    buffer.push_back(p);
+
+    // write out full buffers; only this thread waits on the file
+    if ((stream_escaped_particles_)&&(buffer.size() >= escaped_stream_chunk_))
+    {
+      #pragma omp critical(escaped_stream)
+      append_escaped_stream(buffer);
+      buffer.clear();
+    }
+  }
+}
+
+//--------------------------------------------------------
+// Move the escaped particles collected by each thread
+// this step onto the escaped particle list
+//--------------------------------------------------------
+void transport::gather_escaped_particles()
+{
+  if ((!save_escaped_particles_)||(stream_escaped_particles_)) return;
+
+  for (size_t t = 0; t < escape_buffers_.size(); t++)
+  {
+    ParticleStore& buffer = escape_buffers_[t];
+    for (int i = 0; i < buffer.size(); i++)
+    {
+      if (maxn_escaped_particles_ >= particles_escaped.size()) {
+        particles_escaped.push_back(buffer.get(i));
+      }
+      else {
+        std::cerr << "# WARNING: Escaped particle list exceeds max size "
+          << maxn_escaped_particles_ << std::endl;
+        std::cerr << "# Clearing escaped particle list on rank " << MPI_myID << std::endl;
+        clearEscapedParticles();
+      }
+    }
+    buffer.clear();
+  }
+}
+
+
+//--------------------------------------------------------
+// helper for the census: range of particles [lo,hi) that
+// thread t of nt handles in a blocked parallel scan
+//--------------------------------------------------------
+static void thread_block(int n, int t, int nt, int &lo, int &hi)
+{
+  lo = (int)(((long)n*t)/nt);
+  hi = (int)(((long)n*(t+1))/nt);
+}
+
+//--------------------------------------------------------
+// Remove the particles that are either escaped or absorbed
+// from the particle store, using parallel prefix sums.
+// Fills in census_ (number and energy of particles of
+// each fate) and returns the number that escaped.
+//
+// By default the compaction is done in place: the k-th
+// dead slot below the new end of the store is refilled with
+// the k-th live particle counted from the back, which gives
+// the same ordering as a serial swap-and-pop. If
+// census_preserve_order_ is set, the live particles are
+// instead copied out in their original order.
 //--------------------------------------------------------
 int transport::clean_up_particle_vector()
 {
+  int n = particles.size();
+
+  // count the particles of each fate in one pass
+  int n_escaped = 0, n_absorbed = 0;
+  double e_escaped = 0, e_absorbed = 0;
+  #pragma omp parallel for schedule(static) reduction(+:n_escaped,n_absorbed,e_escaped,e_absorbed)
+  for (int i=0;i<n;i++)
+  {
+    if (particles.fate[i] == escaped)
+      {n_escaped++;  e_escaped  += particles.e[i];}
+    else if (particles.fate[i] == absorbed)
+      {n_absorbed++; e_absorbed += particles.e[i];}
+  }
+  int n_alive = n - n_escaped - n_absorbed;
+
+  census_.n_alive    = n_alive;
+  census_.n_escaped  = n_escaped;
+  census_.n_absorbed = n_absorbed;
+  census_.e_escaped  = e_escaped;
+  census_.e_absorbed = e_absorbed;
+
+  // nothing to remove
+  if (n_alive == n) return n_escaped;
 
-  // do nothing to an empty particle vector
-  if (particles.size() == 0) return 0;
+  // the runtime may give a team smaller than nt, so the
+  // blocks are sized by the team each region actually gets
+  int nt = local_max_threads();
+  std::vector<int> offset(nt+1,0);
+
+  if (census_preserve_order_)
+  {
+    // ---------------------------------
+    // out of place, order preserving
+    // ---------------------------------
+    particles_census_.resize(n_alive);
+    #pragma omp parallel num_threads(nt)
+    {
+      int t = local_thread_num(), n_team = local_num_threads(), lo, hi;
+      thread_block(n,t,n_team,lo,hi);
+      int n_live = 0;
+      for (int i=lo;i<hi;i++)
+        if ((particles.fate[i] != escaped)&&(particles.fate[i] != absorbed)) n_live++;
+      offset[t+1] = n_live;
+      #pragma omp barrier
+      #pragma omp single
+      for (int k=0;k<n_team;k++) offset[k+1] += offset[k];
+      int j = offset[t];
+      for (int i=lo;i<hi;i++)
+        if ((particles.fate[i] != escaped)&&(particles.fate[i] != absorbed))
+          particles_census_.copy(j++,particles,i);
+    }
+    particles.swap(particles_census_);
+    particles_census_.clear();
+    return n_escaped;
+  }
 
-  int n_escaped = 0;
-  int i=0;
-  while (true)
+  // ---------------------------------
+  // in place: move live particles from the tail
+  // [n_alive,n) into the dead slots of [0,n_alive)
+  // ---------------------------------
+  int n_tail = n - n_alive;
+  std::vector<int> tail_live;
+  std::vector<int> tail_offset(nt+1,0);
+  #pragma omp parallel num_threads(nt)
   {
-    // remove particles from back until we have one that is allive
-    while ((particles.back().fate == escaped)||(particles.back().fate == absorbed))
+    int t = local_thread_num(), n_team = local_num_threads(), lo, hi;
+
+    // count live particles in the tail and dead slots in the head
+    thread_block(n_tail,t,n_team,lo,hi);
+    int n_live = 0;
+    for (int i=n_alive+lo;i<n_alive+hi;i++)
+      if ((particles.fate[i] != escaped)&&(particles.fate[i] != absorbed)) n_live++;
+    tail_offset[t+1] = n_live;
+
+    int hlo, hhi;
+    thread_block(n_alive,t,n_team,hlo,hhi);
+    int n_dead = 0;
+    for (int i=hlo;i<hhi;i++)
+      if ((particles.fate[i] == escaped)||(particles.fate[i] == absorbed)) n_dead++;
+    offset[t+1] = n_dead;
+
+    #pragma omp barrier
+    #pragma omp single
     {
-      if (particles.back().fate == escaped) n_escaped++;
-        particles.pop_back();
-        if (particles.size() == 0) break;
+      for (int k=0;k<n_team;k++) tail_offset[k+1] += tail_offset[k];
+      for (int k=0;k<n_team;k++) offset[k+1] += offset[k];
+      tail_live.resize(tail_offset[n_team]);
     }
 
-   // see if we've finished with all particles
-   if (i >= particles.size()) break;
+    // list the live tail particles, last one first
+    int n_tail_live = tail_live.size();
+    int j = tail_offset[t];
+    for (int i=n_alive+lo;i<n_alive+hi;i++)
+      if ((particles.fate[i] != escaped)&&(particles.fate[i] != absorbed))
+        tail_live[n_tail_live - 1 - (j++)] = i;
+    #pragma omp barrier
+
+    // fill the dead slots in order
+    j = offset[t];
+    for (int i=hlo;i<hhi;i++)
+      if ((particles.fate[i] == escaped)||(particles.fate[i] == absorbed))
+        particles.move(i,tail_live[j++]);
+  }
+  particles.resize(n_alive);
 
-   // check if we should remove this particle
-   if (particles[i].fate == escaped) n_escaped++;
-   if ((particles[i].fate == escaped)||(particles[i].fate == absorbed)){
-     particles[i] = particles.back();
-     particles.pop_back();
-   }
-   i = i+1;
- }
   return n_escaped;
 }
 
+//--------------------------------------------------------
+// spread the lowest 21 bits of v out to every third bit,
+// for interleaving three coordinates into a morton code
+//--------------------------------------------------------
+static uint64_t morton_spread(uint64_t v)
+{
+  v &= 0x1fffff;
+  v = (v | (v << 32)) & 0x1f00000000ffffULL;
+  v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+  v = (v | (v <<  8)) & 0x100f00f00f00f00fULL;
+  v = (v | (v <<  4)) & 0x10c30c30c30c30c3ULL;
+  v = (v | (v <<  2)) & 0x1249249249249249ULL;
+  return v;
+}
+
+//--------------------------------------------------------
+// Reorder the particle store so that particles close in
+// space are close in memory, either by zone index (a
+// stable counting sort) or by the morton (z-order) code of
+// the position within the bounding box of all particles.
+// The permutation is done out of place, using
+// particles_census_ as scratch space.
+//--------------------------------------------------------
+void transport::sort_particle_vector()
+{
+  int n = particles.size();
+  if (n < 2) return;
+
+  double tsort = get_system_time();
+
+  // new position of each particle in the store
+  std::vector<int> dest(n);
+
+  if (sort_particles_ == 1)
+  {
+    // zone of each particle, those off the grid go last
+    int nz = grid->n_zones;
+    std::vector<int> key(n);
+    #pragma omp parallel for schedule(static)
+    for (int i=0;i<n;i++)
+    {
+      double x[3] = {particles.x[0][i], particles.x[1][i], particles.x[2][i]};
+      int ind = grid->get_zone(x);
+      key[i] = (ind < 0) ? nz : ind;
+    }
+
+    std::vector<int> start(nz+2,0);
+    for (int i=0;i<n;i++) start[key[i]+1]++;
+    for (int k=0;k<=nz;k++) start[k+1] += start[k];
+    for (int i=0;i<n;i++) dest[i] = start[key[i]]++;
+  }
+  else
+  {
+    // bounding box of the particles
+    double xmin[3], xmax[3];
+    for (int k=0;k<3;k++)
+    {
+      double lo = particles.x[k][0], hi = particles.x[k][0];
+      #pragma omp parallel for schedule(static) reduction(min:lo) reduction(max:hi)
+      for (int i=0;i<n;i++)
+      {
+        if (particles.x[k][i] < lo) lo = particles.x[k][i];
+        if (particles.x[k][i] > hi) hi = particles.x[k][i];
+      }
+      xmin[k] = lo;
+      xmax[k] = hi;
+    }
+
+    // morton code on a 2^21 grid in each dimension,
+    // ties broken by the original index
+    const double n_cell = 2097151.0;
+    std::vector< std::pair<uint64_t,int> > key(n);
+    #pragma omp parallel for schedule(static)
+    for (int i=0;i<n;i++)
+    {
+      uint64_t code = 0;
+      for (int k=0;k<3;k++)
+      {
+        double w = xmax[k] - xmin[k];
+        uint64_t c = 0;
+        if (w > 0) c = (uint64_t)(n_cell*(particles.x[k][i] - xmin[k])/w);
+        code |= morton_spread(c) << k;
+      }
+      key[i] = std::make_pair(code,i);
+    }
+    std::sort(key.begin(),key.end());
+    #pragma omp parallel for schedule(static)
+    for (int j=0;j<n;j++) dest[key[j].second] = j;
+  }
+
+  particles_census_.resize(n);
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<n;i++) particles_census_.copy(dest[i],particles,i);
+  particles.swap(particles_census_);
+  particles_census_.clear();
+
+  double tsort_end = get_system_time();
+  if (verbose)
+    cout << "# Sorted particles       (" << (tsort_end-tsort) << " secs; "
+         << n << " particles by " << (sort_particles_ == 1 ? "zone" : "morton order") << ")\n";
+}
+
 //--------------------------------------------------------
 // Propagate a particle until either the
 // time step ends at a time tstop
 // or the particle escapes or is absorbed.
 // Returns this fate of the particle
 //--------------------------------------------------------
-ParticleFate transport::propagate(particle &p, double dt)
+ParticleFate transport::propagate(particle &p, double dt, RNG_stream &rng, bool locate)
 {
   // To be sure, get initial position of the particle
-  p.ind = grid->get_zone(p.x);
+  if (locate) p.ind = grid->get_zone(p.x);
 
   if (p.ind == -1) {return absorbed;}
   if (p.ind == -2) {return  escaped;}
@@ -211,34 +585,23 @@ ParticleFate transport::propagate(particle &p, double dt)
   double tstop = t_now_ + dt;
 
   ParticleFate  fate = moving;
+  if (use_weight_windows_) fate = apply_weight_window(p,rng);
   while (fate == moving)
   {
     // check if we are in DDMC zone
     // Generalized to be particle- and frequency-dependent
-    int in_ddmc_zone = 0;
+    int in_ddmc = 0;
     if (use_ddmc_)
-    {
-       double sigma_i, dshift, eps_i;
-       int i_nu;
-       dshift = dshift_lab_to_comoving(&p);
-       i_nu = get_opacity(p,dshift,sigma_i,eps_i);
-
-       double dr;
-       grid->get_zone_size(p.ind,&dr);
+      in_ddmc = in_ddmc_zone(p,p.ind,dshift_lab_to_comoving(&p));
 
-       double ztau = sigma_i * dr;
-       if ((ztau > ddmc_tau_) && (p.type == photon)) in_ddmc_zone = 1;
-       //if ((ddmc_use_in_zone_[p.ind]) && (p.type == photon)) in_ddmc_zone = 1;
-    }
-
-    if (in_ddmc_zone)
+    if (in_ddmc)
     {
       if(use_ddmc_ == 1)
-        fate = discrete_diffuse_IMD(p, tstop);
+        fate = discrete_diffuse_IMD(p, tstop, rng);
       else if(use_ddmc_ == 2)
-        fate = discrete_diffuse_DDMC(p, tstop);
+        fate = discrete_diffuse_DDMC(p, tstop, rng);
       else if(use_ddmc_ == 3)
-        fate = discrete_diffuse_RandomWalk(p, tstop);
+        fate = discrete_diffuse_RandomWalk(p, tstop, rng);
       else
       {
          cout << "Invalid diffusion method" << endl;
@@ -246,7 +609,7 @@ ParticleFate transport::propagate(particle &p, double dt)
       }
     }
     else
-      fate = propagate_monte_carlo(p, tstop);
+      fate = propagate_monte_carlo(p, tstop, rng);
   }
 
 return fate;
@@ -257,198 +620,70 @@ return fate;
 // Propagate a single monte carlo particle until
 // it  escapes, is absorbed, or the time step ends
 //--------------------------------------------------------
-ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
+ParticleFate transport::propagate_monte_carlo(particle &p, double tstop, RNG_stream &rng)
 {
-  enum ParticleEvent {scatter, boundary, tstep};
   ParticleEvent event;
 
   ParticleFate  fate = moving;
   while (fate == moving)
   {
-    // set pointer to current zone
-    assert(p.ind >= 0);
-    zone *zone = &(grid->z[p.ind]);
-
     // check if we have moved into a DDMC zone
     // Instead of using ddmc_use_in_zone_[p.ind] as in the gray case,
     // it is generalized to be particle- and frequency-dependent.
     if (use_ddmc_)
     {
-      int i_nu;
-      double dshift = dshift_lab_to_comoving(&p);
-      double sigma_i, dr, eps_i;
-      i_nu = get_opacity(p,dshift,sigma_i,eps_i);
-      grid->get_zone_size(p.ind,&dr);
-      double ztau = sigma_i * dr;
-      //if ((ddmc_use_in_zone_[p.ind]) && (p.type == photon))
-      if ((ztau > ddmc_tau_) && (p.type == photon))
+      if (in_ddmc_zone(p,p.ind,dshift_lab_to_comoving(&p)))
         return moving;
     }
 
-    // get distance and index to the next zone boundary
-    double d_bn = 0;
-    int new_ind = grid->get_next_zone(p.x,p.D,p.ind,r_core_,&d_bn);
+    // find the next event and the distance to it
+    double this_d, dshift, continuum_opac_cmf, eps_absorb_cmf;
+    int new_ind, i_nu;
+    event = get_next_event(p,tstop,this_d,new_ind,i_nu,dshift,
+      continuum_opac_cmf,eps_absorb_cmf,rng);
 
-    // determine the doppler shift from comoving to lab
-    double dshift = dshift_lab_to_comoving(&p);
-
-    // Check whether the neighbor is a DDMC zone
+    // Check whether the neighbor is a DDMC zone; only need its
+    // opacity and size if we may move across the interface
     bool new_cell_ddmc = false;
     double sigma_i, eps_i, dr;
     if (use_ddmc_ && (new_ind >=0))
     {
-       int old_ind = p.ind;
-       p.ind = new_ind;
-       int i_nu = get_opacity(p,dshift,sigma_i,eps_i);
-       grid->get_zone_size(p.ind,&dr);
-       p.ind = old_ind;
-
-       double ztau = sigma_i * dr;
-       if ((ztau > ddmc_tau_) && (p.type == photon)) new_cell_ddmc = true;
-       //if ((ddmc_use_in_zone_[new_ind]) && (p.type == photon)) new_cell_ddmc = true;
-    }
-
-    // get continuum opacity and absorption fraction (epsilon)
-    double continuum_opac_cmf,eps_absorb_cmf;
-    int i_nu = get_opacity(p,dshift,continuum_opac_cmf,eps_absorb_cmf);
-
-    // check for distance to next frequency bin
-    // nushift = nu*(dvds*l)/c --> l = nushift/nu*c/dvds
-    double d_nu = nu_grid_.delta(i_nu)/p.nu*pc::c/p.dvds;
-    if (p.dvds == 0) d_nu = std::numeric_limits<double>::infinity();
-    if (d_nu < 0) d_nu = -1*d_nu;
-    if (d_nu < d_bn)
-    {
-      d_bn = d_nu;
-      new_ind = p.ind;
+      new_cell_ddmc = in_ddmc_zone(p,new_ind,dshift);
+      if (new_cell_ddmc)
+      {
+        int old_ind = p.ind;
+        p.ind = new_ind;
+        get_opacity(p,dshift,sigma_i,eps_i);
+        grid->get_zone_size(p.ind,&dr);
+        p.ind = old_ind;
+      }
     }
 
-    if (d_bn == 0) std::cout << "zerob\n";
-
-    // convert opacity from comoving to lab frame for the purposes of
-    // determining the interaction distance in the lab frame
-    // This corresponds to equation 90.8 in Mihalas&Mihalas. You multiply
-    // the comoving opacity by nu_0 over nu, which is why you
-    // multiply by dshift instead of dividing by dshift here
-    double tot_opac_cmf      = continuum_opac_cmf;
-    double tot_opac_labframe = tot_opac_cmf*dshift;
-
-    // random optical depth to next interaction
-    double tau_r = -1.0*log(1 - rangen.uniform());
-
-    // step size to next interaction event
-    double d_sc  = tau_r/tot_opac_labframe;
-    if (tot_opac_labframe == 0) d_sc = std::numeric_limits<double>::infinity();
-    if (d_sc < 0)
-      cerr << "ERROR: negative interaction distance! " << d_sc << " " << p.nu << " " << dshift << " " <<
-        tot_opac_labframe  << endl;
-    //std::cout << "dists: "<< d_sc << "\t" << d_bn << "\t" << tot_opac_labframe << "\n";
-
-    // find distance to end of time step
-    double d_tm = (tstop - p.t)*pc::c;
-    // if iterative calculation, give infinite time for particle escape
-    if (this->steady_state) d_tm = std::numeric_limits<double>::infinity();
-
-    // find out what event happens (shortest distance)
-    double this_d;
-    if ((d_sc < d_bn)&&(d_sc < d_tm))
-      {event = scatter;    this_d = d_sc;}
-    else if (d_bn < d_tm)
-      {event = boundary;   this_d = d_bn;}
-    else
-      {event = tstep;      this_d = d_tm; }
-
-    // tally in contribution to zone's radiation energy (both *lab* frame)
-    double this_E = p.e*this_d;
-
-    // store absorbed energy in *comoving* frame
-    // (will turn into rate by dividing by dt later)
-    // Extra dshift definitely needed here (two total)
-    // don't add gamma-rays here (they would be separate)
-    if (p.type == photon)
+    // tally radiation quantities and move the particle
+    tally_and_move(p,this_d,i_nu,dshift,continuum_opac_cmf,eps_absorb_cmf);
+    if (implicit_capture_)
     {
-      #pragma omp atomic
-      zone->e_abs  += this_E*dshift*(continuum_opac_cmf)*eps_absorb_cmf*dshift * zone->eps_imc;
-      if (store_Jnu_)
-	     #pragma omp atomic
-	      J_nu_[p.ind][i_nu] += this_E;
-      else
-	     #pragma omp atomic
-	      J_nu_[p.ind][0] += this_E;
+      fate = roulette_captured(p,rng);
+      if (fate != moving) break;
     }
 
-     // tally radiation force
-     // Extra dshift definitely needed here (two total)
-    #pragma omp atomic
-    zone->fx_rad += this_E*dshift*continuum_opac_cmf*p.D[0] * dshift;
-    #pragma omp atomic
-    zone->fy_rad += this_E*dshift*continuum_opac_cmf*p.D[1] * dshift;
-    #pragma omp atomic
-    zone->fz_rad += this_E*dshift*continuum_opac_cmf*p.D[2] * dshift;
-    // radial radiation force
-    double rr = sqrt(p.x[0]*p.x[0] + p.x[1]*p.x[1] + p.x[2]*p.x[2]);
-    double xdotD = p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2];
-    #pragma omp atomic
-    zone->fr_rad += this_E*dshift*continuum_opac_cmf*xdotD/rr * dshift;
-
-    // move particle the distance
-    p.x[0] += this_d*p.D[0];
-    p.x[1] += this_d*p.D[1];
-    p.x[2] += this_d*p.D[2];
-    // advance the time
-    p.t = p.t + this_d/pc::c;
-
     // ---------------------------------
     // do a boundary event
     // ---------------------------------
     if (event == boundary)
     {
-      // inner boundary hit
-      if (new_ind == -1)
+      // check if you are moving into a ddmc zone
+      if (use_ddmc_ && new_cell_ddmc && (new_ind != p.ind))
       {
-        if (boundary_in_reflect_)
-        {
-          // flip direction
-          p.D[0] *= -1;
-          p.D[1] *= -1;
-          p.D[2] *= -1;
-        }
-        else
-        {
-          p.ind = new_ind;
-          fate = absorbed;
-        }
+        int convert_to_ddmc = move_across_DDMC_interface(p,new_ind,sigma_i,dr,rng);
+        if (convert_to_ddmc) return moving;
       }
-      // outer boundary hit
-      else if (new_ind == -2)
-      {
-        if (boundary_out_reflect_)
-        {
-          // flip direction
-          p.D[0] *= -1;
-          p.D[1] *= -1;
-          p.D[2] *= -1;
-        }
-        else
-        {
-          p.ind = new_ind;
-          fate = escaped;
-        }
-      }
-      // otherwise move to the next zone
       else
       {
-        // check if you are moving into a ddmc zone
-        if (use_ddmc_ && new_cell_ddmc && (new_ind != p.ind))
-        {
-          int convert_to_ddmc = move_across_DDMC_interface(p,new_ind,sigma_i,dr);
-          if (convert_to_ddmc) return moving;
-        }
-        else
-        {
-          // if it is not moving to ddmc zone, just update zone index
-          p.ind = new_ind;
-        }
+        int old_ind = p.ind;
+        fate = cross_boundary(p,new_ind);
+        if ((use_weight_windows_)&&(fate == moving)&&(p.ind != old_ind))
+          fate = apply_weight_window(p,rng);
       }
     }
 
@@ -457,18 +692,7 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
     // ---------------------------------
     else if (event == scatter)
     {
-       //eps_absorb_cmf = 0;
-
-      if (fate == moving)
-      {
- //        fate = do_scatter(&p,eps_absorb_cmf);
-   //     if (rangen.uniform() > 0.38)
-    //    fate = absorbed;
-        //else fate = do_scatter(&p,0);
-         // debug
-        fate = do_scatter(&p,eps_absorb_cmf);
-        //if (p.nu*pc::h < pc::rydberg) fate = escaped;
-       }
+      fate = do_scatter(&p,eps_absorb_cmf,rng);
     }
 
     // ---------------------------------
@@ -483,6 +707,201 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
   return fate;
 }
 
+
+//--------------------------------------------------------
+// Find the next event (scatter, zone/frequency bin
+// boundary, or end of time step) of a particle that is
+// not in a DDMC zone. Returns the event type and sets the
+// distance to it, the index of the next zone, and the
+// comoving opacity quantities used to tally the segment
+//--------------------------------------------------------
+transport::ParticleEvent transport::get_next_event(particle &p, double tstop,
+  double &this_d, int &new_ind, int &i_nu, double &dshift, double &opac, double &eps,
+  RNG_stream &rng)
+{
+  assert(p.ind >= 0);
+
+  // get distance and index to the next zone boundary
+  double d_bn = 0;
+  new_ind = grid->get_next_zone(p.x,p.D,p.ind,r_core_,&d_bn);
+
+  // determine the doppler shift from comoving to lab
+  dshift = dshift_lab_to_comoving(&p);
+
+  // get continuum opacity and absorption fraction (epsilon)
+  i_nu = get_opacity(p,dshift,opac,eps);
+
+  // check for distance to next frequency bin
+  // nushift = nu*(dvds*l)/c --> l = nushift/nu*c/dvds
+  double d_nu = nu_grid_.delta(i_nu)/p.nu*pc::c/p.dvds;
+  if (p.dvds == 0) d_nu = std::numeric_limits<double>::infinity();
+  if (d_nu < 0) d_nu = -1*d_nu;
+  if (d_nu < d_bn)
+  {
+    d_bn = d_nu;
+    new_ind = p.ind;
+  }
+
+  if (d_bn == 0) std::cout << "zerob\n";
+
+  // convert opacity from comoving to lab frame for the purposes of
+  // determining the interaction distance in the lab frame
+  // This corresponds to equation 90.8 in Mihalas&Mihalas. You multiply
+  // the comoving opacity by nu_0 over nu, which is why you
+  // multiply by dshift instead of dividing by dshift here
+  double tot_opac_cmf      = opac;
+  // with implicit capture, absorption is continuous along the
+  // path and only the scatterings are sampled as events
+  if ((implicit_capture_)&&(p.type == photon))
+    tot_opac_cmf = opac*(1 - capture_fraction(p.ind,eps));
+  double tot_opac_labframe = tot_opac_cmf*dshift;
+
+  // random optical depth to next interaction
+  double tau_r = -1.0*log(1 - rng.uniform());
+
+  // step size to next interaction event
+  double d_sc  = tau_r/tot_opac_labframe;
+  if (tot_opac_labframe == 0) d_sc = std::numeric_limits<double>::infinity();
+  if (d_sc < 0)
+    cerr << "ERROR: negative interaction distance! " << d_sc << " " << p.nu << " " << dshift << " " <<
+      tot_opac_labframe  << endl;
+
+  // find distance to end of time step
+  double d_tm = (tstop - p.t)*pc::c;
+  // if iterative calculation, give infinite time for particle escape
+  if (this->steady_state) d_tm = std::numeric_limits<double>::infinity();
+
+  // find out what event happens (shortest distance)
+  if ((d_sc < d_bn)&&(d_sc < d_tm))
+    {this_d = d_sc; return scatter;}
+  else if (d_bn < d_tm)
+    {this_d = d_bn; return boundary;}
+  else
+    {this_d = d_tm; return tstep;}
+}
+
+
+//--------------------------------------------------------
+// Tally the contribution of a flight segment of length
+// this_d to the zone radiation quantities, then move
+// the particle along the segment
+//--------------------------------------------------------
+void transport::tally_and_move(particle &p, double this_d, int i_nu,
+  double dshift, double continuum_opac_cmf, double eps_absorb_cmf)
+{
+  zone *zone = &(grid->z[p.ind]);
+
+  // tally in contribution to zone's radiation energy (both *lab* frame)
+  double this_E = p.e*this_d;
+
+  // with implicit capture, the packet energy decays by the
+  // absorptive optical depth of the segment, and the tallies
+  // take its mean energy along the segment
+  double decay = 1;
+  if ((implicit_capture_)&&(p.type == photon))
+  {
+    double tau_abs = this_d*dshift*continuum_opac_cmf*capture_fraction(p.ind,eps_absorb_cmf);
+    if (tau_abs > 0)
+    {
+      decay = exp(-tau_abs);
+      if (tau_abs > 1e-6) this_E *= (1 - decay)/tau_abs;
+      else this_E *= 1 - 0.5*tau_abs;
+    }
+  }
+
+  // store absorbed energy in *comoving* frame
+  // (will turn into rate by dividing by dt later)
+  // Extra dshift definitely needed here (two total)
+  // don't add gamma-rays here (they would be separate)
+  if (p.type == photon)
+  {
+    tally_.add(radiation_tally::e_abs, p.ind,
+      this_E*dshift*(continuum_opac_cmf)*eps_absorb_cmf*dshift * zone->eps_imc);
+    if (store_Jnu_)
+      tally_.add_J_nu(p.ind,i_nu,this_E);
+    else
+      tally_.add_J_nu(p.ind,0,this_E);
+  }
+
+   // tally radiation force
+   // Extra dshift definitely needed here (two total)
+  tally_.add(radiation_tally::fx_rad, p.ind, this_E*dshift*continuum_opac_cmf*p.D[0] * dshift);
+  tally_.add(radiation_tally::fy_rad, p.ind, this_E*dshift*continuum_opac_cmf*p.D[1] * dshift);
+  tally_.add(radiation_tally::fz_rad, p.ind, this_E*dshift*continuum_opac_cmf*p.D[2] * dshift);
+  // radial radiation force
+  double rr = sqrt(p.x[0]*p.x[0] + p.x[1]*p.x[1] + p.x[2]*p.x[2]);
+  double xdotD = p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2];
+  tally_.add(radiation_tally::fr_rad, p.ind, this_E*dshift*continuum_opac_cmf*xdotD/rr * dshift);
+
+  // move particle the distance
+  p.x[0] += this_d*p.D[0];
+  p.x[1] += this_d*p.D[1];
+  p.x[2] += this_d*p.D[2];
+  // advance the time
+  p.t = p.t + this_d/pc::c;
+  p.e *= decay;
+}
+
+
+//--------------------------------------------------------
+// With implicit capture, russian roulette a photon packet
+// whose energy has decayed below the floor: it survives
+// with probability e/e_floor, carrying e_floor
+//--------------------------------------------------------
+ParticleFate transport::roulette_captured(particle &p, RNG_stream &rng)
+{
+  if ((p.type != photon)||(p.e >= implicit_capture_e_floor_)) return moving;
+  if (rng.uniform()*implicit_capture_e_floor_ < p.e)
+  {
+    p.e = implicit_capture_e_floor_;
+    return moving;
+  }
+  p.e = 0;
+  return absorbed;
+}
+
+
+//--------------------------------------------------------
+// Move a particle across a zone (or frequency bin)
+// boundary into zone new_ind, handling the inner
+// and outer edges of the grid. Returns the new fate
+//--------------------------------------------------------
+ParticleFate transport::cross_boundary(particle &p, int new_ind)
+{
+  // inner boundary hit
+  if (new_ind == -1)
+  {
+    if (boundary_in_reflect_)
+    {
+      // flip direction
+      p.D[0] *= -1;
+      p.D[1] *= -1;
+      p.D[2] *= -1;
+      return moving;
+    }
+    p.ind = new_ind;
+    return absorbed;
+  }
+  // outer boundary hit
+  if (new_ind == -2)
+  {
+    if (boundary_out_reflect_)
+    {
+      // flip direction
+      p.D[0] *= -1;
+      p.D[1] *= -1;
+      p.D[2] *= -1;
+      return moving;
+    }
+    p.ind = new_ind;
+    return escaped;
+  }
+
+  // otherwise move to the next zone
+  p.ind = new_ind;
+  return moving;
+}
+
 transport::~transport() {
   if (src_MPI_block)
     delete[] src_MPI_block;
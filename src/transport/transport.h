@@ -7,11 +7,18 @@
 #include <string>
 
 #include "particle.h"
+#include "particle_store.h"
+#include "aligned_allocator.h"
 #include "grid_general.h"
 #include "cdf_array.h"
+#include "compton_tables.h"
+#include "lte_opacity_table.h"
+#include "sobol_sequence.h"
+#include "opacity_table.h"
 #include "locate_array.h"
 #include "thread_RNG.h"
 #include "spectrum_array.h"
+#include "radiation_tally.h"
 #include "GasState.h"
 #include "ParameterReader.h"
 #include "VoigtProfile.h"
@@ -42,16 +49,56 @@ using std::vector;
 
 
 
+//-------------------------------------------------
+// number and energy of the particles of each fate,
+// counted when the particle store is cleaned up
+//-------------------------------------------------
+struct ParticleCensus
+{
+  int n_alive, n_escaped, n_absorbed;
+  double e_escaped, e_absorbed;
+};
+
+//-------------------------------------------------
+// splitting and russian roulette done by the weight
+// windows of one thread during a step; each thread's
+// counts fill whole cache lines of their own
+//-------------------------------------------------
+struct alignas(ALIGNED_ALLOCATOR_ALIGN) WeightWindowCounts
+{
+  long n_split, n_copies, n_roulette, n_survived;
+  double e_split_in, e_split_out;     // energy before and after splitting
+  double e_roulette_in, e_roulette_out; // energy before and after roulette
+  double e_roulette_var;                // variance of the energy after roulette
+};
+
+//-------------------------------------------------
+// state of a zone when its opacities were last
+// calculated, to decide whether they can be reused
+//-------------------------------------------------
+struct OpacityCacheKey
+{
+  double rho, T_gas, time;
+  double J_int, J_nu_mean;   // integral and mean frequency of J_nu
+  vector<double> X;          // decayed mass fractions
+  double rho_table;          // density the stored opacities are scaled to
+};
+
+
 class transport
 {
 
  private:
 
   // arrays of particles
-  std::vector<particle> particles;
-  std::vector<particle> particles_new; // For debugging checkpointing
-  std::vector<particle> particles_escaped;
-  std::vector<particle> particles_escaped_new;
+  ParticleStore particles;
+  ParticleStore particles_new; // For debugging checkpointing
+  ParticleStore particles_escaped;
+  ParticleStore particles_escaped_new;
+  ParticleStore particles_census_;    // scratch space for order-preserving census and sorting
+  ParticleCensus census_;
+  int census_preserve_order_;
+  int sort_particles_;                // 0 = no sorting, 1 = by zone, 2 = by morton order
   int max_total_particles;
 
   // gas class for opacities
@@ -67,6 +114,15 @@ class transport
   int save_escaped_particles_;
   double maxn_escaped_particles_;
 
+  // per-thread lists of particles escaped during a step
+  vector<ParticleStore> escape_buffers_;
+  // stream escaped particles to an hdf5 file in chunks
+  int stream_escaped_particles_;
+  int escaped_stream_chunk_;
+  int escaped_stream_created_;
+  long long escaped_stream_length_;   // particles written to the stream file
+  std::string escaped_stream_file_;
+
   // MPI stuff
   int MPI_nprocs;
   int MPI_myID;
@@ -94,6 +150,7 @@ class transport
   int    solve_Tgas_with_updated_opacities_;
   int    set_Tgas_to_Trad_;
   int    fix_Tgas_during_transport_;
+  int    use_event_transport_;
 
   int use_nlte_;
 
@@ -116,10 +173,54 @@ class transport
   cdf_array<double> pointsource_emission_spectrum_;
   double pointsources_L_tot_;
 
-
-  // For sampling Maxwell-Boltzmann distribution for Compton scatterirng
-  cdf_array<double> mb_cdf_;
-  double mb_dv;
+  // quasi-random emission: the zone, time, position, direction
+  // and frequency of emitted particles from a scrambled sobol
+  // sequence instead of random numbers
+  int qmc_emission_;
+  sobol_sequence sobol_;
+  // stratified emission: each zone emits its expected number
+  // of particles, rounded up or down at random
+  int stratify_emission_zones_;
+
+  // importance-based splitting and russian roulette of photon
+  // packets: each zone has a target packet energy, e_ref over
+  // the zone importance, and packets entering it are split or
+  // rouletted to within a factor width of that target
+  int    use_weight_windows_;
+  double weight_window_width_;
+  int    weight_window_max_split_;
+  double importance_min_;
+  double weight_window_e_ref_;
+  vector<double> importance_;
+  vector<ParticleStore> split_buffers_;       // per-thread lists of split copies
+  vector<WeightWindowCounts, aligned_allocator<WeightWindowCounts> > weight_window_counts_;  // per thread
+  int n_split_pending_;
+
+  // implicit capture: photon packets lose energy continuously
+  // to absorption instead of being destroyed at interactions,
+  // and are rouletted once below a floor energy
+  int    implicit_capture_;
+  double implicit_capture_floor_;     // floor, relative to the mean packet energy
+  double implicit_capture_e_floor_;   // floor energy this step
+
+  // reuse of the opacities of zones whose state has changed
+  // by less than a tolerance since they were last calculated
+  double opacity_cache_tolerance_;
+  vector<OpacityCacheKey> opacity_cache_;
+  vector<char> opacity_cache_hit_;
+  double opacity_cache_zone_time_;    // time to calculate one zone
+  long   opacity_cache_n_hits_, opacity_cache_n_zones_;
+
+  // number of zones whose opacities are calculated together
+  int opacity_batch_size_;
+
+  // LTE opacities interpolated from a table
+  int use_lte_table_;
+  lte_opacity_table lte_table_;
+
+  // For sampling Compton scattering angles and the Maxwell-Boltzmann
+  // distribution of the scattering electrons
+  compton_tables compton_tables_;
 
   // minimum and maximum temperatures
   double temp_max_value_, temp_min_value_;
@@ -153,11 +254,11 @@ class transport
 
   // the zone opacity/emissivity variables
   vector< cdf_array<OpacityType> >    emissivity_;
-  vector< vector<OpacityType> >       abs_opacity_;
-  vector< vector<OpacityType> >       scat_opacity_;
+  opacity_table<OpacityType>          opacity_table_;
   vector<OpacityType> planck_mean_opacity_;
   vector<OpacityType> rosseland_mean_opacity_;
   vector< vector<real> > J_nu_;
+  radiation_tally tally_;
   vector<real> compton_opac;
   vector<real> photoion_opac;
 
@@ -176,6 +277,9 @@ class transport
   vector<real> ddmc_use_in_zone_;
   int use_ddmc_;
   double ddmc_tau_;
+  // whether photons in each zone and comoving frequency bin
+  // are above the ddmc threshold, indexed [zone*n_nu + i_nu]
+  vector<char> ddmc_mask_;
   locate_array randomwalk_x;
   vector<double> randomwalk_Pescape;
 
@@ -193,9 +297,14 @@ class transport
   // opacity functions
   int   get_opacity(particle&, double, double&, double&);
   void   set_opacity(double dt);
+  void   store_zone_opacity(GasState*, const int, vector<OpacityType>&,
+           vector<OpacityType>&, vector<OpacityType>&);
   double klein_nishina(double);
   double blackbody_nu(double T, double nu);
   void   reduce_opacities();
+  int    check_opacity_cache();
+  void   rescale_cached_opacity(int i);
+  void   reduce_changed_opacities();
 
   // creation of particles functions
   void   emit_particles(double dt);
@@ -204,9 +313,12 @@ class transport
   void   emit_thermal(double dt);
   void   emit_heating_source(double dt);
   void   emit_from_pointsoures(double dt);
-  void   create_isotropic_particle(int,PType,double,double);
+  void   create_isotropic_particle(int,int,PType,double,double,RNG_stream&,const double *u = NULL);
+  int    add_particle_slots(const int n_emit);
   void   initialize_particles(int);
-  void sample_photon_frequency(particle*);
+  void sample_photon_frequency(particle*, RNG_stream&, const double *u = NULL);
+  void   scramble_emission_points();
+  void   stratify_emission_zones(const int n_emit, std::vector<int> &start);
 
   // special relativistic functions
   void   transform_comoving_to_lab(particle*);
@@ -217,26 +329,49 @@ class transport
   double do_dshift(particle*, int);
 
   // sampling Maxwell-Boltzmann distribution for Compton scatterirng
-  void setup_MB_cdf(double, double, int);
-  void sample_MB_vector(double, double*, double*);
+  void sample_MB_vector(double, double*, double*, RNG_stream&);
 
   //propagation of particles functions
-  ParticleFate propagate(particle &p, double tstop);
-  ParticleFate propagate_monte_carlo(particle &p, double dt);
-  ParticleFate discrete_diffuse_IMD(particle &p, double tstop);
-  ParticleFate discrete_diffuse_DDMC(particle &p, double tstop);
-  ParticleFate discrete_diffuse_RandomWalk(particle &p, double tstop);
-  int move_across_DDMC_interface(particle &p, int, double, double);
+  enum ParticleEvent {scatter, boundary, tstep};
+  ParticleFate propagate(particle &p, double tstop, RNG_stream &rng, bool locate = true);
+  ParticleFate propagate_monte_carlo(particle &p, double dt, RNG_stream &rng);
+  ParticleEvent get_next_event(particle &p, double tstop, double &this_d,
+    int &new_ind, int &i_nu, double &dshift, double &opac, double &eps, RNG_stream &rng);
+  void tally_and_move(particle &p, double this_d, int i_nu,
+    double dshift, double opac, double eps);
+  ParticleFate roulette_captured(particle &p, RNG_stream &rng);
+  double mean_particle_energy();
+
+  // fraction of the continuum opacity that destroys photons,
+  // i.e. absorption not followed by re-emission
+  double capture_fraction(const int i, const double eps) const
+    {return radiative_eq ? 0 : eps*grid->z[i].eps_imc; }
+  ParticleFate cross_boundary(particle &p, int new_ind);
+  void propagate_event_based(double dt);
+  void set_weight_windows();
+  ParticleFate apply_weight_window(particle &p, RNG_stream &rng);
+  void propagate_split_particles(double dt);
+  void record_escaped_particle(particle &p);
+  void gather_escaped_particles();
+  void append_escaped_stream(ParticleStore& particle_list);
+  void flush_escaped_stream();
+  void restart_escaped_stream(std::string fname);
+  ParticleFate discrete_diffuse_IMD(particle &p, double tstop, RNG_stream &rng);
+  ParticleFate discrete_diffuse_DDMC(particle &p, double tstop, RNG_stream &rng);
+  ParticleFate discrete_diffuse_RandomWalk(particle &p, double tstop, RNG_stream &rng);
+  int move_across_DDMC_interface(particle &p, int, double, double, RNG_stream &rng);
   void setup_RandomWalk();
   void compute_diffusion_probabilities(double dt);
-  void sample_dir_from_blackbody_surface(particle*);
+  bool in_ddmc_zone(particle &p, const int ind, const double dshift);
+  void sample_dir_from_blackbody_surface(particle*, RNG_stream&);
   int clean_up_particle_vector();
+  void sort_particle_vector();
 
   // scattering functions
-  ParticleFate do_scatter(particle*, double);
-  void compton_scatter(particle*);
-  void compton_scatter_photon(particle*);
-  void isotropic_scatter(particle*, int);
+  ParticleFate do_scatter(particle*, double, RNG_stream&);
+  void compton_scatter(particle*, RNG_stream&);
+  void compton_scatter_photon(particle*, RNG_stream&);
+  void isotropic_scatter(particle*, int, RNG_stream&);
 
   // radiation quantities functions
   void wipe_radiation();
@@ -298,19 +433,19 @@ class transport
   void clearEscapedParticles();
 
   void writeCheckpointParticlesAll(std::string fname);
-  void writeCheckpointParticles(std::vector<particle>& particle_list,
+  void writeCheckpointParticles(ParticleStore& particle_list,
       std::string fname, std::string groupname);
   void writeParticleProp(std::string fname, std::string fieldname,
-      std::string groupname, std::vector<particle>& particle_list,
-      int total_particles, int offset);
+      std::string groupname, ParticleStore& particle_list,
+      int total_particles, int offset, bool append=false);
   void writeCheckpointSpectra(std::string fname);
   void writeCheckpointRNG(std::string fname);
 
-  void readCheckpointParticles(std::vector<particle>& particle_list, 
+  void readCheckpointParticles(ParticleStore& particle_list, 
       std::string fname, std::string groupname, bool test=false,
       bool all_one_rank=false);
   void readParticleProp(std::string fname, std::string fieldname,
-      std::string groupname, std::vector<particle>& particle_list,
+      std::string groupname, ParticleStore& particle_list,
       int total_particles, int offset);
   void readCheckpointSpectra(std::string fname, bool test=false);
   void readCheckpointRNG(std::string fname, bool test=false);
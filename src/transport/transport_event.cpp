@@ -0,0 +1,155 @@
+//------------------------------------------------------------
+// transport_event.cpp
+// This file contains the event-based (batched) propagation
+// of monte carlo particles. Instead of following one history
+// at a time, all live particles are advanced together in
+// phases: find the next event of every particle, then process
+// all boundary crossings, then all scatterings, then a census
+// of which particles are still moving.
+//------------------------------------------------------------
+
+#include <math.h>
+#include <cassert>
+#include "transport.h"
+#include "physical_constants.h"
+
+namespace pc = physical_constants;
+
+
+//------------------------------------------------------------
+// Propagate all particles in the particle store until they
+// escape, are absorbed, or the time step ends. Sets the fate
+// of each particle; escaped particles are tallied by the caller
+//------------------------------------------------------------
+void transport::propagate_event_based(double dt)
+{
+  // time of end of timestep
+  double tstop = t_now_ + dt;
+
+  int n_particles = particles.size();
+
+  // ---------------------------------
+  // locate all particles on the grid
+  // ---------------------------------
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<n_particles;i++)
+  {
+    double x[3] = {particles.x[0][i],particles.x[1][i],particles.x[2][i]};
+    int ind = grid->get_zone(x);
+    particles.ind[i] = ind;
+    if      (ind == -1) particles.fate[i] = absorbed;
+    else if (ind == -2) particles.fate[i] = escaped;
+    else                particles.fate[i] = moving;
+  }
+
+  // split or roulette packets outside the weight windows
+  if (use_weight_windows_)
+  {
+    #pragma omp parallel for schedule(static)
+    for (int i=0;i<n_particles;i++)
+    {
+      if (particles.fate[i] != moving) continue;
+      particle p = particles.get(i);
+      RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+      p.fate = apply_weight_window(p,rng);
+      p.rng_count = rng.count();
+      particles.set(i,p);
+    }
+  }
+
+  // list of store indices of the particles still moving
+  std::vector<int> active, still_active;
+  active.reserve(n_particles);
+  for (int i=0;i<n_particles;i++)
+    if (particles.fate[i] == moving) active.push_back(i);
+
+  // event data for each active particle
+  std::vector<ParticleEvent> event;
+  std::vector<int>    new_ind;
+  std::vector<double> eps_absorb;
+  // positions (in the active list) of each kind of event
+  std::vector<int> boundary_list, scatter_list;
+
+  while (!active.empty())
+  {
+    int n_active = active.size();
+    event.resize(n_active);
+    new_ind.resize(n_active);
+    eps_absorb.resize(n_active);
+
+    // ---------------------------------
+    // find the next event of every particle,
+    // tally and move along the flight segment
+    // ---------------------------------
+    #pragma omp parallel for schedule(guided)
+    for (int k=0;k<n_active;k++)
+    {
+      int i = active[k];
+      particle p = particles.get(i);
+      RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+      double this_d, dshift, opac;
+      int i_nu;
+      event[k] = get_next_event(p,tstop,this_d,new_ind[k],i_nu,dshift,opac,eps_absorb[k],rng);
+      tally_and_move(p,this_d,i_nu,dshift,opac,eps_absorb[k]);
+      if (implicit_capture_) p.fate = roulette_captured(p,rng);
+      p.rng_count = rng.count();
+      particles.set(i,p);
+    }
+
+    // sort the events into batches
+    boundary_list.clear();
+    scatter_list.clear();
+    for (int k=0;k<n_active;k++)
+    {
+      if      (particles.fate[active[k]] != moving) continue;
+      else if (event[k] == boundary) boundary_list.push_back(k);
+      else if (event[k] == scatter)  scatter_list.push_back(k);
+      else    particles.fate[active[k]] = stopped;
+    }
+
+    // ---------------------------------
+    // process all boundary events
+    // ---------------------------------
+    int n_boundary = boundary_list.size();
+    #pragma omp parallel for schedule(static)
+    for (int j=0;j<n_boundary;j++)
+    {
+      int k = boundary_list[j];
+      int i = active[k];
+      particle p = particles.get(i);
+      int old_ind = p.ind;
+      p.fate = cross_boundary(p,new_ind[k]);
+      if ((use_weight_windows_)&&(p.fate == moving)&&(p.ind != old_ind))
+      {
+        RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+        p.fate = apply_weight_window(p,rng);
+        p.rng_count = rng.count();
+      }
+      particles.set(i,p);
+    }
+
+    // ---------------------------------
+    // process all scattering events
+    // ---------------------------------
+    int n_scatter = scatter_list.size();
+    #pragma omp parallel for schedule(guided)
+    for (int j=0;j<n_scatter;j++)
+    {
+      int k = scatter_list[j];
+      int i = active[k];
+      particle p = particles.get(i);
+      RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+      p.fate = do_scatter(&p,eps_absorb[k],rng);
+      p.rng_count = rng.count();
+      particles.set(i,p);
+    }
+
+    // ---------------------------------
+    // census: keep only moving particles
+    // ---------------------------------
+    still_active.clear();
+    for (int k=0;k<n_active;k++)
+      if (particles.fate[active[k]] == moving) still_active.push_back(active[k]);
+    active.swap(still_active);
+  }
+}
@@ -96,6 +96,33 @@ void transport::init(ParameterReader* par, grid_general *g)
 
   // read relevant parameters
   max_total_particles = params_->getScalar<int>("particles_max_total");
+  census_preserve_order_ = params_->getScalar<int>("transport_census_preserve_order");
+  std::string sort_mode = params_->getScalar<string>("transport_sort_particles");
+  if      (sort_mode == "none")   sort_particles_ = 0;
+  else if (sort_mode == "zone")   sort_particles_ = 1;
+  else if (sort_mode == "morton") sort_particles_ = 2;
+  else
+  {
+    if (verbose) cerr << "# ERROR: unknown transport_sort_particles " << sort_mode << "\n";
+    exit(1);
+  }
+  std::string sampling = params_->getScalar<string>("particles_emission_sampling");
+  if      (sampling == "random") qmc_emission_ = 0;
+  else if (sampling == "sobol")  qmc_emission_ = 1;
+  else
+  {
+    if (verbose) cerr << "# ERROR: unknown particles_emission_sampling " << sampling << "\n";
+    exit(1);
+  }
+  if (qmc_emission_) sobol_.init(sobol_sequence::max_dims);
+  std::string zone_sampling = params_->getScalar<string>("particles_zone_sampling");
+  if      (zone_sampling == "random")     stratify_emission_zones_ = 0;
+  else if (zone_sampling == "stratified") stratify_emission_zones_ = 1;
+  else
+  {
+    if (verbose) cerr << "# ERROR: unknown particles_zone_sampling " << zone_sampling << "\n";
+    exit(1);
+  }
   radiative_eq    = params_->getScalar<int>("transport_radiative_equilibrium");
   steady_state    = (params_->getScalar<int>("transport_steady_iterate") > 0);
   temp_max_value_ = params_->getScalar<double>("limits_temp_max");
@@ -178,6 +205,49 @@ void transport::init(ParameterReader* par, grid_general *g)
   else
     save_escaped_particles_ = 1;
   maxn_escaped_particles_ = params_->getScalar<double>("spectrum_particle_list_maxn");
+
+  // each thread collects its escaped particles separately
+  int n_threads = 1;
+#ifdef _OPENMP
+  n_threads = omp_get_max_threads();
+#endif
+  escape_buffers_.resize(n_threads);
+
+  // importance-based splitting and russian roulette
+  use_weight_windows_ = params_->getScalar<int>("transport_weight_windows");
+  weight_window_width_ = params_->getScalar<double>("transport_weight_window_width");
+  weight_window_max_split_ = params_->getScalar<int>("transport_weight_window_max_split");
+  importance_min_ = params_->getScalar<double>("transport_importance_min");
+  if ((use_weight_windows_)&&((weight_window_width_ <= 1)||(weight_window_max_split_ < 2)
+    ||(importance_min_ <= 0)||(importance_min_ > 1)))
+  {
+    if (verbose) cerr << "# ERROR: need transport_weight_window_width > 1, "
+      << "transport_weight_window_max_split >= 2 and 0 < transport_importance_min <= 1\n";
+    exit(1);
+  }
+  weight_window_e_ref_ = 0;
+  n_split_pending_ = 0;
+  split_buffers_.resize(n_threads);
+  weight_window_counts_.resize(n_threads);
+
+  // implicit capture of photons; packets then escape with reduced
+  // energy, so core_fix_luminosity rescales by escaped energy, not count
+  implicit_capture_ = params_->getScalar<int>("transport_implicit_capture");
+  implicit_capture_floor_ = params_->getScalar<double>("transport_implicit_capture_floor");
+  implicit_capture_e_floor_ = 0;
+
+  // escaped particles streamed to one file per rank
+  stream_escaped_particles_ = params_->getScalar<int>("spectrum_particle_list_stream");
+  escaped_stream_chunk_ = params_->getScalar<int>("spectrum_particle_list_chunk");
+  if (escaped_stream_chunk_ < 1) escaped_stream_chunk_ = 1;
+  std::stringstream stream_name;
+  stream_name << escaped_particle_filename_ << "_stream_rank" << MPI_myID << ".h5";
+  escaped_stream_file_ = stream_name.str();
+  escaped_stream_created_ = 0;
+  escaped_stream_length_ = 0;
+  if ((save_escaped_particles_)&&(stream_escaped_particles_)&&(verbose))
+    std::cout << "# Streaming escaped particles to " << escaped_particle_filename_
+      << "_stream_rank*.h5 in chunks of " << escaped_stream_chunk_ << "\n";
   
   // check if atomfile is there
   atomdata_file_ = params_->getScalar<string>("data_atomic_file");
@@ -246,6 +316,26 @@ void transport::init(ParameterReader* par, grid_general *g)
        n_fuzzlines << " lines used\n";
   if (verbose) gas_state_vec_[0].print_properties();
 
+  // LTE opacities from a table made with snopac
+  std::string lte_table_file = params_->getScalar<string>("opacity_table_file");
+  use_lte_table_ = (lte_table_file != "");
+  if (use_lte_table_)
+  {
+    if ((use_nlte_)||(solve_Tgas_with_updated_opacities_))
+    {
+      if (verbose) cerr << "# ERROR: opacity_table_file can't be used with NLTE or transport_solve_Tgas_with_updated_opacities\n";
+      exit(1);
+    }
+    lte_table_.read(lte_table_file,nu_grid_);
+    if (lte_table_.n_groups() == 0)
+    {
+      if (verbose) cerr << "# ERROR: no opacities in opacity table file " << lte_table_file << "\n";
+      exit(1);
+    }
+    if (verbose) std::cout << "# Using LTE opacity table " << lte_table_file << " ("
+      << lte_table_.n_groups() << " compositions, " << lte_table_.memory_bytes() << " bytes)\n";
+  }
+
   maximum_opacity_ = params_->getScalar<double>("opacity_maximum_opacity");
   // define it as the first step, for NLTE
   first_step_ = 1;
@@ -276,33 +366,24 @@ void transport::init(ParameterReader* par, grid_general *g)
   }
 
   rosseland_mean_opacity_.resize(grid->n_zones);
+  importance_.resize(grid->n_zones,1.0);
   n_grid_variables += 2;
 
-  abs_opacity_.resize(grid->n_zones);
-  if (!omit_scattering_) scat_opacity_.resize(grid->n_zones);
   emissivity_.resize(grid->n_zones);
   J_nu_.resize(grid->n_zones);
   n_freq_variables += 2;
   if (!omit_scattering_) n_freq_variables +=1;
   if (store_Jnu_) n_freq_variables += 1;
 
+  // allocate absorptive and scattering opacity
+  int interleave_opacity = params_->getScalar<int>("opacity_interleave_tables");
+  try {
+    opacity_table_.init(grid->n_zones,nu_grid_.size(),!omit_scattering_,interleave_opacity); }
+  catch (std::bad_alloc const&) {
+    cerr << "Memory allocation fail!" << std::endl; }
+
   for (int i=0; i<grid->n_zones;  i++)
   {
-    // allocate absorptive opacity
-    try {
-      abs_opacity_[i].resize(nu_grid_.size()); }
-    catch (std::bad_alloc const&) {
-      cerr << "Memory allocation fail!" << std::endl; }
-
-    // allocate scattering opacity
-    if (!omit_scattering_)
-    {
-        try {
-            scat_opacity_[i].resize(nu_grid_.size()); }
-        catch (std::bad_alloc const&) {
-            cerr << "Memory allocation fail!" << std::endl; }
-    }
-
     // allocate emissivity
     emissivity_[i].resize(nu_grid_.size());
 
@@ -314,10 +395,41 @@ void transport::init(ParameterReader* par, grid_general *g)
     else
       J_nu_[i].resize(1);
   }
+
+  // set up tallies of the radiation quantities
+  std::string tally_mode = params_->getScalar<string>("transport_tally_mode");
+  int use_private_tallies = 0;
+  if (tally_mode == "private")
+    use_private_tallies = 1;
+  else if (tally_mode != "atomic")
+  {
+    if (verbose) cerr << "# ERROR: unknown transport_tally_mode " << tally_mode << "\n";
+    exit(1);
+  }
+  int tally_stats = params_->getScalar<int>("transport_tally_stats");
+  tally_.init(grid,&J_nu_,use_private_tallies,tally_stats);
+  if (verbose) std::cout << "# Using " << tally_mode << " radiation tallies ("
+    << tally_.memory_bytes() << " bytes of thread buffers)\n";
   compton_opac.resize(grid->n_zones);
   photoion_opac.resize(grid->n_zones);
   n_grid_variables += 2;
 
+  // zones calculated together in set_opacity
+  opacity_batch_size_ = params_->getScalar<int>("opacity_batch_size");
+  if (opacity_batch_size_ < 1) opacity_batch_size_ = 1;
+
+  // reuse of opacities between steps
+  opacity_cache_tolerance_ = params_->getScalar<double>("opacity_cache_tolerance");
+  opacity_cache_zone_time_ = 0;
+  opacity_cache_n_hits_  = 0;
+  opacity_cache_n_zones_ = 0;
+  if (opacity_cache_tolerance_ > 0)
+  {
+    opacity_cache_.resize(grid->n_zones);
+    for (int i=0;i<grid->n_zones;i++) opacity_cache_[i].X.assign(grid->n_elems,0);
+    opacity_cache_hit_.assign(grid->n_zones,0);
+  }
+
   // setup emissivity weight  -- debug
   emissivity_weight_.resize(nu_grid_.size());
   double norm = 0;
@@ -344,6 +456,7 @@ void transport::init(ParameterReader* par, grid_general *g)
    ddmc_P_abs_.resize(grid->n_zones);
    ddmc_P_stay_.resize(grid->n_zones);
    ddmc_use_in_zone_.resize(grid->n_zones);
+   ddmc_mask_.resize(grid->n_zones*nu_grid_.size());
    n_grid_variables += 6;
 
    if(use_ddmc_ == 3)
@@ -355,6 +468,24 @@ void transport::init(ParameterReader* par, grid_general *g)
    }
  }
 
+  // history-based or event-based propagation of particles
+  std::string transport_mode = params_->getScalar<string>("transport_mode");
+  if (transport_mode == "history")
+    use_event_transport_ = 0;
+  else if (transport_mode == "event")
+    use_event_transport_ = 1;
+  else
+  {
+    if (verbose) cerr << "# ERROR: unknown transport_mode " << transport_mode << "\n";
+    exit(1);
+  }
+  if ((use_event_transport_)&&(use_ddmc_))
+  {
+    if (verbose) cerr << "# ERROR: transport_mode = event does not support ddmc\n";
+    exit(1);
+  }
+  if (verbose) std::cout << "# Using " << transport_mode << "-based particle propagation\n";
+
   // allocate space for emission distribution function across zones
   zone_emission_cdf_.resize(grid->n_zones);
   n_grid_variables += 1;
@@ -372,6 +503,8 @@ void transport::init(ParameterReader* par, grid_general *g)
   if (do_restart) {
     readCheckpointParticles(particles, restart_file, "particles");
     readCheckpointParticles(particles_escaped, restart_file, "particles_escaped");
+    if ((save_escaped_particles_)&&(stream_escaped_particles_))
+      restart_escaped_stream(restart_file);
   }
   else {
     int n_parts = params_->getScalar<int>("particles_n_initialize");
@@ -379,8 +512,7 @@ void transport::init(ParameterReader* par, grid_general *g)
   }
 
   compton_scatter_photons_ = params_->getScalar<int>("opacity_compton_scatter_photons");
-  if (compton_scatter_photons_)
-    setup_MB_cdf(0.,5.,512); // in non-dimensional velocity units
+  compton_tables_.init();
 
   // print out memory footprint
   if (verbose)
@@ -440,24 +572,6 @@ void transport::setup_MPI()
   verbose = (MPI_myID==0);
 }
 
-void transport::setup_MB_cdf(double min_v, double max_v, int num_v)
-{
-  mb_cdf_.resize(num_v);
-  mb_dv = (max_v - min_v)/( (double) num_v);
-
-  //setup the cdf
-  double v = 0;
-  for (int j = 0; j < num_v; j++)
-    {
-      v += mb_dv;
-      mb_cdf_.set_value(j,4./(sqrt(pc::pi)) * pow(v,2.) * exp(-pow(v,2.)));
-    }
-  mb_cdf_.normalize();
-
-
-}
-
-
 // -----------------------------------------------------------
 // Read parameters for a spherical emitting core and
 // setup the emission
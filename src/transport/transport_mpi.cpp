@@ -31,6 +31,7 @@ void transport::wipe_radiation()
     grid->z[i].fz_rad = 0;
     grid->z[i].fr_rad = 0;
   }
+  tally_.wipe();
 }
 
 //------------------------------------------------------------
@@ -45,9 +46,29 @@ void transport::reduce_opacities()
 #else
   if (MPI_nprocs == 1) return;
 
+  // with the opacity cache, the reused zones were
+  // rescaled on all ranks, so only send the others
+  if (opacity_cache_tolerance_ > 0)
+  {
+    reduce_changed_opacities();
+    return;
+  }
 
-   //=************************************************
-  // do zone vectors
+  //=************************************************
+  // do absorptive and scattering opacity; the table
+  // is one contiguous block, so reduce it in place
+  //=************************************************
+  MPI_Datatype MPI_opacity = ( sizeof(OpacityType)==4 ? MPI_FLOAT : MPI_DOUBLE );
+  OpacityType *opac = opacity_table_.data();
+  long n_opac = opacity_table_.size();
+  for (long i=0;i<n_opac;i+=Max_MPI_Blocksize)
+  {
+    int this_size = std::min((long)Max_MPI_Blocksize,n_opac - i);
+    MPI_Allreduce(MPI_IN_PLACE,opac+i,this_size,MPI_opacity,MPI_SUM,MPI_COMM_WORLD);
+  }
+
+  //=************************************************
+  // do emissivity
   //=************************************************
 
   // dimensions
@@ -89,60 +110,6 @@ void transport::reduce_opacities()
       this_nz = last_nz_per_block;
       this_blocksize = last_blocksize; }
 
-    //-----------------------------
-    // absorptive opacity
-    //-----------------------------
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        src_MPI_block[cnt] = abs_opacity_[iz][k];
-        dst_MPI_block[cnt] = 0.0;
-        cnt++;
-      }
-    }
-    MPI_Allreduce(src_MPI_block,dst_MPI_block,this_blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        abs_opacity_[iz][k] = (OpacityType)dst_MPI_block[cnt];
-        cnt++;
-      }
-    }
-
-    //-----------------------------
-    // scattering opacity
-    //-----------------------------
-    if (!omit_scattering_)
-    {
-      cnt = 0;
-      for (int j=0;j<this_nz;j++)
-      {
-        int iz = i*nz_per_block + j;
-        for (int k=0;k<nw;k++)
-        {
-          src_MPI_block[cnt] = scat_opacity_[iz][k];
-          dst_MPI_block[cnt] = 0.0;
-          cnt++;
-        }
-      }
-      MPI_Allreduce(src_MPI_block,dst_MPI_block,this_blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-      cnt = 0;
-      for (int j=0;j<this_nz;j++)
-      {
-        int iz = i*nz_per_block + j;
-        for (int k=0;k<nw;k++)
-        {
-          scat_opacity_[iz][k] = (OpacityType)dst_MPI_block[cnt];
-          cnt++;
-        }
-      }
-    }
     //-----------------------------
     // emissivity
     //-----------------------------
@@ -170,6 +137,11 @@ void transport::reduce_opacities()
     }
   }
 
+  // the emissivity alias tables were only built for the
+  // zones computed on this rank
+  #pragma omp parallel for schedule(guided)
+  for (int i=0;i<nz;i++) emissivity_[i].build_alias();
+
   //=************************************************
   // do zone scalars
   //=************************************************
@@ -209,6 +181,66 @@ void transport::reduce_opacities()
 
 }
 
+//------------------------------------------------------------
+// Combine the opacities, emissivities and mean opacities
+// of only the zones calculated this step (those not reused
+// from the opacity cache), packing the zones into blocks
+//------------------------------------------------------------
+void transport::reduce_changed_opacities()
+{
+#ifdef MPI_PARALLEL
+  int nw = nu_grid_.size();
+  long stride = opacity_table_.stride();
+
+  vector<int> zones;
+  for (int i=0;i<grid->n_zones;i++)
+    if (!opacity_cache_hit_[i]) zones.push_back(i);
+
+  // table row, emissivity and 4 zone scalars per zone
+  long per_zone = stride + nw + 4;
+  if (per_zone > Max_MPI_Blocksize) {
+    std::cerr << "Error, frequency grid is bigger than MPI_Max_Blocksize" << std::endl;
+    exit(1);
+  }
+  int nz_per_block = Max_MPI_Blocksize/per_zone;
+
+  for (size_t b=0;b<zones.size();b+=nz_per_block)
+  {
+    int this_nz = std::min((size_t)nz_per_block,zones.size() - b);
+
+    long cnt = 0;
+    for (int j=0;j<this_nz;j++)
+    {
+      int iz = zones[b+j];
+      OpacityType *row = opacity_table_.row(iz);
+      for (long k=0;k<stride;k++) src_MPI_block[cnt++] = row[k];
+      for (int k=0;k<nw;k++)      src_MPI_block[cnt++] = emissivity_[iz].get(k);
+      src_MPI_block[cnt++] = compton_opac[iz];
+      src_MPI_block[cnt++] = photoion_opac[iz];
+      src_MPI_block[cnt++] = rosseland_mean_opacity_[iz];
+      src_MPI_block[cnt++] = planck_mean_opacity_[iz];
+    }
+    MPI_Allreduce(src_MPI_block,dst_MPI_block,cnt,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+
+    cnt = 0;
+    for (int j=0;j<this_nz;j++)
+    {
+      int iz = zones[b+j];
+      OpacityType *row = opacity_table_.row(iz);
+      for (long k=0;k<stride;k++) row[k] = (OpacityType)dst_MPI_block[cnt++];
+      for (int k=0;k<nw;k++)      emissivity_[iz].set(k,(OpacityType)dst_MPI_block[cnt++]);
+      compton_opac[iz]            = dst_MPI_block[cnt++];
+      photoion_opac[iz]           = dst_MPI_block[cnt++];
+      rosseland_mean_opacity_[iz] = dst_MPI_block[cnt++];
+      planck_mean_opacity_[iz]    = dst_MPI_block[cnt++];
+    }
+  }
+
+  #pragma omp parallel for schedule(guided)
+  for (size_t j=0;j<zones.size();j++) emissivity_[zones[j]].build_alias();
+#endif
+}
+
 //------------------------------------------------------------
 // Combine the solved for temperature in zones
 // from all processors using MPI
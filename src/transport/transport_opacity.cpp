@@ -9,6 +9,7 @@
 #include "transport.h"
 #include "physical_constants.h"
 #include "radioactive.h"
+#include "fastmath.h"
 
 using std::cout;
 using std::cerr;
@@ -26,6 +27,7 @@ void transport::set_opacity(double dt)
 
   // tmp vector to hold emissivity
   vector<OpacityType> emis(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
@@ -37,20 +39,29 @@ void transport::set_opacity(double dt)
     }
   }
 
-  // zero out opacities, etc...
+  // find the zones that can reuse their opacities
+  int use_cache = (opacity_cache_tolerance_ > 0);
+  int n_cache_hits = 0;
+  if (use_cache) n_cache_hits = check_opacity_cache();
+
+  // zero out opacities, etc... of the zones to calculate,
+  // and rescale those of the zones to reuse
+  #pragma omp parallel for schedule(static)
   for (int i=0;i<grid->n_zones;i++)
   {
+    if (use_cache && opacity_cache_hit_[i])
+    {
+      rescale_cached_opacity(i);
+      continue;
+    }
     compton_opac[i]  = 0;
     photoion_opac[i] = 0;
     rosseland_mean_opacity_[i] = 0;
     planck_mean_opacity_[i]    = 0;
     emissivity_[i].wipe();
-    for (int j=0;j<nu_grid_.size();j++)
-    {
-      abs_opacity_[i][j] = 0;
-      if (!omit_scattering_) scat_opacity_[i][j] = 0;
-    }
+    if (use_cache) opacity_table_.wipe_row(i);
   }
+  if (!use_cache) opacity_table_.wipe();
 
 
   if (verbose)
@@ -63,8 +74,9 @@ void transport::set_opacity(double dt)
   tstr = get_system_time();
   int solve_root_errors = 0;
   int solve_iter_errors = 0;
+  int n_my_hits = 0;
 
-#pragma omp parallel firstprivate(emis, scat) shared(cerr,solve_root_errors,solve_iter_errors) default(none)
+#pragma omp parallel firstprivate(emis, abs, scat) shared(cerr,solve_root_errors,solve_iter_errors,use_cache) reduction(+:n_my_hits) default(none)
   {
 #ifdef _OPENMP
     int my_threadID = omp_get_thread_num();
@@ -74,13 +86,27 @@ void transport::set_opacity(double dt)
     // Private variables for each thread
     GasState* gas_state_ptr = &(gas_state_vec_[my_threadID]);
     vector<double> X_now(grid->n_elems);
+    vector<double> bnu(nu_grid_.size());
     radioactive radio_obj;
     radioactive* radio = &radio_obj;
     int solve_error = 0;
 
+    // the zones are taken in blocks, whose solved gas states
+    // are saved to calculate their opacities together
+    int nb = opacity_batch_size_;
+    vector<GasZoneState> block(nb);
+    vector<int> block_zone(nb);
+    vector< vector<OpacityType> > abs_b(nb,abs), scat_b(nb,abs), emis_b(nb,abs);
+    int n_blocks = (my_zone_stop_ - my_zone_start_ + nb - 1)/nb;
 
 #pragma omp for
-    for (int i=my_zone_start_;i<my_zone_stop_;i++) {
+    for (int ib=0;ib<n_blocks;ib++) {
+    int n_in_block = 0;
+    int i_stop = std::min(my_zone_start_ + (ib+1)*nb, my_zone_stop_);
+    for (int i=my_zone_start_+ib*nb;i<i_stop;i++) {
+      // opacities reused from an earlier step
+      if (use_cache && opacity_cache_hit_[i]) {n_my_hits++; continue; }
+
       // pointer to current zone for easy access
       zone* z = &(grid->z[i]);
 
@@ -106,7 +132,15 @@ void transport::set_opacity(double dt)
       gas_state_ptr->bulk_grey_opacity_ = z->bulk_grey_opacity;
       gas_state_ptr->total_grey_opacity_ = z->total_grey_opacity;
 
-      if (first_step_)
+      // LTE opacities looked up in the table
+      int from_table = (use_lte_table_ && (gas_state_ptr->total_grey_opacity_ == 0));
+      if (from_table)
+      {
+        int g = lte_table_.closest_group(grid->elems_Z,grid->elems_A,X_now,t_now_);
+        lte_table_.get_opacity(g,z->rho,gas_state_ptr->temp_,abs,scat,gas_state_ptr->n_elec_);
+      }
+
+      else if (first_step_)
       {
         zone* z = &(grid->z[i]);
         gas_state_ptr->dens_ = z->rho;
@@ -142,66 +176,48 @@ void transport::set_opacity(double dt)
 
       //gas_state_ptr->print();
       #pragma omp critical
-      if(write_levels) gas_state_ptr->write_levels(i);
+      if ((write_levels)&&(!from_table)) gas_state_ptr->write_levels(i);
 
       grid->z[i].n_elec = gas_state_ptr->n_elec_;
 
-      // calculate the opacities/emissivities
-      gas_state_ptr->computeOpacity(abs_opacity_[i],scat,emis);
-
-      double max_extinction = maximum_opacity_* z->rho;
-
-      // save and normalize emissivity cdf
-      grid->z[i].L_thermal = 0;
-      if (nu_grid_.size() == 1)
-      {
-        double bb_int = pc::sb*pow(grid->z[i].T_gas,4)/pc::pi;
-        grid->z[i].L_thermal += 4*pc::pi*abs_opacity_[i][0]*bb_int;
-        emissivity_[i].set_value(0,1);
-        if (!omit_scattering_) scat_opacity_[i][0] = scat[0];
-      }
-      else for (int j=0;j<nu_grid_.size();j++)
+      // calculate the opacities/emissivities; in LTE, the
+      // emissivity of the table opacities is abs*B_nu(T)
+      if (from_table)
       {
-        double ednu = emis[j]*nu_grid_.delta(j);
-        emissivity_[i].set_value(j,ednu);
-        grid->z[i].L_thermal += 4*pc::pi * ednu;
-        if (!omit_scattering_) scat_opacity_[i][j] = scat[j];
-
-        // check for maximum opacity
-        if (!omit_scattering_)
+        int ng = nu_grid_.size();
+        double T = gas_state_ptr->temp_;
+        for (int j=0;j<ng;j++) bnu[j] = pc::h*nu_grid_.center(j)/pc::k/T;
+        fastmath::exp(bnu.data(),bnu.data(),ng);
+        for (int j=0;j<ng;j++)
         {
-          if (scat_opacity_[i][j] > max_extinction)
-            scat_opacity_[i][j]   = max_extinction;
+          double nu = nu_grid_.center(j);
+          emis[j] = abs[j]*2.0*nu*nu*nu*pc::h/pc::c/pc::c/(bnu[j] - 1);
         }
-        if (abs_opacity_[i][j]  > max_extinction)
-          abs_opacity_[i][j]    = max_extinction;
+        store_zone_opacity(gas_state_ptr,i,abs,scat,emis);
       }
-      emissivity_[i].normalize();
-
-      // calculate mean opacities
-      planck_mean_opacity_[i] =
-        gas_state_ptr->get_planck_mean(abs_opacity_[i],scat_opacity_[i]);
-      rosseland_mean_opacity_[i] =
-        gas_state_ptr->get_rosseland_mean(abs_opacity_[i],scat_opacity_[i]);
+      else if (nb == 1)
+      {
+        gas_state_ptr->computeOpacity(abs,scat,emis);
+        store_zone_opacity(gas_state_ptr,i,abs,scat,emis);
+      }
+      else
+      {
+        gas_state_ptr->save_zone_state(block[n_in_block]);
+        block_zone[n_in_block++] = i;
+      }
+    }
 
-      //------------------------------------------------------
-      // gamma-ray opacity (compton + photo-electric)
-      //------------------------------------------------------
-      compton_opac[i]  = 0;
-      photoion_opac[i] = 0;
-      for (int k=0;k<grid->n_elems;k++)
+    // opacities of the rest of the block, all together
+    if (n_in_block > 0)
+    {
+      gas_state_ptr->computeOpacityBatch(block.data(),n_in_block,abs_b,scat_b,emis_b);
+      for (int b=0;b<n_in_block;b++)
       {
-        double dens  = z->X_gas[k]*z->rho;
-        double ndens = dens/(pc::m_p*grid->elems_A[k]);
-        // compton scattering opacity
-        compton_opac[i] += ndens*pc::thomson_cs*grid->elems_Z[k];
-        // photoelectric opacity
-        double photo = pow(pc::alpha_fs,4.0)*4.0*sqrt(2.0);
-        photo *= pow(1.0*grid->elems_Z[k],5.0);
-        photo *= pow(pc::m_e_MeV,3.5);
-        photoion_opac[i] += ndens*2.0*pc::thomson_cs*photo;
+        gas_state_ptr->temp_ = block[b].temp;
+        store_zone_opacity(gas_state_ptr,block_zone[b],abs_b[b],scat_b[b],emis_b[b]);
       }
     }
+    }
 
     // output any solve error
     #pragma omp single
@@ -224,6 +240,19 @@ void transport::set_opacity(double dt)
   tend = get_system_time();
   if (verbose) cout << "# Calculated opacities   (" << (tend-tstr) << " secs) \n";
 
+  // the time saved is estimated from the time taken
+  // to calculate each zone on this rank
+  if (use_cache)
+  {
+    int n_my_zones = my_zone_stop_ - my_zone_start_;
+    if (n_my_zones > n_my_hits) opacity_cache_zone_time_ = (tend-tstr)/(n_my_zones - n_my_hits);
+    opacity_cache_n_hits_  += n_cache_hits;
+    opacity_cache_n_zones_ += grid->n_zones;
+    if (verbose) printf("# Opacity cache          (reused %d of %d zones, %.1f%%; %.1f%% of all so far; ~%.3g secs saved)\n",
+      n_cache_hits,grid->n_zones,100.0*n_cache_hits/grid->n_zones,
+      100.0*opacity_cache_n_hits_/opacity_cache_n_zones_,n_my_hits*opacity_cache_zone_time_);
+  }
+
 
   //------------------------------------------------------------
   // Calcuate implicit MC parameter eps_imc
@@ -260,6 +289,175 @@ void transport::set_opacity(double dt)
 }
 
 
+//------------------------------------------------------------
+// Store the opacities and emissivity of zone i, as
+// calculated by the gas state (or read from the table), and
+// set its mean and gamma-ray opacities. The gas state has to
+// be at the temperature of the zone, for the means
+//------------------------------------------------------------
+void transport::store_zone_opacity(GasState *gas_state_ptr, const int i,
+  vector<OpacityType>& abs, vector<OpacityType>& scat, vector<OpacityType>& emis)
+{
+  zone* z = &(grid->z[i]);
+  if (omit_scattering_) scat.assign(scat.size(),0.0);
+
+  double max_extinction = maximum_opacity_* z->rho;
+
+  // save and normalize emissivity cdf
+  grid->z[i].L_thermal = 0;
+  if (nu_grid_.size() == 1)
+  {
+    double bb_int = pc::sb*pow(grid->z[i].T_gas,4)/pc::pi;
+    grid->z[i].L_thermal += 4*pc::pi*abs[0]*bb_int;
+    emissivity_[i].set_value(0,1);
+  }
+  else for (int j=0;j<nu_grid_.size();j++)
+  {
+    double ednu = emis[j]*nu_grid_.delta(j);
+    emissivity_[i].set_value(j,ednu);
+    grid->z[i].L_thermal += 4*pc::pi * ednu;
+
+    // check for maximum opacity
+    if (scat[j] > max_extinction) scat[j] = max_extinction;
+    if (abs[j]  > max_extinction) abs[j]  = max_extinction;
+  }
+  emissivity_[i].normalize();
+  opacity_table_.set_row(i,abs,scat);
+
+  // calculate mean opacities
+  planck_mean_opacity_[i] =
+    gas_state_ptr->get_planck_mean(abs,scat);
+  rosseland_mean_opacity_[i] =
+    gas_state_ptr->get_rosseland_mean(abs,scat);
+
+  //------------------------------------------------------
+  // gamma-ray opacity (compton + photo-electric)
+  //------------------------------------------------------
+  compton_opac[i]  = 0;
+  photoion_opac[i] = 0;
+  for (int k=0;k<grid->n_elems;k++)
+  {
+    double dens  = z->X_gas[k]*z->rho;
+    double ndens = dens/(pc::m_p*grid->elems_A[k]);
+    // compton scattering opacity
+    compton_opac[i] += ndens*pc::thomson_cs*grid->elems_Z[k];
+    // photoelectric opacity
+    double photo = pow(pc::alpha_fs,4.0)*4.0*sqrt(2.0);
+    photo *= pow(1.0*grid->elems_Z[k],5.0);
+    photo *= pow(pc::m_e_MeV,3.5);
+    photoion_opac[i] += ndens*2.0*pc::thomson_cs*photo;
+  }
+}
+
+//-----------------------------------------------------------------
+// whether a quantity has changed by more than a relative
+// tolerance from its cached value
+//-----------------------------------------------------------------
+static int cache_changed(double now, double cached, double tol)
+{
+  return (fabs(now - cached) > tol*fabs(cached));
+}
+
+//-----------------------------------------------------------------
+// Decide which zones can reuse the opacities of the step in
+// which they were last calculated. That is the case if the
+// density, gas temperature, time, decayed composition and (with
+// NLTE) the integral and mean frequency of J_nu have all changed
+// by less than opacity_cache_tolerance since then. The decision
+// only uses quantities known on all ranks, so all ranks agree on
+// it. Returns the number of zones to reuse
+//-----------------------------------------------------------------
+int transport::check_opacity_cache()
+{
+  int nz = grid->n_zones;
+  double tol = opacity_cache_tolerance_;
+
+  // the temperature is solved for along with the opacities,
+  // and the level populations are written out, in these modes
+  int recalc_all = (first_step_ || solve_Tgas_with_updated_opacities_ || write_levels);
+  int use_J = (use_nlte_ && store_Jnu_);
+
+  int n_hits = 0;
+  #pragma omp parallel reduction(+:n_hits)
+  {
+    vector<double> X_now(grid->n_elems);
+    radioactive radio;
+
+    #pragma omp for schedule(static)
+    for (int i=0;i<nz;i++)
+    {
+      zone* z = &(grid->z[i]);
+      OpacityCacheKey &key = opacity_cache_[i];
+
+      double T = z->T_gas;
+      if (T < temp_min_value_) T = temp_min_value_;
+      if (T > temp_max_value_) T = temp_max_value_;
+
+      for (size_t j=0;j<X_now.size();j++) X_now[j] = z->X_gas[j];
+      if (!omit_composition_decay_)
+        radio.decay_composition(grid->elems_Z,grid->elems_A,X_now,t_now_);
+
+      double J_int = 0, J_nu_mean = 0;
+      if (use_J)
+      {
+        for (int j=0;j<nu_grid_.size();j++)
+        {
+          double Jdnu = J_nu_[i][j]*nu_grid_.delta(j);
+          J_int     += Jdnu;
+          J_nu_mean += Jdnu*nu_grid_.center(j);
+        }
+        if (J_int > 0) J_nu_mean /= J_int;
+      }
+
+      int hit = !recalc_all;
+      if (hit) hit = !(cache_changed(z->rho,key.rho,tol) || cache_changed(T,key.T_gas,tol)
+                    || cache_changed(t_now_,key.time,tol) || cache_changed(J_int,key.J_int,tol)
+                    || cache_changed(J_nu_mean,key.J_nu_mean,tol));
+      if (hit)
+      {
+        double dX = 0;
+        for (size_t j=0;j<X_now.size();j++) dX += fabs(X_now[j] - key.X[j]);
+        hit = (dX <= tol);
+      }
+
+      opacity_cache_hit_[i] = hit;
+      if (hit) {n_hits++; continue; }
+
+      // the zone is recalculated in this state
+      key.rho       = z->rho;
+      key.T_gas     = T;
+      key.time      = t_now_;
+      key.J_int     = J_int;
+      key.J_nu_mean = J_nu_mean;
+      key.X         = X_now;
+      key.rho_table = z->rho;
+    }
+  }
+  return n_hits;
+}
+
+//-----------------------------------------------------------------
+// Reuse the opacities of zone i from the last step, scaling
+// them (and the electron density and thermal luminosity) to
+// the current density. The normalized emissivity is unchanged
+//-----------------------------------------------------------------
+void transport::rescale_cached_opacity(int i)
+{
+  OpacityCacheKey &key = opacity_cache_[i];
+  double fac = grid->z[i].rho/key.rho_table;
+  key.rho_table = grid->z[i].rho;
+  if (fac == 1) return;
+
+  opacity_table_.scale_row(i,fac);
+  planck_mean_opacity_[i]    *= fac;
+  rosseland_mean_opacity_[i] *= fac;
+  compton_opac[i]  *= fac;
+  photoion_opac[i] *= fac;
+  grid->z[i].n_elec    *= fac;
+  grid->z[i].L_thermal *= fac;
+}
+
+
 //-----------------------------------------------------------------
 // get comoving opacity at the frequency
 // returns the frequency index of the photon in the
@@ -276,11 +474,14 @@ int transport::get_opacity(particle &p, double dshift, double &opac, double &eps
   // get opacity if it is an optical photon.
   if (p.type == photon)
   {
-    // interpolate opacity at the local comving frame frequency
-    i_nu = nu_grid_.locate_within_bounds(nu);
-    double a_opac = nu_grid_.value_at(nu,abs_opacity_[p.ind],i_nu);
-    double s_opac = 0;
-    if (!omit_scattering_) s_opac = nu_grid_.value_at(nu,scat_opacity_[p.ind],i_nu);
+    // interpolate opacity at the local comving frame frequency.
+    // The particle remembers its bin, and the comoving frequency
+    // only drifts by about a bin between calls (steps are limited
+    // to the next bin crossing), so start the search from there
+    i_nu = nu_grid_.locate_from(nu,p.i_nu);
+    p.i_nu = i_nu;
+    double a_opac = opacity_table_.abs(p.ind,i_nu);
+    double s_opac = opacity_table_.scat(p.ind,i_nu);
     opac = a_opac + s_opac;
     if (opac == 0) eps = 0;
     else eps  = a_opac/opac;
@@ -290,7 +491,8 @@ int transport::get_opacity(particle &p, double dshift, double &opac, double &eps
   if (p.type == gammaray)
   {
     double c_opac = compton_opac[p.ind]*klein_nishina(p.nu);
-    double p_opac = photoion_opac[p.ind]*pow(p.nu,-3.5);
+    // nu^-3.5, without the cost of a call to pow
+    double p_opac = photoion_opac[p.ind]/(p.nu*p.nu*p.nu*sqrt(p.nu));
     opac = c_opac + p_opac;
     eps  = p_opac/(c_opac + p_opac);
   }
@@ -306,13 +508,7 @@ int transport::get_opacity(particle &p, double dshift, double &opac, double &eps
 double transport::klein_nishina(double x)
 {
   // divide by m_e c^2 = 0.511 MeV
-  x = x/pc::m_e_MeV;
-  double logfac = log(1 + 2*x);
-  double term1 = (1+x)/x/x/x*(2*x*(1+x)/(1+2*x) - logfac);
-  double term2 = 1.0/2.0/x*logfac;
-  double term3 = -1.0*(1 + 3*x)/(1+2*x)/(1+2*x);
-  double KN    = .75*(term1 + term2 + term3);
-  return KN;
+  return compton_tables_.klein_nishina(x/pc::m_e_MeV);
 }
 
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <iostream>
 #include <sstream>
+#include <fstream>
 
 #include "transport.h"
 #include "physical_constants.h"
@@ -39,7 +40,13 @@ void transport::output_spectrum(int it)
     if (verbose) gamma_spectrum.print(suppress_txt);
   }
 
-  if (save_escaped_particles_)
+  if ((save_escaped_particles_)&&(stream_escaped_particles_))
+  {
+    // escaped particles are already on disk except for
+    // the partially filled thread buffers
+    flush_escaped_stream();
+  }
+  else if (save_escaped_particles_)
   {
     if (verbose) {
       std::cout << "# writing escaped particle list" << std::endl;
@@ -210,10 +217,10 @@ void transport::write_radiation_file(int iw)
     // write total opacity
     if (omit_scattering_)
       for (int j=0;j<n_nu;j++)
-        tmp_array[j] = (abs_opacity_[i][j])/grid->z[i].rho;
+        tmp_array[j] = (opacity_table_.abs(i,j))/grid->z[i].rho;
     else
       for (int j=0;j<n_nu;j++)
-        tmp_array[j] = (scat_opacity_[i][j] + abs_opacity_[i][j])/grid->z[i].rho;
+        tmp_array[j] = (opacity_table_.scat(i,j) + opacity_table_.abs(i,j))/grid->z[i].rho;
     H5LTmake_dataset(zone_id,"opacity",RANK,dims,H5T_NATIVE_FLOAT,tmp_array);
 
     // write absorption fraction
@@ -222,9 +229,9 @@ void transport::write_radiation_file(int iw)
       double eps = 1;
       if (!omit_scattering_)
       {
-        double topac = scat_opacity_[i][j] + abs_opacity_[i][j];
+        double topac = opacity_table_.scat(i,j) + opacity_table_.abs(i,j);
         if (topac == 0) eps = 1;
-        else eps = abs_opacity_[i][j]/topac;
+        else eps = opacity_table_.abs(i,j)/topac;
       }
       tmp_array[j] = eps;
     }
@@ -293,11 +300,25 @@ void transport::write_radiation_file(int iw)
 
 
 void transport::writeCheckpointParticlesAll(std::string fname) {
+  if ((save_escaped_particles_)&&(stream_escaped_particles_)) flush_escaped_stream();
   writeCheckpointParticles(particles, fname, "particles");
   writeCheckpointParticles(particles_escaped, fname, "particles_escaped");
+
+  // length of each rank's escaped particle stream, so a restart
+  // can drop whatever was streamed after this checkpoint
+  if ((save_escaped_particles_)&&(stream_escaped_particles_)) {
+    long long* stream_lengths = new long long[MPI_nprocs];
+    MPI_Gather(&escaped_stream_length_, 1, MPI_LONG_LONG, stream_lengths, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (MPI_myID == 0) {
+      hsize_t nranks_dim[1] = {hsize_t(MPI_nprocs)};
+      createDataset(fname, "particles_escaped", "stream_counts_by_rank", 1, nranks_dim, H5T_NATIVE_LLONG);
+      writeSimple(fname, "particles_escaped", "stream_counts_by_rank", stream_lengths, H5T_NATIVE_LLONG);
+    }
+    delete[] stream_lengths;
+  }
 }
 
-void transport::writeCheckpointParticles(std::vector<particle>& particle_list,
+void transport::writeCheckpointParticles(ParticleStore& particle_list,
     std::string fname, std::string groupname) {
   // Figures out what every rank's offset is going to be in the big particle list
   int my_n_particles = particle_list.size();
@@ -339,6 +360,8 @@ void transport::writeCheckpointParticles(std::vector<particle>& particle_list,
     createDataset(fname, groupname, "dshift", ndim1, dims1, H5T_NATIVE_DOUBLE);
     createDataset(fname, groupname, "dvds", ndim1, dims1, H5T_NATIVE_DOUBLE);
     createDataset(fname, groupname, "fate", ndim1, dims1, H5T_NATIVE_INT);
+    createDataset(fname, groupname, "rng_id", ndim1, dims1, H5T_NATIVE_UINT64);
+    createDataset(fname, groupname, "rng_count", ndim1, dims1, H5T_NATIVE_UINT64);
   }
   MPI_Barrier(MPI_COMM_WORLD);
   for (int i = 0; i < MPI_nprocs; i++) {
@@ -355,6 +378,8 @@ void transport::writeCheckpointParticles(std::vector<particle>& particle_list,
       writeParticleProp(fname, "dshift", groupname, particle_list, global_n_particles_total, my_offset);
       writeParticleProp(fname, "dvds", groupname, particle_list, global_n_particles_total, my_offset);
       writeParticleProp(fname, "fate", groupname, particle_list, global_n_particles_total, my_offset);
+      writeParticleProp(fname, "rng_id", groupname, particle_list, global_n_particles_total, my_offset);
+      writeParticleProp(fname, "rng_count", groupname, particle_list, global_n_particles_total, my_offset);
     }
     MPI_Barrier(MPI_COMM_WORLD);
   }
@@ -362,60 +387,169 @@ void transport::writeCheckpointParticles(std::vector<particle>& particle_list,
   delete[] particle_offsets;
 }
 
+//--------------------------------------------------------------
+// Append a list of escaped particles to this rank's escaped
+// particle stream file, creating it on first use. The file
+// has the same group and fields as writeCheckpointParticles,
+// with the particle count growing along the first dimension.
+// Not thread safe; must be called by one thread at a time
+//--------------------------------------------------------------
+void transport::append_escaped_stream(ParticleStore& particle_list)
+{
+  int n = particle_list.size();
+  if (n == 0) return;
+
+  std::string groupname = "particles_escaped";
+  if (!escaped_stream_created_)
+  {
+    createFile(escaped_stream_file_);
+    createGroup(escaped_stream_file_, groupname);
+    int chunk1[1] = {escaped_stream_chunk_};
+    int chunk3[2] = {escaped_stream_chunk_, 3};
+    createExtendableDataset(escaped_stream_file_, groupname, "type", 1, chunk1, H5T_NATIVE_INT);
+    createExtendableDataset(escaped_stream_file_, groupname, "x", 2, chunk3, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "D", 2, chunk3, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "x_interact", 2, chunk3, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "ind", 1, chunk1, H5T_NATIVE_INT);
+    createExtendableDataset(escaped_stream_file_, groupname, "t", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "e", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "nu", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "gamma", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "dshift", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "dvds", 1, chunk1, H5T_NATIVE_DOUBLE);
+    createExtendableDataset(escaped_stream_file_, groupname, "fate", 1, chunk1, H5T_NATIVE_INT);
+    createExtendableDataset(escaped_stream_file_, groupname, "rng_id", 1, chunk1, H5T_NATIVE_UINT64);
+    createExtendableDataset(escaped_stream_file_, groupname, "rng_count", 1, chunk1, H5T_NATIVE_UINT64);
+    escaped_stream_created_ = 1;
+  }
+
+  const char* fields[] = {"type", "x", "D", "x_interact", "ind", "t", "e",
+    "nu", "gamma", "dshift", "dvds", "fate", "rng_id", "rng_count"};
+  for (int k = 0; k < 14; k++)
+    writeParticleProp(escaped_stream_file_, fields[k], groupname, particle_list, 0, 0, true);
+  escaped_stream_length_ += n;
+}
+
+//--------------------------------------------------------------
+// On restart, keep adding to an existing stream file, first
+// cutting it back to its length at the time of the checkpoint
+// so that particles streamed after the checkpoint are not
+// written twice. Checkpoints without stream lengths leave the
+// file as it is
+//--------------------------------------------------------------
+void transport::restart_escaped_stream(std::string fname)
+{
+  if (!std::ifstream(escaped_stream_file_).good()) return;
+  escaped_stream_created_ = 1;
+
+  std::string groupname = "particles_escaped";
+  hsize_t n_stream;
+  getH5dims(escaped_stream_file_, groupname, "e", &n_stream);
+  escaped_stream_length_ = n_stream;
+
+  /* Check for the stream lengths, which older files do not have */
+  int has_lengths = 0;
+  if (MPI_myID == 0) {
+    hid_t file_id = openH5File(fname);
+    hid_t group_id = openH5Group(file_id, groupname);
+    has_lengths = (H5Lexists(group_id, "stream_counts_by_rank", H5P_DEFAULT) > 0);
+    closeH5Group(group_id);
+    closeH5File(file_id);
+  }
+  MPI_Bcast(&has_lengths, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (!has_lengths) {
+    if (verbose)
+      std::cerr << "# WARNING: no escaped particle stream lengths in " << fname
+        << "; particles streamed after the checkpoint may be repeated" << std::endl;
+    return;
+  }
+
+  // ranks read the checkpoint one at a time
+  std::vector<long long> stream_lengths;
+  for (int rank = 0; rank < MPI_nprocs; rank++) {
+    if (MPI_myID == rank)
+      readVector(fname, groupname, "stream_counts_by_rank", stream_lengths, H5T_NATIVE_LLONG);
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+  if (MPI_myID >= (int)stream_lengths.size()) return;
+  if (escaped_stream_length_ <= stream_lengths[MPI_myID]) return;
+
+  const char* fields[] = {"type", "x", "D", "x_interact", "ind", "t", "e",
+    "nu", "gamma", "dshift", "dvds", "fate", "rng_id", "rng_count"};
+  for (int k = 0; k < 14; k++)
+    truncateDataset(escaped_stream_file_, groupname, fields[k], stream_lengths[MPI_myID]);
+  escaped_stream_length_ = stream_lengths[MPI_myID];
+}
+
+//--------------------------------------------------------------
+// Write the escaped particles remaining in the thread buffers
+// to the stream file
+//--------------------------------------------------------------
+void transport::flush_escaped_stream()
+{
+  for (size_t t = 0; t < escape_buffers_.size(); t++)
+  {
+    append_escaped_stream(escape_buffers_[t]);
+    escape_buffers_[t].clear();
+  }
+}
+
 // Writes out particle data, assuming that the particles group already exists in
 // the hdf5 file named file. The
 void transport::writeParticleProp(std::string fname, std::string fieldname,
-    std::string groupname, std::vector<particle>& particle_list, int total_particles, int offset) {
+    std::string groupname, ParticleStore& particle_list, int total_particles, int offset,
+    bool append) {
   int n_dims = 1;
   int n_particles_local = particle_list.size();
-  int* buffer_i;
-  double* buffer_d;
+  int* buffer_i = NULL;
+  double* buffer_d = NULL;
+  uint64_t* buffer_u = NULL;
   hid_t t = H5T_NATIVE_DOUBLE;
   if (fieldname == "type") {
     t = H5T_NATIVE_INT;
     buffer_i = new int[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_i[i] = particle_list[i].type;
+      buffer_i[i] = particle_list.type[i];
     }
   }
   else if (fieldname == "x") {
     n_dims = 2;
     buffer_d = new double[n_particles_local * 3];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i * 3] = particle_list[i].x[0];
-      buffer_d[i * 3 + 1] = particle_list[i].x[1];
-      buffer_d[i * 3 + 2] = particle_list[i].x[2];
+      buffer_d[i * 3] = particle_list.x[0][i];
+      buffer_d[i * 3 + 1] = particle_list.x[1][i];
+      buffer_d[i * 3 + 2] = particle_list.x[2][i];
     }
   }
   else if (fieldname == "D") {
     n_dims = 2;
     buffer_d = new double[n_particles_local * 3];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i * 3] = particle_list[i].D[0];
-      buffer_d[i * 3 + 1] = particle_list[i].D[1];
-      buffer_d[i * 3 + 2] = particle_list[i].D[2];
+      buffer_d[i * 3] = particle_list.D[0][i];
+      buffer_d[i * 3 + 1] = particle_list.D[1][i];
+      buffer_d[i * 3 + 2] = particle_list.D[2][i];
     }
   }
   else if (fieldname == "x_interact") {
     n_dims = 2;
     buffer_d = new double[n_particles_local * 3];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i * 3] = particle_list[i].x_interact[0];
-      buffer_d[i * 3 + 1] = particle_list[i].x_interact[1];
-      buffer_d[i * 3 + 2] = particle_list[i].x_interact[2];
+      buffer_d[i * 3] = particle_list.x_interact[0][i];
+      buffer_d[i * 3 + 1] = particle_list.x_interact[1][i];
+      buffer_d[i * 3 + 2] = particle_list.x_interact[2][i];
     }
   }
   else if (fieldname == "ind") {
     t = H5T_NATIVE_INT;
     buffer_i = new int[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_i[i] = particle_list[i].ind;
+      buffer_i[i] = particle_list.ind[i];
     }
   }
   else if (fieldname == "t") {
     buffer_d = new double[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i] = particle_list[i].t;
+      buffer_d[i] = particle_list.t[i];
     }
   }
   else if (fieldname == "e") {
@@ -426,38 +560,52 @@ void transport::writeParticleProp(std::string fname, std::string fieldname,
       // In case we restart with a different number of particles,
       // we need to scale down the energy so that the total of all
       // particles is the total ejecta energy.
-      buffer_d[i] = particle_list[i].e / MPI_nprocs;
+      buffer_d[i] = particle_list.e[i] / MPI_nprocs;
     }
   }
   else if (fieldname == "nu") {
     buffer_d = new double[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i] = particle_list[i].nu;
+      buffer_d[i] = particle_list.nu[i];
     }
   }
   else if (fieldname == "gamma") {
     buffer_d = new double[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i] = particle_list[i].gamma;
+      buffer_d[i] = particle_list.gamma[i];
     }
   }
   else if (fieldname == "dshift") {
     buffer_d = new double[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i] = particle_list[i].dshift;
+      buffer_d[i] = particle_list.dshift[i];
     }
   }
   else if (fieldname == "dvds") {
     buffer_d = new double[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_d[i] = particle_list[i].dvds;
+      buffer_d[i] = particle_list.dvds[i];
     }
   }
   else if (fieldname == "fate") {
     t = H5T_NATIVE_INT;
     buffer_i = new int[n_particles_local];
     for (int i = 0; i < n_particles_local; i++) {
-      buffer_i[i] = particle_list[i].fate;
+      buffer_i[i] = particle_list.fate[i];
+    }
+  }
+  else if (fieldname == "rng_id") {
+    t = H5T_NATIVE_UINT64;
+    buffer_u = new uint64_t[n_particles_local];
+    for (int i = 0; i < n_particles_local; i++) {
+      buffer_u[i] = particle_list.rng_id[i];
+    }
+  }
+  else if (fieldname == "rng_count") {
+    t = H5T_NATIVE_UINT64;
+    buffer_u = new uint64_t[n_particles_local];
+    for (int i = 0; i < n_particles_local; i++) {
+      buffer_u[i] = particle_list.rng_count[i];
     }
   }
   else {
@@ -476,17 +624,19 @@ void transport::writeParticleProp(std::string fname, std::string fieldname,
     std::cerr << "Dimension count " << n_dims << " not allowed." <<std::endl;
     exit(3);
   }
-  if (t == H5T_NATIVE_INT) {
-    writePatch(fname, groupname, fieldname.c_str(), buffer_i, t, n_dims, start, size, total_size);
-    delete[] buffer_i;
-  }
-  else if (t == H5T_NATIVE_DOUBLE) {
-    writePatch(fname, groupname, fieldname.c_str(), buffer_d, t, n_dims, start, size, total_size);
-    delete[] buffer_d;
-  }
-  else {
-    std::cerr << "HDF5 type is wrong" <<std::endl;
-  }
+  // exactly one of the buffers was filled above
+  void* buffer = NULL;
+  if (buffer_i != NULL) buffer = buffer_i;
+  else if (buffer_d != NULL) buffer = buffer_d;
+  else if (buffer_u != NULL) buffer = buffer_u;
+  if (append)
+    appendPatch(fname, groupname, fieldname.c_str(), buffer, t, n_dims, size);
+  else
+    writePatch(fname, groupname, fieldname.c_str(), buffer, t, n_dims, start, size, total_size);
+
+  delete[] buffer_i;
+  delete[] buffer_d;
+  delete[] buffer_u;
 }
 
 void transport::writeCheckpointSpectra(std::string fname) {
@@ -498,13 +648,13 @@ void transport::writeCheckpointRNG(std::string fname) {
   rangen.writeCheckpointRNG(fname);
 }
 
-void transport::readCheckpointParticles(std::vector<particle>& particle_list,
+void transport::readCheckpointParticles(ParticleStore& particle_list,
     std::string fname, std::string groupname, bool test, bool all_one_rank) {
   /* Get number of particles that are stored in the file */
   hsize_t global_n_particles_total, n_ranks_old;
   int my_n_particles, my_offset;
-  int* global_n_particles;
-  int* particle_offsets;
+  int* global_n_particles = NULL;
+  int* particle_offsets = NULL;
   // all_one_rank option reads all particles into this rank and does not divide
   // them up
   if (!all_one_rank) {
@@ -560,6 +710,16 @@ void transport::readCheckpointParticles(std::vector<particle>& particle_list,
   }
   particle_list.resize(my_n_particles);
 
+  /* Check for the random number streams, which older files do not have */
+  int has_rng_streams = 0;
+  if (MPI_myID == 0 || all_one_rank) {
+    hid_t file_id = openH5File(fname);
+    hid_t group_id = openH5Group(file_id, groupname);
+    has_rng_streams = (H5Lexists(group_id, "rng_id", H5P_DEFAULT) > 0);
+    closeH5Group(group_id);
+    closeH5File(file_id);
+  }
+  if (!all_one_rank) MPI_Bcast(&has_rng_streams, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
   /* Read in all of the quantities */
   for (int i = 0; i < MPI_nprocs; i++) {
@@ -576,12 +736,25 @@ void transport::readCheckpointParticles(std::vector<particle>& particle_list,
       readParticleProp(fname, "dshift", groupname, particle_list, global_n_particles_total, my_offset);
       readParticleProp(fname, "dvds", groupname, particle_list, global_n_particles_total, my_offset);
       readParticleProp(fname, "fate", groupname, particle_list, global_n_particles_total, my_offset);
+      if (has_rng_streams) {
+        readParticleProp(fname, "rng_id", groupname, particle_list, global_n_particles_total, my_offset);
+        readParticleProp(fname, "rng_count", groupname, particle_list, global_n_particles_total, my_offset);
+      }
     }
     if (!all_one_rank) {
       MPI_Barrier(MPI_COMM_WORLD);
     }
   }
 
+  // particles from older checkpoints get new random streams
+  if (!has_rng_streams) {
+    uint64_t id0 = rangen.new_streams(global_n_particles_total);
+    for (int i = 0; i < my_n_particles; i++) {
+      particle_list.rng_id[i] = id0 + my_offset + i;
+      particle_list.rng_count[i] = 0;
+    }
+  }
+
   if (!all_one_rank) {
     delete[] global_n_particles;
     delete[] particle_offsets;
@@ -589,11 +762,12 @@ void transport::readCheckpointParticles(std::vector<particle>& particle_list,
 }
 
 void transport::readParticleProp(std::string fname, std::string fieldname,
-    std::string groupname, std::vector<particle>& particle_list, int total_particles, int offset) {
+    std::string groupname, ParticleStore& particle_list, int total_particles, int offset) {
   int n_dims = 1;
   int n_particles_local = particle_list.size();
-  int* buffer_i;
-  double* buffer_d;
+  int* buffer_i = NULL;
+  double* buffer_d = NULL;
+  uint64_t* buffer_u = NULL;
   // Set up patch info
   int start[2] = {offset, 0};
   int size[2] = {n_particles_local, 3};
@@ -611,84 +785,96 @@ void transport::readParticleProp(std::string fname, std::string fieldname,
   else if ((fieldname == "t") || (fieldname == "e") || (fieldname == "nu") || (fieldname == "gamma") || (fieldname == "dshift") || (fieldname == "dvds")) {
     buffer_d = new double[n_particles_local];
   }
+  else if ((fieldname == "rng_id") || (fieldname == "rng_count")) {
+    t = H5T_NATIVE_UINT64;
+    buffer_u = new uint64_t[n_particles_local];
+  }
   else {
     std::cerr << "Particle field " << fieldname << " does not exist. Terminating" << std::endl;
     exit(3);
   }
 
-  if (t == H5T_NATIVE_INT)
-    readPatch(fname, groupname, fieldname.c_str(), buffer_i, t, n_dims, start, size, total_size);
-  else if (t == H5T_NATIVE_DOUBLE)
-    readPatch(fname, groupname, fieldname.c_str(), buffer_d, t, n_dims, start, size, total_size);
-  else {
-    std::cerr << "HDF5 type is wrong" << std::endl;
-    exit(3);
-  }
+  // exactly one of the buffers was allocated above
+  void* buffer = NULL;
+  if (buffer_i != NULL) buffer = buffer_i;
+  else if (buffer_d != NULL) buffer = buffer_d;
+  else if (buffer_u != NULL) buffer = buffer_u;
+  readPatch(fname, groupname, fieldname.c_str(), buffer, t, n_dims, start, size, total_size);
 
   if (fieldname == "type") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].type = static_cast<PType>(buffer_i[i]);
+      particle_list.type[i] = static_cast<PType>(buffer_i[i]);
     }
   }
   else if (fieldname == "x") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].x[0] = buffer_d[i * 3];
-      particle_list[i].x[1] = buffer_d[i * 3 + 1];
-      particle_list[i].x[2] = buffer_d[i * 3 + 2];
+      particle_list.x[0][i] = buffer_d[i * 3];
+      particle_list.x[1][i] = buffer_d[i * 3 + 1];
+      particle_list.x[2][i] = buffer_d[i * 3 + 2];
     }
   }
   else if (fieldname == "D") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].D[0] = buffer_d[i * 3];
-      particle_list[i].D[1] = buffer_d[i * 3 + 1];
-      particle_list[i].D[2] = buffer_d[i * 3 + 2];
+      particle_list.D[0][i] = buffer_d[i * 3];
+      particle_list.D[1][i] = buffer_d[i * 3 + 1];
+      particle_list.D[2][i] = buffer_d[i * 3 + 2];
     }
   }
   else if (fieldname == "x_interact") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].x_interact[0] = buffer_d[i * 3];
-      particle_list[i].x_interact[1] = buffer_d[i * 3 + 1];
-      particle_list[i].x_interact[2] = buffer_d[i * 3 + 2];
+      particle_list.x_interact[0][i] = buffer_d[i * 3];
+      particle_list.x_interact[1][i] = buffer_d[i * 3 + 1];
+      particle_list.x_interact[2][i] = buffer_d[i * 3 + 2];
     }
   }
   else if (fieldname == "ind") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].ind = buffer_i[i];
+      particle_list.ind[i] = buffer_i[i];
     }
   }
   else if (fieldname == "t") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].t = buffer_d[i];
+      particle_list.t[i] = buffer_d[i];
     }
   }
   else if (fieldname == "e") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].e = buffer_d[i] * MPI_nprocs;
+      particle_list.e[i] = buffer_d[i] * MPI_nprocs;
     }
   }
   else if (fieldname == "nu") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].nu = buffer_d[i];
+      particle_list.nu[i] = buffer_d[i];
     }
   }
   else if (fieldname == "gamma") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].gamma = buffer_d[i];
+      particle_list.gamma[i] = buffer_d[i];
     }
   }
   else if (fieldname == "dshift") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].dshift = buffer_d[i];
+      particle_list.dshift[i] = buffer_d[i];
     }
   }
   else if (fieldname == "dvds") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].dvds = buffer_d[i];
+      particle_list.dvds[i] = buffer_d[i];
     }
   }
   else if (fieldname == "fate") {
     for (int i = 0; i < n_particles_local; i++) {
-      particle_list[i].fate = static_cast<ParticleFate>(buffer_i[i]);
+      particle_list.fate[i] = static_cast<ParticleFate>(buffer_i[i]);
+    }
+  }
+  else if (fieldname == "rng_id") {
+    for (int i = 0; i < n_particles_local; i++) {
+      particle_list.rng_id[i] = buffer_u[i];
+    }
+  }
+  else if (fieldname == "rng_count") {
+    for (int i = 0; i < n_particles_local; i++) {
+      particle_list.rng_count[i] = buffer_u[i];
     }
   }
   else {
@@ -696,14 +882,9 @@ void transport::readParticleProp(std::string fname, std::string fieldname,
     exit(3);
   }
 
-  if (t == H5T_NATIVE_INT)
-    delete[] buffer_i;
-  else if (t == H5T_NATIVE_DOUBLE)
-    delete[] buffer_d;
-  else {
-    std::cerr << "HDF5 type is wrong" << std::endl;
-    exit(3);
-  }
+  delete[] buffer_i;
+  delete[] buffer_d;
+  delete[] buffer_u;
 }
 
 void transport::readCheckpointSpectra(std::string fname, bool test) {
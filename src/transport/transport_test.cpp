@@ -18,66 +18,74 @@ void transport::testCheckpointParticles(std::string fname) {
   for (int rank = 0; rank < MPI_nprocs; rank++) {
     if (rank == MPI_myID) {
       for (int i = 0; i < particles_new.size(); i++) {
-        if (particles_new[i].type != particles[i].type) {
+        if (particles_new.type[i] != particles.type[i]) {
           std::cerr << "New particle type is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].x[0] != particles[i].x[0]) {
+        if (particles_new.x[0][i] != particles.x[0][i]) {
           std::cerr << "New particle x0 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].x[1] != particles[i].x[1]) {
+        if (particles_new.x[1][i] != particles.x[1][i]) {
           std::cerr << "New particle x1 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].x[2] != particles[i].x[2]) {
+        if (particles_new.x[2][i] != particles.x[2][i]) {
           std::cerr << "New particle x2 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].D[0] != particles[i].D[0]) {
+        if (particles_new.D[0][i] != particles.D[0][i]) {
           std::cerr << "New particle D0 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].D[1] != particles[i].D[1]) {
+        if (particles_new.D[1][i] != particles.D[1][i]) {
           std::cerr << "New particle D1 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].D[2] != particles[i].D[2]) {
+        if (particles_new.D[2][i] != particles.D[2][i]) {
           std::cerr << "New particle D2 is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].ind != particles[i].ind) {
+        if (particles_new.ind[i] != particles.ind[i]) {
           std::cerr << "New particle ind is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].t != particles[i].t) {
+        if (particles_new.t[i] != particles.t[i]) {
           std::cerr << "New particle t is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].e != particles[i].e) {
+        if (particles_new.e[i] != particles.e[i]) {
           std::cerr << "New particle e is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].nu != particles[i].nu) {
+        if (particles_new.nu[i] != particles.nu[i]) {
           std::cerr << "New particle nu is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].gamma != particles[i].gamma) {
+        if (particles_new.gamma[i] != particles.gamma[i]) {
           std::cerr << "New particle gamma is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].dshift != particles[i].dshift) {
+        if (particles_new.dshift[i] != particles.dshift[i]) {
           std::cerr << "New particle dshift is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].dvds != particles[i].dvds) {
+        if (particles_new.dvds[i] != particles.dvds[i]) {
           std::cerr << "New particle dvds is different." << std::endl;
           exit(1);
         }
-        if (particles_new[i].fate != particles[i].fate) {
+        if (particles_new.fate[i] != particles.fate[i]) {
           std::cerr << "New particle fate is different." << std::endl;
           exit(1);
         }
+        if (particles_new.rng_id[i] != particles.rng_id[i]) {
+          std::cerr << "New particle rng_id is different." << std::endl;
+          exit(1);
+        }
+        if (particles_new.rng_count[i] != particles.rng_count[i]) {
+          std::cerr << "New particle rng_count is different." << std::endl;
+          exit(1);
+        }
       }
     }
     MPI_Barrier(MPI_COMM_WORLD);
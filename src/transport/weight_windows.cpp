@@ -0,0 +1,272 @@
+//------------------------------------------------------------
+// weight_windows.cpp
+// This file contains the importance-based splitting and
+// russian roulette of photon packets. Each zone is given an
+// importance, and a target packet energy inversely
+// proportional to it. Packets entering a zone with more than
+// width times the target energy are split into copies, and
+// those with less than 1/width of it are rouletted, so that
+// the packets are spent where they reach the spectrum
+//------------------------------------------------------------
+
+#include <math.h>
+#include "transport.h"
+#include "physical_constants.h"
+
+using std::cout;
+using std::cerr;
+namespace pc = physical_constants;
+
+static int thread_num()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+//------------------------------------------------------------
+// Set the importance of each zone and the reference packet
+// energy for this step. The importance is 1/(1 + tau), where
+// tau is the Rosseland mean optical depth from the middle of
+// the zone radially out to the edge of the grid, and is
+// bounded below by importance_min_. The reference energy,
+// that of packets in zones of importance 1, is the mean over
+// all packets on all ranks of their energy times the
+// importance of their zone
+//------------------------------------------------------------
+void transport::set_weight_windows()
+{
+  int nz = grid->n_zones;
+  double tau_max = 1.0/importance_min_ - 1;
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int i=0;i<nz;i++)
+  {
+    // start from the middle of the zone and head outward
+    std::vector<double> u(3,0.5);
+    double x[3], D[3];
+    grid->sample_in_zone(i,u,x);
+    double r = sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2]);
+    if (r > 0) {D[0] = x[0]/r; D[1] = x[1]/r; D[2] = x[2]/r; }
+    else       {D[0] = 0;      D[1] = 0;      D[2] = 1; }
+
+    // optical depth along the ray, no further than needed
+    double tau = 0;
+    int ind = i;
+    for (int n=0;(ind >= 0)&&(tau < tau_max)&&(n <= nz);n++)
+    {
+      double d = 0;
+      int next = grid->get_next_zone(x,D,ind,r_core_,&d);
+      tau += rosseland_mean_opacity_[ind]*d;
+      x[0] += d*D[0];
+      x[1] += d*D[1];
+      x[2] += d*D[2];
+      ind = next;
+    }
+    importance_[i] = 1.0/(1.0 + tau);
+    if (importance_[i] < importance_min_) importance_[i] = importance_min_;
+  }
+
+  // reference energy that keeps the expected number of
+  // packets the same once all are inside their windows
+  double sum[2] = {0, (double)particles.size()};
+  int n = particles.size();
+  double e_sum = 0;
+  #pragma omp parallel for schedule(static) reduction(+:e_sum)
+  for (int i=0;i<n;i++)
+  {
+    int ind = particles.ind[i];
+    e_sum += particles.e[i]*(((ind >= 0)&&(ind < nz)) ? importance_[ind] : 1.0);
+  }
+  sum[0] = e_sum;
+#ifdef MPI_PARALLEL
+  MPI_Allreduce(MPI_IN_PLACE,sum,2,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif
+  weight_window_e_ref_ = 0;
+  if (sum[1] > 0) weight_window_e_ref_ = sum[0]/sum[1];
+
+  for (size_t t=0;t<weight_window_counts_.size();t++)
+  {
+    WeightWindowCounts &c = weight_window_counts_[t];
+    c.n_split = c.n_copies = c.n_roulette = c.n_survived = 0;
+    c.e_split_in = c.e_split_out = c.e_roulette_in = c.e_roulette_out = c.e_roulette_var = 0;
+  }
+  n_split_pending_ = 0;
+}
+
+//------------------------------------------------------------
+// Split or roulette a photon packet that has just entered
+// zone p.ind, if its energy is outside the weight window of
+// the zone. Split copies get new random number streams and
+// are put on this thread's split buffer, to be propagated
+// after the particle store. Returns absorbed if the packet
+// lost the roulette, otherwise moving
+//------------------------------------------------------------
+ParticleFate transport::apply_weight_window(particle &p, RNG_stream &rng)
+{
+  if ((p.type != photon)||(p.ind < 0)||(weight_window_e_ref_ <= 0)) return moving;
+
+  int t = thread_num();
+  WeightWindowCounts &c = weight_window_counts_[t];
+  double e_target = weight_window_e_ref_/importance_[p.ind];
+
+  // ---------------------------------
+  // russian roulette: survive with probability
+  // e/e_target, carrying the target energy
+  // ---------------------------------
+  if (p.e*weight_window_width_ < e_target)
+  {
+    c.n_roulette++;
+    c.e_roulette_in += p.e;
+    c.e_roulette_var += p.e*(e_target - p.e);
+    if (rng.uniform()*e_target < p.e)
+    {
+      c.n_survived++;
+      c.e_roulette_out += e_target;
+      p.e = e_target;
+      return moving;
+    }
+    p.e = 0;
+    return absorbed;
+  }
+
+  // ---------------------------------
+  // splitting into n packets of equal energy
+  // ---------------------------------
+  if (p.e > e_target*weight_window_width_)
+  {
+    int n = (int)ceil(p.e/e_target);
+    if (n > weight_window_max_split_) n = weight_window_max_split_;
+
+    // don't go over the maximum number of particles
+    int n_pending;
+    #pragma omp atomic capture
+    n_pending = n_split_pending_ += (n - 1);
+    if (particles.size() + n_pending > max_total_particles)
+    {
+      #pragma omp atomic
+      n_split_pending_ -= (n - 1);
+      return moving;
+    }
+
+    c.n_split++;
+    c.n_copies += n - 1;
+    c.e_split_in += p.e;
+    p.e = p.e/n;
+    c.e_split_out += n*p.e;
+
+    // copies follow their own streams, with ids drawn from
+    // the parent's stream so that they do not depend on the
+    // thread or rank; the top bit keeps them apart from the
+    // ids handed out by new_streams()
+    particle copy = p;
+    copy.rng_count = 0;
+    for (int k=1;k<n;k++)
+    {
+      uint64_t hi = (uint64_t)(rng.uniform()*9007199254740992.0);
+      uint64_t lo = (uint64_t)(rng.uniform()*9007199254740992.0);
+      copy.rng_id = (1ULL << 63) | (hi << 10) | (lo & 0x3ff);
+      split_buffers_[t].push_back(copy);
+    }
+  }
+  return moving;
+}
+
+//------------------------------------------------------------
+// Propagate the copies made by splitting during the step
+// until they (and their own copies) escape, are absorbed,
+// or reach the end of the step. The copies are added to the
+// end of the particle store, then checked for energy
+// conservation
+//------------------------------------------------------------
+void transport::propagate_split_particles(double dt)
+{
+  int n_start = particles.size();
+  while (true)
+  {
+    // move this round of copies onto the particle store
+    int n_old = particles.size();
+    int n_copies = 0;
+    for (size_t t=0;t<split_buffers_.size();t++) n_copies += split_buffers_[t].size();
+    if (n_copies == 0) break;
+    particles.resize(n_old + n_copies);
+    int j = n_old;
+    for (size_t t=0;t<split_buffers_.size();t++)
+    {
+      ParticleStore &buffer = split_buffers_[t];
+      for (int i=0;i<buffer.size();i++) particles.copy(j++,buffer,i);
+      buffer.clear();
+    }
+    n_split_pending_ = 0;
+
+    // copies made at a zone edge keep the zone they were
+    // given rather than being located again
+    #pragma omp parallel for schedule(guided)
+    for (int i=n_old;i<n_old+n_copies;i++)
+    {
+      particle p = particles.get(i);
+      RNG_stream rng = rangen.stream(p.rng_id,p.rng_count);
+      p.fate = propagate(p,dt,rng,false);
+      p.rng_count = rng.count();
+      if (p.fate == escaped) record_escaped_particle(p);
+      particles.set(i,p);
+    }
+  }
+
+  // ---------------------------------
+  // sum up the counts of all threads and ranks, and check
+  // that splitting conserved energy and roulette did on average
+  // ---------------------------------
+  WeightWindowCounts s = {0,0,0,0,0,0,0,0,0};
+  for (size_t t=0;t<weight_window_counts_.size();t++)
+  {
+    WeightWindowCounts &c = weight_window_counts_[t];
+    s.n_split += c.n_split;
+    s.n_copies += c.n_copies;
+    s.n_roulette += c.n_roulette;
+    s.n_survived += c.n_survived;
+    s.e_split_in += c.e_split_in;
+    s.e_split_out += c.e_split_out;
+    s.e_roulette_in += c.e_roulette_in;
+    s.e_roulette_out += c.e_roulette_out;
+    s.e_roulette_var += c.e_roulette_var;
+  }
+  long n_added = particles.size() - n_start;
+#ifdef MPI_PARALLEL
+  long n_sum[5] = {s.n_split, s.n_copies, s.n_roulette, s.n_survived, n_added};
+  double e_sum[5] = {s.e_split_in, s.e_split_out, s.e_roulette_in, s.e_roulette_out, s.e_roulette_var};
+  MPI_Allreduce(MPI_IN_PLACE,n_sum,5,MPI_LONG,MPI_SUM,MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE,e_sum,5,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+  s.n_split = n_sum[0];
+  s.n_copies = n_sum[1];
+  s.n_roulette = n_sum[2];
+  s.n_survived = n_sum[3];
+  n_added = n_sum[4];
+  s.e_split_in = e_sum[0];
+  s.e_split_out = e_sum[1];
+  s.e_roulette_in = e_sum[2];
+  s.e_roulette_out = e_sum[3];
+  s.e_roulette_var = e_sum[4];
+#endif
+  if (!verbose) return;
+
+  cout << "# Weight windows         (" << s.n_split << " packets split into " << s.n_copies
+       << " copies, " << s.n_roulette << " rouletted (" << s.n_survived << " survived); "
+       << n_added << " copies added)\n";
+
+  if (fabs(s.e_split_out - s.e_split_in) > 1e-10*s.e_split_in)
+    cerr << "# WARNING: splitting did not conserve energy: " << s.e_split_in
+         << " ergs in, " << s.e_split_out << " ergs out\n";
+
+  // roulette conserves energy only on average, so
+  // flag a difference of many standard deviations
+  if (s.n_roulette > 0)
+  {
+    double e_diff = s.e_roulette_out - s.e_roulette_in;
+    if (fabs(e_diff) > 5*sqrt(s.e_roulette_var) + 1e-10*s.e_roulette_in)
+      cerr << "# WARNING: roulette energy out of balance: " << s.e_roulette_in
+           << " ergs in, " << s.e_roulette_out << " ergs out\n";
+  }
+}
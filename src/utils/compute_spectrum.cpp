@@ -44,6 +44,7 @@ int main(int argc, char **argv){
     std::vector<int> file_rank_id = params.getVector<int>("spectrum_calc_file_to_rank");
     std::string chk_spectrum_fname = params.getScalar<std::string>("spectrum_calc_chk_file");
     std::string out_spectrum_fname = params.getScalar<std::string>("spectrum_calc_out_file");
+    int read_chunk = params.getScalar<int>("spectrum_calc_read_chunk");
     int save_particles = params.getScalar<int>("spectrum_calc_save_particles");
     std::string save_particles_fname = params.getScalar<std::string>("spectrum_calc_save_particles_file");
 
@@ -83,37 +84,51 @@ int main(int argc, char **argv){
 
     transport* transport_dummy = new transport;
     transport_dummy->setup_MPI();
-    std::vector<particle> saved_particles;
+    ParticleStore saved_particles;
+    const char* fields[] = {"type", "x", "D", "x_interact", "ind", "t", "e",
+      "nu", "gamma", "dshift", "dvds", "fate"};
+    if (read_chunk < 1) read_chunk = 1;
+    ParticleStore particle_list;
     for (auto i_fname = my_fnames.begin(); i_fname != my_fnames.end(); i_fname++) {
-      std::vector<particle> particle_list;
       std::string fname = *i_fname;
-      transport_dummy->readCheckpointParticles(particle_list, fname, "particles_escaped", false, true);
-      // Divide particle energy by number of processes to undo multiplication that happens on
-      // reading in a particle list from checkpoint
-      for (auto i_part = particle_list.begin(); i_part != particle_list.end(); i_part++) {
-        i_part->e = i_part->e / nprocs;
-      }
-      for (auto i_part = particle_list.begin(); i_part != particle_list.end(); i_part++) {
-        double time_phys = i_part->t + i_part->x_dot_d() / pc::c;
-        double x_inter_x_sep[3] = {i_part->x_interact[0] - i_part->x[0],
-          i_part->x_interact[1] - i_part->x[1], i_part->x_interact[2] - i_part->x[2]};
-        double x_interact_dist = sqrt(x_inter_x_sep[0] * x_inter_x_sep[0] +
-              x_inter_x_sep[1] * x_inter_x_sep[1] + x_inter_x_sep[2] * x_inter_x_sep[2]);
-        double time_interact = time_phys - x_interact_dist / pc::c;
-        int time_filt_flag = between(i_part->t, time_filter);
-        int time_phys_filt_flag = between(time_phys, time_phys_filter);
-        int energy_filt_flag = between(i_part->e, energy_filter);
-        int mu_filt_flag = between(i_part->D[2], mu_filter);
-        int nu_filt_flag = between(i_part->nu, nu_filter);
-        int vel_filt_flag = between(i_part->r_interact() / time_interact / pc::c, vel_filter);
-        int filt_flag = time_filt_flag * time_phys_filt_flag * energy_filt_flag *
-            mu_filt_flag * nu_filt_flag * vel_filt_flag;
-
-        if (filt_flag) {
-          spectrum.count(i_part->t, i_part->nu, i_part->e, i_part->D);
-          if (save_particles)
-            saved_particles.push_back(*i_part);
-        } 
+      // particle files (checkpoint lists or escaped particle streams)
+      // are read in chunks so that they need not fit in memory
+      hsize_t n_total;
+      getH5dims(fname, "particles_escaped", "e", &n_total);
+      for (hsize_t offset = 0; offset < n_total; offset += read_chunk) {
+        int n_read = read_chunk;
+        if (offset + n_read > n_total) n_read = n_total - offset;
+        particle_list.resize(n_read);
+        for (int k = 0; k < 12; k++)
+          transport_dummy->readParticleProp(fname, fields[k], "particles_escaped", particle_list, n_total, offset);
+        // Divide particle energy by number of processes to undo multiplication that happens on
+        // reading in a particle list from checkpoint
+        for (int i = 0; i < particle_list.size(); i++) {
+          particle_list.e[i] = particle_list.e[i] / nprocs;
+        }
+        for (int i = 0; i < particle_list.size(); i++) {
+          particle p = particle_list.get(i);
+          double time_phys = p.t + p.x_dot_d() / pc::c;
+          double x_inter_x_sep[3] = {p.x_interact[0] - p.x[0],
+            p.x_interact[1] - p.x[1], p.x_interact[2] - p.x[2]};
+          double x_interact_dist = sqrt(x_inter_x_sep[0] * x_inter_x_sep[0] +
+                x_inter_x_sep[1] * x_inter_x_sep[1] + x_inter_x_sep[2] * x_inter_x_sep[2]);
+          double time_interact = time_phys - x_interact_dist / pc::c;
+          int time_filt_flag = between(p.t, time_filter);
+          int time_phys_filt_flag = between(time_phys, time_phys_filter);
+          int energy_filt_flag = between(p.e, energy_filter);
+          int mu_filt_flag = between(p.D[2], mu_filter);
+          int nu_filt_flag = between(p.nu, nu_filter);
+          int vel_filt_flag = between(p.r_interact() / time_interact / pc::c, vel_filter);
+          int filt_flag = time_filt_flag * time_phys_filt_flag * energy_filt_flag *
+              mu_filt_flag * nu_filt_flag * vel_filt_flag;
+
+          if (filt_flag) {
+            spectrum.count(p.t, p.nu, p.e, p.D);
+            if (save_particles)
+              saved_particles.push_back(p);
+          } 
+        }
       }
     }
 
@@ -125,9 +140,6 @@ int main(int argc, char **argv){
     }
 
     if (save_particles) {
-      for (auto i_part = saved_particles.begin(); i_part != saved_particles.end(); i_part++) {
-        i_part->e = i_part->e;
-      }
       if (verbose)
         createFile(save_particles_fname);
       transport_dummy->writeCheckpointParticles(saved_particles, save_particles_fname, "particles_filtered");
@@ -0,0 +1,247 @@
+#ifndef _FASTMATH_H
+#define _FASTMATH_H 1
+
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+//**********************************************************
+// Inline exp, log, pow and atan2 for the hot loops.
+//
+// These are plain range reduction + polynomial kernels,
+// with no calls into libm, no table lookups and no
+// branches, so loops over arrays of them can be vectorized
+// by the compiler; the batch versions loop over arrays with
+// an omp simd hint. With gcc this needs -fno-trapping-math
+// (set in make.exec), and gets 2 doubles per instruction
+// with plain SSE2 and 4 or 8 with -march=native. One at a
+// time, they are no faster than a good libm, so use the
+// batch versions in loops. Special arguments (zeros,
+// infinities, nans, subnormals) give the same results as
+// libm, except for pow of negative x, which is passed to
+// libm by the scalar version and is nan in the batch one.
+//
+// The relative error of the kernels (not counting the
+// roundoff of a few ulp) is bounded by SEDONA_FASTMATH_TOL,
+// which sets the polynomial degrees at compile time, e.g.
+//   SEDONA_FASTMATH_TOL=1e-8 ./install.sh MACHINE
+// The default is close to libm. pow(x,y) adds an error of
+// about |y*log(x)|*1e-16 on top, like exp(y*log(x)) does.
+//**********************************************************
+
+#ifndef SEDONA_FASTMATH_TOL
+#define SEDONA_FASTMATH_TOL 1e-15
+#endif
+
+namespace fastmath
+{
+
+  //------------------------------------------------------
+  // compile time choice of the polynomial degrees
+  //------------------------------------------------------
+  constexpr double ipow(const double x, const int n)
+    {return (n == 0) ? 1.0 : x*ipow(x,n-1); }
+  constexpr double factorial(const int n)
+    {return (n <= 1) ? 1.0 : n*factorial(n-1); }
+
+  // exp: taylor series of degree d on |r| <= log(2)/2
+  constexpr int exp_degree(const double tol, const int d = 3)
+    {return ((ipow(0.3466,d+1)/factorial(d+1) <= tol)||(d >= 13)) ? d : exp_degree(tol,d+1); }
+
+  // log and atan: series in s = f^2 with k terms, for
+  // s <= (3 - 2 sqrt(2))^2 (log) and tan(pi/16)^2 (atan)
+  constexpr int series_terms(const double s_max, const double tol, const int k = 2)
+    {return ((ipow(s_max,k)/(2*k+1) <= tol)||(k >= 12)) ? k : series_terms(s_max,tol,k+1); }
+
+  constexpr int EXP_DEGREE = exp_degree(SEDONA_FASTMATH_TOL);
+  constexpr int LOG_TERMS  = series_terms(0.02944,SEDONA_FASTMATH_TOL);
+  constexpr int ATAN_TERMS = series_terms(0.03957,SEDONA_FASTMATH_TOL);
+
+  //------------------------------------------------------
+  // constants
+  //------------------------------------------------------
+  const double LN2_HI  = 6.93147180369123816490e-01;
+  const double LN2_LO  = 1.90821492927058770002e-10;
+  const double LOG2E   = 1.44269504088896338700e+00;
+  const double SQRT2   = 1.41421356237309504880e+00;
+  const double PI      = 3.14159265358979323846e+00;
+  const double TAN_PI8 = 4.14213562373095048802e-01;
+  const double TAN_3PI16 = 6.68178637919298919997e-01;
+  const double TAN_PI16  = 1.98912367379658006912e-01;
+  // adding and subtracting this rounds to the nearest integer
+  const double ROUND_MAGIC = 6755399441055744.0;
+  const double TWO52 = 4503599627370496.0;
+  const double TWO54 = 18014398509481984.0;
+
+  inline uint64_t as_bits(const double x)
+    {uint64_t u; memcpy(&u,&x,sizeof(u)); return u; }
+  inline double as_double(const uint64_t u)
+    {double x; memcpy(&x,&u,sizeof(x)); return x; }
+
+  //------------------------------------------------------
+  // polynomial coefficients: 1/k! (exp), 1/(2k+1) (log)
+  // and (-1)^k/(2k+1) (atan)
+  //------------------------------------------------------
+  const double EXP_COEF[14] = {1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720,
+    1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600,
+    1.0/6227020800.0};
+  const double LOG_COEF[12] = {1.0, 1.0/3, 1.0/5, 1.0/7, 1.0/9, 1.0/11, 1.0/13,
+    1.0/15, 1.0/17, 1.0/19, 1.0/21, 1.0/23};
+  const double ATAN_COEF[12] = {1.0, -1.0/3, 1.0/5, -1.0/7, 1.0/9, -1.0/11, 1.0/13,
+    -1.0/15, 1.0/17, -1.0/19, 1.0/21, -1.0/23};
+
+  //------------------------------------------------------
+  // c[0] + c[1] x + ... + c[N] x^N, unrolled at compile
+  // time (a loop over the coefficients keeps the callers
+  // from being vectorized). Horner's rule in x^2 over the
+  // pairs c[k] + c[k+1] x, which halves the chain of
+  // dependent multiply-adds
+  //------------------------------------------------------
+  template <int N> inline double poly(const double x, const double x2, const double *c)
+    {return (c[0] + x*c[1]) + x2*poly<N-2>(x,x2,c+2); }
+  template <> inline double poly<1>(const double x, const double x2, const double *c)
+    {return c[0] + x*c[1]; }
+  template <> inline double poly<0>(const double x, const double x2, const double *c)
+    {return c[0]; }
+  template <int N> inline double poly(const double x, const double *c)
+    {return poly<N>(x,x*x,c); }
+
+  //------------------------------------------------------
+  // 2^k for an integer k stored as k + ROUND_MAGIC
+  // in t, with -1022 <= k <= 1023
+  //------------------------------------------------------
+  inline double pow2(const double t)
+  {
+    return as_double((as_bits(t) - as_bits(ROUND_MAGIC) + 1023) << 52);
+  }
+
+  //------------------------------------------------------
+  // exp(x) = 2^k exp(r), with |r| <= log(2)/2
+  //------------------------------------------------------
+  inline double exp_kernel(const double x)
+  {
+    double t  = x*LOG2E + ROUND_MAGIC;
+    double kf = t - ROUND_MAGIC;
+    double r  = (x - kf*LN2_HI) - kf*LN2_LO;
+
+    double p = poly<EXP_DEGREE>(r,EXP_COEF);
+
+    // scale by 2^k in two steps, so that neither factor
+    // over- or underflows
+    double t1 = 0.5*kf + ROUND_MAGIC;
+    double t2 = (kf - (t1 - ROUND_MAGIC)) + ROUND_MAGIC;
+    double val = p*pow2(t1)*pow2(t2);
+
+    // outside of this range the result is 0 or inf, and the
+    // above is not valid. The special cases are selected at
+    // the end, as anything conditional that comes before
+    // can keep the compiler from vectorizing
+    return isgreater(x,710.0) ? HUGE_VAL : (isless(x,-746.0) ? 0.0 : val);
+  }
+
+  //------------------------------------------------------
+  // log(x) = e log(2) + log(m), with sqrt(1/2) <= m < sqrt(2)
+  //------------------------------------------------------
+  inline double log_kernel(const double x)
+  {
+    // scale up subnormals
+    double xs = x*(isless(x,DBL_MIN) ? TWO54 : 1.0);
+
+    uint64_t u = as_bits(xs);
+    uint64_t eb = u >> 52;
+    double m = as_double((u & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+    // exponent as a double, exactly
+    double e = as_double(eb | as_bits(TWO52)) - TWO52 - 1023;
+    e += isless(x,DBL_MIN) ? -54.0 : 0.0;
+    e += isgreater(m,SQRT2) ? 1.0 : 0.0;
+    m *= isgreater(m,SQRT2) ? 0.5 : 1.0;
+
+    double f = (m - 1)/(m + 1);
+    double s = f*f;
+    double p = poly<LOG_TERMS-1>(s,LOG_COEF);
+    double val = e*LN2_HI + (e*LN2_LO + 2*f*p);
+
+    return isgreater(x,0.0) ? (islessequal(x,DBL_MAX) ? val : x) : ((x == 0) ? -HUGE_VAL : NAN);
+  }
+
+  //------------------------------------------------------
+  // atan(t) for 0 <= t <= 1, reduced to |v| <= tan(pi/16)
+  // around the nearest of 0, pi/8 and pi/4
+  //------------------------------------------------------
+  inline double atan_kernel(const double t)
+  {
+    double c = isgreater(t,TAN_3PI16) ? 1.0 : (isgreater(t,TAN_PI16) ? TAN_PI8 : 0.0);
+    double a = isgreater(t,TAN_3PI16) ? 0.25*PI : (isgreater(t,TAN_PI16) ? 0.125*PI : 0.0);
+    double v = (t - c)/(1 + t*c);
+    double s = v*v;
+    double p = poly<ATAN_TERMS-1>(s,ATAN_COEF);
+    return a + v*p;
+  }
+
+  //------------------------------------------------------
+  // atan2(y,x) from atan of min(|x|,|y|)/max(|x|,|y|)
+  //------------------------------------------------------
+  inline double atan2_kernel(const double y, const double x)
+  {
+    double ax = fabs(x), ay = fabs(y);
+    double a = isless(ax,ay) ? ax : ay;
+    double b = isless(ax,ay) ? ay : ax;
+    double q = a/b;
+    double t = isgreater(b,0.0) ? ((a == b) ? 1.0 : q) : 0.0;
+    double r = atan_kernel(t);
+    r = isgreater(ay,ax) ? 0.5*PI - r : r;
+    // signs from copysign rather than signbit, which does
+    // not vectorize
+    r = isless(copysign(1.0,x),0.0) ? PI - r : r;
+    r = copysign(r,y);
+    return ((x == x)&&(y == y)) ? r : x + y;
+  }
+
+  //------------------------------------------------------
+  // scalar versions
+  //------------------------------------------------------
+  inline double exp(const double x) {return exp_kernel(x); }
+  inline double log(const double x) {return log_kernel(x); }
+  inline double atan2(const double y, const double x) {return atan2_kernel(y,x); }
+
+  inline double pow(const double x, const double y)
+  {
+    if (!(x > 0)) return ::pow(x,y);
+    if (y == 0) return 1;
+    return exp_kernel(y*log_kernel(x));
+  }
+
+  //------------------------------------------------------
+  // batch versions, out[i] = f(in[i]) for i < n.
+  // The input and output arrays may be the same
+  //------------------------------------------------------
+  inline void exp(const double *x, double *y, const int n)
+  {
+    #pragma omp simd
+    for (int i=0;i<n;i++) y[i] = exp_kernel(x[i]);
+  }
+
+  inline void log(const double *x, double *y, const int n)
+  {
+    #pragma omp simd
+    for (int i=0;i<n;i++) y[i] = log_kernel(x[i]);
+  }
+
+  // x[i]^p, for x[i] >= 0 (nan otherwise)
+  inline void pow(const double *x, const double p, double *y, const int n)
+  {
+    if (p == 0) {for (int i=0;i<n;i++) y[i] = 1; return; }
+    #pragma omp simd
+    for (int i=0;i<n;i++) y[i] = exp_kernel(p*log_kernel(x[i]));
+  }
+
+  inline void atan2(const double *y, const double *x, double *r, const int n)
+  {
+    #pragma omp simd
+    for (int i=0;i<n;i++) r[i] = atan2_kernel(y[i],x[i]);
+  }
+
+}
+
+#endif
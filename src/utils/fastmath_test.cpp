@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdio.h>
+#include <ctime>
+#include <vector>
+#include <iostream>
+#include "fastmath.h"
+
+//------------------------------------------------------------
+// Accuracy of the fastmath functions against libm, and the
+// speed of their batch versions compared to libm loops.
+// Returns nonzero if an error is above the bound
+//------------------------------------------------------------
+
+double cpu_time()
+{
+  return ((double)clock())/(double)CLOCKS_PER_SEC;
+}
+
+// simple reproducible uniform random numbers in [0,1)
+double lcg_uniform(unsigned long long &state)
+{
+  state = state*6364136223846793005ULL + 1442695040888963407ULL;
+  return (state >> 11)*(1.0/9007199254740992.0);
+}
+
+double rel_err(const double a, const double b)
+{
+  if (a == b) return 0;
+  return fabs(a - b)/fabs(b);
+}
+
+int n_fail = 0;
+
+void report(const char *name, const double err, const double bound)
+{
+  int ok = (err <= bound);
+  if (!ok) n_fail++;
+  printf("  %-32s max rel err %10.3e  (bound %10.3e)  %s\n",name,err,bound,ok ? "ok" : "FAIL");
+}
+
+void check_special(const char *name, const double a, const double b)
+{
+  int ok = (a == b) || (isnan(a) && isnan(b)) || (rel_err(a,b) <= SEDONA_FASTMATH_TOL + 8*DBL_EPSILON);
+  if (ok && (a == 0) && (b == 0)) ok = (signbit(a) == signbit(b));
+  if (!ok) n_fail++;
+  if (!ok) printf("  special %-24s got %g, libm %g  FAIL\n",name,a,b);
+}
+
+int main()
+{
+  const int n = 4000000;
+  const double tol = SEDONA_FASTMATH_TOL;
+  // allow for the roundoff of the kernels
+  const double ulps = 8*DBL_EPSILON;
+  unsigned long long state = 12345;
+
+  printf("# SEDONA_FASTMATH_TOL = %g (exp degree %d, log terms %d, atan terms %d)\n",
+    tol,fastmath::EXP_DEGREE,fastmath::LOG_TERMS,fastmath::ATAN_TERMS);
+
+  std::vector<double> x(n), y(n), z(n), ref(n);
+
+  //-----------------------------------------
+  // exp over its whole range, and on [-1,0]
+  //-----------------------------------------
+  double err = 0;
+  for (int i=0;i<n;i++) x[i] = -745 + 1454*lcg_uniform(state);
+  fastmath::exp(x.data(),y.data(),n);
+  for (int i=0;i<n;i++)
+    if (fabs(exp(x[i])) > DBL_MIN) err = std::max(err,rel_err(y[i],exp(x[i])));
+  report("exp(x), -745 < x < 709",err,tol + ulps);
+
+  err = 0;
+  for (int i=0;i<n;i++) x[i] = -lcg_uniform(state);
+  fastmath::exp(x.data(),y.data(),n);
+  for (int i=0;i<n;i++) err = std::max(err,rel_err(y[i],exp(x[i])));
+  report("exp(x), -1 < x < 0",err,tol + ulps);
+
+  //-----------------------------------------
+  // log over the whole range, near 1, and of 1 - u
+  //-----------------------------------------
+  err = 0;
+  for (int i=0;i<n;i++) x[i] = pow(10.0,-300 + 600*lcg_uniform(state));
+  fastmath::log(x.data(),y.data(),n);
+  for (int i=0;i<n;i++) err = std::max(err,rel_err(y[i],log(x[i])));
+  report("log(x), 1e-300 < x < 1e300",err,tol + ulps);
+
+  err = 0;
+  for (int i=0;i<n;i++) x[i] = 0.5 + lcg_uniform(state);
+  fastmath::log(x.data(),y.data(),n);
+  for (int i=0;i<n;i++) err = std::max(err,rel_err(y[i],log(x[i])));
+  report("log(x), 0.5 < x < 1.5",err,tol + ulps);
+
+  err = 0;
+  for (int i=0;i<n;i++) x[i] = 1 - lcg_uniform(state);
+  fastmath::log(x.data(),y.data(),n);
+  for (int i=0;i<n;i++) err = std::max(err,rel_err(y[i],log(x[i])));
+  report("log(1-u), 0 <= u < 1",err,tol + ulps);
+
+  //-----------------------------------------
+  // pow, including the photoelectric nu^-3.5
+  //-----------------------------------------
+  double powers[] = {-3.5, -1.5, 0.5, 3.0};
+  for (int k=0;k<4;k++)
+  {
+    double p = powers[k];
+    err = 0;
+    double bound = 0;
+    for (int i=0;i<n;i++) x[i] = pow(10.0,-10 + 20*lcg_uniform(state));
+    fastmath::pow(x.data(),p,y.data(),n);
+    for (int i=0;i<n;i++)
+    {
+      err = std::max(err,rel_err(y[i],pow(x[i],p)));
+      bound = std::max(bound,tol*(1 + fabs(p*log(x[i]))) + ulps*(1 + fabs(p*log(x[i]))));
+    }
+    char name[100];
+    sprintf(name,"pow(x,%g), 1e-10 < x < 1e10",p);
+    report(name,err,bound);
+  }
+
+  //-----------------------------------------
+  // atan2 of random directions
+  //-----------------------------------------
+  err = 0;
+  for (int i=0;i<n;i++)
+  {
+    double phi = 2*M_PI*lcg_uniform(state);
+    double r = pow(10.0,-5 + 10*lcg_uniform(state));
+    x[i] = r*cos(phi);
+    z[i] = r*sin(phi);
+  }
+  fastmath::atan2(z.data(),x.data(),y.data(),n);
+  for (int i=0;i<n;i++) err = std::max(err,rel_err(y[i],atan2(z[i],x[i])));
+  report("atan2(y,x)",err,tol + ulps);
+
+  //-----------------------------------------
+  // special values
+  //-----------------------------------------
+  double inf = HUGE_VAL;
+  double specials[] = {0.0, -0.0, 1.0, -1.0, 1e-310, DBL_MIN, DBL_MAX, inf, -inf, NAN};
+  int ns = 10;
+  for (int i=0;i<ns;i++)
+  {
+    double a = specials[i];
+    check_special("exp",fastmath::exp(a),exp(a));
+    check_special("log",fastmath::log(a),log(a));
+    check_special("pow(x,-3.5)",fastmath::pow(a,-3.5),pow(a,-3.5));
+    check_special("pow(x,0)",fastmath::pow(a,0.0),pow(a,0.0));
+    for (int j=0;j<ns;j++)
+    {
+      double b = specials[j];
+      if (fabs(b) == 1e-310) continue;
+      check_special("atan2",fastmath::atan2(a,b),atan2(a,b));
+    }
+  }
+  check_special("exp(-1000)",fastmath::exp(-1000.0),exp(-1000.0));
+  check_special("exp(1000)",fastmath::exp(1000.0),exp(1000.0));
+
+  //-----------------------------------------
+  // timing of the batch versions
+  //-----------------------------------------
+  printf("# timing (%d values)\n",n);
+  for (int i=0;i<n;i++) x[i] = -50*lcg_uniform(state);
+  double t0 = cpu_time();
+  for (int i=0;i<n;i++) ref[i] = exp(x[i]);
+  double t_libm = cpu_time() - t0;
+  t0 = cpu_time();
+  fastmath::exp(x.data(),y.data(),n);
+  double t_fast = cpu_time() - t0;
+  printf("  exp    libm %8.4f secs  fastmath %8.4f secs  speedup %6.2f\n",t_libm,t_fast,t_libm/t_fast);
+
+  for (int i=0;i<n;i++) x[i] = 1 - lcg_uniform(state);
+  t0 = cpu_time();
+  for (int i=0;i<n;i++) ref[i] = log(x[i]);
+  t_libm = cpu_time() - t0;
+  t0 = cpu_time();
+  fastmath::log(x.data(),y.data(),n);
+  t_fast = cpu_time() - t0;
+  printf("  log    libm %8.4f secs  fastmath %8.4f secs  speedup %6.2f\n",t_libm,t_fast,t_libm/t_fast);
+
+  for (int i=0;i<n;i++) x[i] = 0.01 + 10*lcg_uniform(state);
+  t0 = cpu_time();
+  for (int i=0;i<n;i++) ref[i] = pow(x[i],-3.5);
+  t_libm = cpu_time() - t0;
+  t0 = cpu_time();
+  fastmath::pow(x.data(),-3.5,y.data(),n);
+  t_fast = cpu_time() - t0;
+  printf("  pow    libm %8.4f secs  fastmath %8.4f secs  speedup %6.2f\n",t_libm,t_fast,t_libm/t_fast);
+
+  for (int i=0;i<n;i++) {x[i] = lcg_uniform(state) - 0.5; z[i] = lcg_uniform(state) - 0.5; }
+  t0 = cpu_time();
+  for (int i=0;i<n;i++) ref[i] = atan2(z[i],x[i]);
+  t_libm = cpu_time() - t0;
+  t0 = cpu_time();
+  fastmath::atan2(z.data(),x.data(),y.data(),n);
+  t_fast = cpu_time() - t0;
+  printf("  atan2  libm %8.4f secs  fastmath %8.4f secs  speedup %6.2f\n",t_libm,t_fast,t_libm/t_fast);
+
+  if (n_fail) printf("FAILURE: %d checks failed\n",n_fail);
+  else printf("SUCCESS\n");
+  return (n_fail != 0);
+}
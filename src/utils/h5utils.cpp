@@ -117,6 +117,85 @@ void writePatch(std::string file ,std::string group ,std::string dset, void* dat
   H5Fclose(h5fil);
 }
 
+void createExtendableDataset(std::string fname, std::string gname, std::string dname, int dim, int* chunk_size, hid_t type){
+  hid_t h5file  = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  hid_t h5group = H5Gopen1(h5file, gname.c_str());
+
+  std::vector<hsize_t> fdims(dim), maxdims(dim), cdims(dim);
+  for (int d=0 ; d<dim ; ++d){
+    fdims[d]   = chunk_size[d];
+    maxdims[d] = chunk_size[d];
+    cdims[d]   = chunk_size[d];
+  }
+  fdims[0]   = 0;
+  maxdims[0] = H5S_UNLIMITED;
+
+  hid_t fspace = H5Screate_simple(dim,fdims.data(),maxdims.data());
+  hid_t plist  = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, dim, cdims.data());
+  hid_t h5dset = H5Dcreate2(h5group, dname.c_str(), type, fspace, H5P_DEFAULT, plist, H5P_DEFAULT);
+
+  H5Dclose(h5dset);
+  H5Pclose(plist);
+  H5Sclose(fspace);
+  H5Gclose(h5group);
+  H5Fclose(h5file);
+}
+
+void appendPatch(std::string file, std::string group, std::string dset, void* data, hid_t type, int dim, int* loc_size){
+  hid_t h5fil = H5Fopen(file.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  hid_t h5grp = H5Gopen1(h5fil, group.c_str());
+  hid_t h5dst = H5Dopen1(h5grp, dset.c_str());
+
+  // current size of the dataset
+  std::vector<hsize_t> fdims(dim), mdims(dim), fstart(dim);
+  hid_t fspace = H5Dget_space(h5dst);
+  H5Sget_simple_extent_dims(fspace, fdims.data(), NULL);
+  H5Sclose(fspace);
+
+  // grow the first dimension to fit the new entries
+  for (int d=0 ; d<dim ; ++d){
+    mdims[d]  = loc_size[d];
+    fstart[d] = 0;
+  }
+  fstart[0] = fdims[0];
+  fdims[0] += loc_size[0];
+  H5Dset_extent(h5dst, fdims.data());
+
+  fspace = H5Dget_space(h5dst);
+  hid_t mspace = H5Screate_simple(dim,mdims.data(),NULL);
+  H5Sselect_hyperslab(fspace, H5S_SELECT_SET, fstart.data(), NULL, mdims.data(), NULL);
+
+  H5Dwrite(h5dst, type, mspace, fspace, H5P_DEFAULT, data);
+
+  H5Sclose(mspace);
+  H5Sclose(fspace);
+  H5Dclose(h5dst);
+  H5Gclose(h5grp);
+  H5Fclose(h5fil);
+}
+
+void truncateDataset(std::string file, std::string group, std::string dset, hsize_t n){
+  hid_t h5fil = H5Fopen(file.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  hid_t h5grp = H5Gopen1(h5fil, group.c_str());
+  hid_t h5dst = H5Dopen1(h5grp, dset.c_str());
+
+  hid_t fspace = H5Dget_space(h5dst);
+  int dim = H5Sget_simple_extent_ndims(fspace);
+  std::vector<hsize_t> fdims(dim);
+  H5Sget_simple_extent_dims(fspace, fdims.data(), NULL);
+  H5Sclose(fspace);
+
+  if (fdims[0] > n){
+    fdims[0] = n;
+    H5Dset_extent(h5dst, fdims.data());
+  }
+
+  H5Dclose(h5dst);
+  H5Gclose(h5grp);
+  H5Fclose(h5fil);
+}
+
 hid_t openH5File(std::string fname) {
     hid_t h5fil = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     return h5fil;
@@ -35,6 +35,18 @@ void writeString(std::string file, std::string group, std::string dset, std::str
 // start is the offset of the patch in each dimension.
 void writePatch(std::string file, std::string group, std::string dset, void* data, hid_t type, int dim, int* start, int* loc_size, int* glo_size);
 
+// Creates a dataset that can grow along its first dimension, starting with zero
+// entries. chunk_size gives the HDF5 chunk dimensions (length dim).
+void createExtendableDataset(std::string fname, std::string gname, std::string dname, int dim, int* chunk_size, hid_t type);
+
+// Extends the first dimension of the extendable dataset file/group/dset by
+// loc_size[0] and writes the patch of size loc_size in data to the new entries.
+void appendPatch(std::string file, std::string group, std::string dset, void* data, hid_t type, int dim, int* loc_size);
+
+// Sets the first dimension of the extendable dataset file/group/dset to n,
+// discarding any entries past n.
+void truncateDataset(std::string file, std::string group, std::string dset, hsize_t n);
+
 template <typename T>
 void writeVector(std::string file, std::string group, std::string dset, std::vector<T>& vec, hid_t t) {
   T* buffer = vec.data();
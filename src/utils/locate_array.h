@@ -83,6 +83,27 @@ public:
   int    locate(const double) const;
   int    locate_within_bounds(const double xval) const;
 
+  //---------------------------------------------------------
+  // same result as locate_within_bounds, but starting from a
+  // guess of the bin (e.g. where the value was last time).
+  // Walks to the neighboring bins, so is O(1) when the value
+  // has only moved a bin or two. Falls back to the full
+  // search if the guess is out of range or too far off
+  //---------------------------------------------------------
+  int locate_from(const double xval, const int guess) const
+  {
+    const int n = (int)x_.size();
+    if ((guess < 0) || (guess >= n)) return locate_within_bounds(xval);
+    int ind = guess;
+    for (int k=0;k<4;k++)
+    {
+      if      ((ind < n-1) && (xval >= x_[ind]))  ind++;
+      else if ((ind > 0)   && (xval <  x_[ind-1])) ind--;
+      else return ind;
+    }
+    return locate_within_bounds(xval);
+  }
+
   double sample(const int, const double) const;
   void   print() const;
 
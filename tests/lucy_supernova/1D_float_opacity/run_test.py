@@ -0,0 +1,142 @@
+import os
+import matplotlib.pyplot as plt
+import numpy as np
+import sys
+
+# executable built with single precision opacity tables, e.g.
+#   SEDONA_FLOAT_OPACITY=1 ./install.sh MACHINE
+#   cp sedona6.ex sedona6_float.ex
+# then rebuild sedona6.ex in double precision as usual
+float_exec = "sedona6_float.ex"
+float_dir  = "float_opacity"
+
+
+def run_test(pdf="",runcommand=""):
+
+    ###########################################
+    # run the code with single precision
+    # opacities, move the results aside, then
+    # run the standard double precision code
+    ###########################################
+    if (runcommand != ""):
+        os.system("rm -rf " + float_dir)
+        os.system("rm optical_spectrum_* gamma_spectrum_* plt_* integrated_quantities.dat")
+        if (not os.path.isfile("../../../src/" + float_exec)):
+            print("no " + float_exec + " found in src/; build it with SEDONA_FLOAT_OPACITY=1")
+            return 1
+        os.system("cp ../../../src/" + float_exec + " .")
+        os.system(runcommand.replace("sedona6.ex",float_exec))
+        os.system("mkdir " + float_dir)
+        os.system("mv optical_spectrum_* gamma_spectrum_* plt_* integrated_quantities.dat " + float_dir)
+        os.system(runcommand)
+
+    ###########################################
+    # compare the output
+    ###########################################
+    plt.clf()
+    failure = 0
+
+    # double precision results
+    ts1,Ls1,c = np.loadtxt('optical_spectrum_final.dat',unpack=1,skiprows=1)
+    ts1 = ts1/3600.0/24.0
+    plt.plot(ts1,Ls1,color='k',lw=2)
+
+    # single precision results
+    ts2,Ls2,c = np.loadtxt(float_dir + '/optical_spectrum_final.dat',unpack=1,skiprows=1)
+    ts2 = ts2/3600.0/24.0
+    plt.plot(ts2,Ls2,'o',markeredgecolor='red',markersize=8,markeredgewidth=2,markerfacecolor='none')
+
+    # differences are monte carlo noise, the runs take
+    # different random walks once any opacity rounds differently
+    use = ((ts1 > 3)*(ts1 < 55))
+    max_err,mean_err = get_error(Ls2,Ls1,use=use)
+    print("light curve float vs double: max error = {:.3e}, mean error = {:.3e}".format(max_err,mean_err))
+    if (mean_err > 0.05): failure = 1
+
+    # radiation temperature profiles
+    for p in ['plt_00015.dat','plt_00030.dat','plt_00060.dat']:
+        v, Trad   = np.loadtxt(p,unpack=1,usecols=[2,4])
+        vf, Tradf = np.loadtxt(float_dir + '/' + p,unpack=1,usecols=[2,4])
+        use = (v > 1e8)*(v < 9.8e8)
+        max_err,mean_err = get_error(Tradf,Trad,use=use)
+        print(p + " T_rad float vs double: max error = {:.3e}, mean error = {:.3e}".format(max_err,mean_err))
+        if (mean_err > 0.02): failure = 2
+
+    ## make plot
+    plt.title('1D Lucy Supernova - single vs double precision opacity')
+    plt.legend(['double','float'])
+    plt.xlim(0,55)
+    plt.ylabel('luminosity (erg/s)',size=13)
+    plt.xlabel('days since explosion',size=13)
+    if (pdf != ''): pdf.savefig()
+    else:
+        plt.ion()
+        plt.show()
+        j = get_input()
+
+    return failure
+
+
+#-------------------------------------------
+# error calculator helper function
+#-------------------------------------------
+
+def get_error(a,b,x=[],x_comp=[],use=[]):
+
+    """ Function to calculate the error between two arrays
+
+        Args:
+        a: numpy array of result
+        b: numpy array of comparison
+        use: an array of 0's and 1's telling which element
+             in the arrays to include
+        x: optional array of x values to go along with a
+        x_comp: optional array of x values to go along with b
+        (if x and x_comp are set, will interpolate b values to x spacing)
+
+        Returns:
+            returns max_error, mean_error in percentages
+
+    """
+
+    # result array
+    y = a
+    # compare array
+    y_comp = b
+
+    # interpolate comparison if wanted
+    if (len(x) != 0 and len(x_comp !=0)):
+        y_comp = np.interp(x,x_comp,y_comp)
+
+    # cut the array length if wanted
+    if (len(use) > 0):
+        y = y[use]
+        y_comp = y_comp[use]
+    err = abs(y - y_comp)
+
+    max_err = max(err/y_comp)
+    mean_err = np.mean(err)/np.mean(y_comp)
+
+    return max_err,mean_err
+
+#-----------------------------------------
+# little function to just plot up and
+# compare results. Assumes code has
+# already been run and output files
+# are present
+#----------------------------------------
+if __name__=='__main__':
+
+    # Support Python 2 and 3 input
+    # Default to Python 3's input()
+    get_input = input
+
+    # If this is Python 2, use raw_input()
+    if sys.version_info[:2] <= (2, 7):
+        get_input = raw_input
+
+    status = run_test('')
+    if (status == 0):
+        print ('SUCCESS')
+    else:
+        print ('FAILURE, code = ' + str(status))
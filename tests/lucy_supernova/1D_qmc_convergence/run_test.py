@@ -0,0 +1,163 @@
+import os
+import timeit
+import matplotlib.pyplot as plt
+import numpy as np
+import sys
+
+# noise of the light curve and of the gamma-ray deposition
+# against the number of particles, for random and for
+# quasi-random (sobol) emission. The noise is the scatter
+# between runs with different seeds
+n_emit_list = [1e3,3e3,1e4]
+modes       = ["random","sobol"]
+seeds       = [1,2,3,4]
+
+
+def run_test(pdf="",runcommand=""):
+
+    days = 3600.0*24
+    # compare on a fixed time grid inside the run
+    t_grid = np.arange(21,29,0.5)
+
+    ###########################################
+    # run the code for all combinations
+    ###########################################
+    failure = 0
+    lc_noise  = {}
+    dep_noise = {}
+    lc_mean   = {}
+    walltime  = {}
+    for mode in modes:
+        lc_noise[mode]  = []
+        dep_noise[mode] = []
+        lc_mean[mode]   = []
+        walltime[mode]  = []
+        for n_emit in n_emit_list:
+            lcs  = []
+            deps = []
+            wt   = []
+            for seed in seeds:
+                if (runcommand != ""):
+                    os.system("rm -f optical_spectrum_* gamma_spectrum_* plt_* integrated_quantities.dat")
+                    os.system("cp param_base.lua param.lua")
+                    fout = open("param.lua","a")
+                    fout.write("particles_n_emit_radioactive = " + str(int(n_emit)) + "\n")
+                    fout.write("transport_rng_seed = " + str(seed) + "\n")
+                    fout.write("particles_emission_sampling = \"" + mode + "\"\n")
+                    fout.close()
+                    starttime = timeit.default_timer()
+                    os.system(runcommand)
+                    wt.append(timeit.default_timer() - starttime)
+                    os.system("rm param.lua")
+
+                ts,Ls,c = np.loadtxt('optical_spectrum_final.dat',unpack=1,skiprows=1)
+                lcs.append(np.interp(t_grid,ts/days,Ls))
+                ts,Ldep = np.loadtxt('integrated_quantities.dat',usecols=[0,2],unpack=1,skiprows=1)
+                deps.append(np.interp(t_grid,ts/days,Ldep))
+
+            lcs  = np.array(lcs)
+            deps = np.array(deps)
+            lc_noise[mode].append(np.mean(np.std(lcs,axis=0,ddof=1)/np.mean(lcs,axis=0)))
+            dep_noise[mode].append(np.mean(np.std(deps,axis=0,ddof=1)/np.mean(deps,axis=0)))
+            lc_mean[mode].append(np.mean(lcs,axis=0))
+            if (len(wt) > 0): walltime[mode].append(np.mean(wt))
+
+    ###########################################
+    # print and plot the noise
+    ###########################################
+    print("  n_emit   sampling   LC noise    L_dep noise   wall time (s)")
+    for mode in modes:
+        for i in range(len(n_emit_list)):
+            wt = walltime[mode][i] if (len(walltime[mode]) > i) else 0
+            print("{:8.0e}   {:8s}   {:10.4e}   {:10.4e}   {:10.2f}".format(
+                n_emit_list[i],mode,lc_noise[mode][i],dep_noise[mode][i],wt))
+
+    # scattering randomizes the particles after emission, so the
+    # gain is smaller than for the lightbulb; check that the
+    # quasi-random light curve is unbiased, and not noisier
+    max_err,mean_err = get_error(lc_mean["sobol"][-1],lc_mean["random"][-1])
+    print("mean light curve sobol vs random: max error = {:.3e}, mean error = {:.3e}".format(max_err,mean_err))
+    if (mean_err > 0.03): failure = 1
+    if (lc_noise["sobol"][-1] > 1.5*lc_noise["random"][-1]): failure = 2
+
+    plt.clf()
+    for mode,color in zip(modes,['black','red']):
+        plt.plot(n_emit_list,lc_noise[mode],'o-',color=color)
+        plt.plot(n_emit_list,dep_noise[mode],'s--',color=color)
+    plt.legend(['random light curve','random L_dep','sobol light curve','sobol L_dep'])
+    plt.title('1D Lucy Supernova - noise against particle number')
+    plt.xlabel('particles_n_emit_radioactive')
+    plt.ylabel('relative scatter between seeds')
+    plt.xscale('log')
+    plt.yscale('log')
+    if (pdf != ''): pdf.savefig()
+    else:
+        plt.ion()
+        plt.show()
+        j = get_input()
+
+    return failure
+
+
+#-------------------------------------------
+# error calculator helper function
+#-------------------------------------------
+
+def get_error(a,b,x=[],x_comp=[],use=[]):
+
+    """ Function to calculate the error between two arrays
+
+        Args:
+        a: numpy array of result
+        b: numpy array of comparison
+        use: an array of 0's and 1's telling which element
+             in the arrays to include
+        x: optional array of x values to go along with a
+        x_comp: optional array of x values to go along with b
+        (if x and x_comp are set, will interpolate b values to x spacing)
+
+        Returns:
+            returns max_error, mean_error in percentages
+
+    """
+
+    # result array
+    y = a
+    # compare array
+    y_comp = b
+
+    # interpolate comparison if wanted
+    if (len(x) != 0 and len(x_comp !=0)):
+        y_comp = np.interp(x,x_comp,y_comp)
+
+    # cut the array length if wanted
+    if (len(use) > 0):
+        y = y[use]
+        y_comp = y_comp[use]
+    err = abs(y - y_comp)
+
+    max_err = max(err/y_comp)
+    mean_err = np.mean(err)/np.mean(y_comp)
+
+    return max_err,mean_err
+
+#-----------------------------------------
+# little function to just plot up and
+# compare results. Reruns the code, as
+# the noise needs all the combinations
+#----------------------------------------
+if __name__=='__main__':
+
+    # Support Python 2 and 3 input
+    # Default to Python 3's input()
+    get_input = input
+
+    # If this is Python 2, use raw_input()
+    if sys.version_info[:2] <= (2, 7):
+        get_input = raw_input
+
+    status = run_test('',"mpirun -np 1 ./sedona6.ex param.lua")
+    if (status == 0):
+        print ('SUCCESS')
+    else:
+        print ('FAILURE, code = ' + str(status))
@@ -0,0 +1,186 @@
+import os
+import timeit
+import matplotlib.pyplot as plt
+import numpy as np
+import h5py
+import sys
+
+# convergence of the lightbulb results with the number of
+# particles, for random and for quasi-random (sobol) emission.
+# Each combination is run with a few seeds; the errors against
+# the analytic solution are averaged over the seeds
+n_emit_list = [1e3,1e4,1e5]
+modes       = ["random","sobol"]
+seeds       = [1,2,3]
+
+
+def run_test(pdf="",runcommand=""):
+
+    h   = 6.6260755e-27    # planck's constant (ergs-s)
+    c   = 2.99792458e10    # speed of light (cm/s)
+    k   = 1.380658e-16     # boltzmann constant (ergs/K)
+    sb  = 5.6704e-5        # stefan boltzman constant (ergs cm^-2 s^-1 K^-4)
+    pi  = 3.14159          # just pi
+
+    T   = 1e4
+    L  = 1e43
+    r0 = 0.5e15
+
+    ###########################################
+    # run the code for all combinations, and
+    # compare each run to the analytic solution
+    ###########################################
+    failure = 0
+    spec_err = {}
+    Jnu_err  = {}
+    walltime = {}
+    for mode in modes:
+        spec_err[mode] = []
+        Jnu_err[mode]  = []
+        walltime[mode] = []
+        for n_emit in n_emit_list:
+            es = []
+            ej = []
+            wt = []
+            for seed in seeds:
+                if (runcommand != ""):
+                    os.system("rm -f spectrum_* plt_* integrated_quantities.dat")
+                    os.system("cp param_base.lua param.lua")
+                    fout = open("param.lua","a")
+                    fout.write("core_n_emit = " + str(int(n_emit)) + "\n")
+                    fout.write("transport_rng_seed = " + str(seed) + "\n")
+                    fout.write("particles_emission_sampling = \"" + mode + "\"\n")
+                    fout.close()
+                    starttime = timeit.default_timer()
+                    os.system(runcommand)
+                    wt.append(timeit.default_timer() - starttime)
+                    os.system("rm param.lua")
+
+                # output spectrum against the blackbody
+                data = np.loadtxt('spectrum_1.dat')
+                nu = data[:,0]
+                y  = data[:,1]
+                f = 2.0*h*nu**3/c**2/(np.exp(h*nu/k/T) - 1)
+                f = f/(sb*T**4/pi)*L
+                max_err,mean_err = get_error(y,f,use=(nu < 3e15))
+                es.append(mean_err)
+
+                # mean intensity at zone 50 against the diluted blackbody
+                fin  = h5py.File('plt_00001.h5','r')
+                nu   = np.array(fin['nu'])
+                Jnu  = np.array(fin['zonedata/50/Jnu'])
+                rz   = np.array(fin['r'])
+                fin.close()
+                f = 2.0*h*nu**2.0/c**2/(np.exp(h*nu/k/T) - 1)*nu
+                f = L*f/(sb*T**4*4.0*pi*r0**2)
+                W = 0.5*(1 - (1 - (r0/rz[50])**2)**0.5)
+                f = W*f
+                max_err,mean_err = get_error(Jnu,f,use=(nu < 3e15))
+                ej.append(mean_err)
+
+            spec_err[mode].append(np.mean(es))
+            Jnu_err[mode].append(np.mean(ej))
+            if (len(wt) > 0): walltime[mode].append(np.mean(wt))
+
+    ###########################################
+    # print and plot the convergence
+    ###########################################
+    print("  n_emit   sampling   spectrum err    Jnu err    wall time (s)")
+    for mode in modes:
+        for i in range(len(n_emit_list)):
+            wt = walltime[mode][i] if (len(walltime[mode]) > i) else 0
+            print("{:8.0e}   {:8s}   {:12.4e} {:12.4e}   {:10.2f}".format(
+                n_emit_list[i],mode,spec_err[mode][i],Jnu_err[mode][i],wt))
+
+    # the quasi-random points cover the core surface, directions
+    # and frequencies evenly, so the errors should be lower
+    if (spec_err["sobol"][-1] > spec_err["random"][-1]): failure = 1
+    if (Jnu_err["sobol"][-1] > Jnu_err["random"][-1]): failure = 2
+    # and the results must still converge
+    if (spec_err["sobol"][-1] > 0.1): failure = 3
+
+    plt.clf()
+    for mode,color in zip(modes,['black','red']):
+        plt.plot(n_emit_list,spec_err[mode],'o-',color=color)
+        plt.plot(n_emit_list,Jnu_err[mode],'s--',color=color)
+    plt.legend(['random spectrum','random Jnu zone 50','sobol spectrum','sobol Jnu zone 50'])
+    plt.title('spherical lightbulb test: convergence with particle number')
+    plt.xlabel('core_n_emit')
+    plt.ylabel('mean relative error')
+    plt.xscale('log')
+    plt.yscale('log')
+
+    if (pdf != ''): pdf.savefig()
+    else:
+        plt.ion()
+        plt.show()
+        j = get_input('Press any key to continue>')
+
+    # this should return !=0 if failed
+    return failure
+
+#-------------------------------------------
+# error calculator helper function
+#-------------------------------------------
+np.seterr(divide='ignore')
+
+def get_error(a,b,x=[],x_comp=[],use=[]):
+
+    """ Function to calculate the error between two arrays
+
+        Args:
+        a: numpy array of result
+        b: numpy array of comparison
+        use: an array of 0's and 1's telling which element
+             in the arrays to include
+        x: optional array of x values to go along with a
+        x_comp: optional array of x values to go along with b
+        (if x and x_comp are set, will interpolate b values to x spacing)
+
+        Returns:
+            returns max_error, mean_error in percentages
+
+    """
+
+    # result array
+    y = a
+    # compare array
+    y_comp = b
+
+    # interpolate comparison if wanted
+    if (len(x) != 0 and len(x_comp !=0)):
+        y_comp = np.interp(x,x_comp,y_comp)
+
+    # cut the array length if wanted
+    if (len(use) > 0):
+        y = y[use]
+        y_comp = y_comp[use]
+    err = abs(y - y_comp)
+
+    with np.errstate(divide='ignore'):
+        max_err = max(err/y_comp)
+        mean_err = np.mean(err)/np.mean(y_comp)
+
+    return max_err,mean_err
+
+
+#-----------------------------------------
+# little function to just plot up and
+# compare results. Reruns the code, as
+# the errors need all the combinations
+#----------------------------------------
+if __name__=='__main__':
+
+    # Support Python 2 and 3 input
+    # Default to Python 3's input()
+    get_input = input
+
+    # If this is Python 2, use raw_input()
+    if sys.version_info[:2] <= (2, 7):
+        get_input = raw_input
+
+    status = run_test('',"mpirun -np 1 ./sedona6.ex param.lua")
+    if (status == 0):
+        print ('SUCCESS')
+    else:
+        print ('FAILURE, code = ' + str(status))
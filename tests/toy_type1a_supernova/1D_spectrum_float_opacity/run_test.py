@@ -0,0 +1,166 @@
+import os
+import matplotlib.pyplot as plt
+import numpy as np
+import sys
+
+# executable built with single precision opacity tables, e.g.
+#   SEDONA_FLOAT_OPACITY=1 ./install.sh MACHINE
+#   cp sedona6.ex sedona6_float.ex
+# then rebuild sedona6.ex in double precision as usual
+float_exec = "sedona6_float.ex"
+float_dir  = "float_opacity"
+
+
+def run_test(pdf="",runcommand=""):
+
+    #-------------------------------------------
+    """ Function to run a test of the sedona code
+
+        Runs the 1D toy type Ia spectrum with single and
+        double precision opacity tables and compares the
+        two spectra
+
+        Args:
+            pdf: pointer to a pdf file to output data to
+            runcommand: string giving the command to run,
+                        e.g., "mpirun -np 6 ./sedona6"
+
+        Returns:
+            an integer ("failure") specifying success or failure of test
+            failure == 0 if success
+            failure != 0 if failed (with the number being some code for what failed)
+
+    """
+    #-------------------------------------------
+
+    testname = "1D toy type1a supernova spectrum - single vs double precision opacity"
+
+    #-------------------------------------------
+    # clean up any old results and run the code
+    # with single, then double precision opacities
+    #-------------------------------------------
+    if (runcommand != ""):
+        os.system("rm -rf " + float_dir)
+        os.system("rm spectrum_* plt_* integrated_quantities.dat")
+        if (not os.path.isfile("../../../src/" + float_exec)):
+            print("no " + float_exec + " found in src/; build it with SEDONA_FLOAT_OPACITY=1")
+            return 1
+        os.system("cp ../../../src/" + float_exec + " .")
+        os.system(runcommand.replace("sedona6.ex",float_exec))
+        os.system("mkdir " + float_dir)
+        os.system("mv spectrum_* plt_* integrated_quantities.dat " + float_dir)
+        os.system(runcommand)
+
+    #-------------------------------------------
+    # compare the output
+    #-------------------------------------------
+    failure = 0
+    plt.clf()
+
+    # double precision spectrum
+    nu,Lnu = np.loadtxt('spectrum_5.dat',unpack=True,skiprows=1,usecols=[0,1])
+    lam = 3e10/nu*1e8
+    Llam = Lnu*nu/lam
+    plt.plot(lam,Llam,color='k',lw=2)
+
+    # single precision spectrum
+    nu,Lnu = np.loadtxt(float_dir + '/spectrum_5.dat',unpack=True,skiprows=1,usecols=[0,1])
+    lam = 3e10/nu*1e8
+    Llam_float = Lnu*nu/lam
+    plt.plot(lam,Llam_float,color='r',lw=2)
+
+    plt.xlim(1000,10000)
+    plt.xlabel('wavelength (angstroms)')
+    plt.ylabel('specific luminoisty (ergs/s/angstrom)')
+    plt.legend(['double','float'])
+    plt.title(testname)
+
+    # the spectra should agree to within the monte carlo noise
+    use = (Llam > max(Llam)*0.1)
+    max_err,mean_err = get_error(Llam_float,Llam,use=use)
+    print("spectrum float vs double: max error = {:.3e}, mean error = {:.3e}".format(max_err,mean_err))
+    if (mean_err > 0.05): failure = 1
+
+    # and the total luminosity more closely
+    L_err = abs(np.sum(Llam_float) - np.sum(Llam))/np.sum(Llam)
+    print("total luminosity float vs double: error = {:.3e}".format(L_err))
+    if (L_err > 0.01): failure = 2
+
+    # add plot to pdf file (or show on screen)
+    if (pdf != ''): pdf.savefig()
+    else:
+        plt.ion()
+        plt.show()
+        j = get_input('Press any key to continue >')
+
+    # this should return !=0 if failed
+    return failure
+
+
+
+#----------------------------------------------
+# helper function for calculating the error
+# between two numpy arrays
+#----------------------------------------------
+
+def get_error(a,b,x=[],x_comp=[],use=[]):
+
+    #-------------------------------------------
+
+    """ Function to calculate the error between two arrays
+
+        Args:
+        a: numpy array of result
+        b: numpy array of comparison
+        use: an array of 0's and 1's telling which element
+             in the arrays to include
+        x: optional array of x values to go along with a
+        x_comp: optional array of x values to go along with b
+        (if x and x_comp are set, will interpolate b values to x spacing)
+
+        Returns:
+            returns max_error, mean_error in percentages
+
+    """
+    #-------------------------------------------------
+
+    # result array
+    y = a
+    # compare array
+    y_comp = b
+
+    # interpolate comparison if wanted
+    if (len(x) != 0 and len(x_comp !=0)):
+        y_comp = np.interp(x,x_comp,y_comp)
+
+    # cut the array length if wanted
+    if (len(use) > 0):
+        y = y[use]
+        y_comp = y_comp[use]
+    err = abs(y - y_comp)
+
+    max_err = max(err/y_comp)
+    mean_err = np.mean(err)/np.mean(y_comp)
+
+    return max_err,mean_err
+
+
+#-----------------------------------------
+# little function to just plot up and
+# compare results. Assumes code has
+# already been run and output files
+# are present
+#----------------------------------------
+if __name__=='__main__':
+
+    # Default to Python 3's input()
+    get_input = input
+    # If this is Python 2, use raw_input()
+    if sys.version_info[:2] <= (2, 7):
+        get_input = raw_input
+
+    status = run_test('')
+    if (status == 0):
+        print ('SUCCESS')
+    else:
+        print ('FAILURE, code = ' + str(status))